@@ -0,0 +1,134 @@
+/*
+ * File:   BatchedScan.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "BatchedScan.h"
+#include "NeighbourList.h"
+#include "KnnIndex.h"  // SearchStats
+#include <algorithm>  // copy, max, min
+using namespace std;
+
+BatchedScan::BatchedScan()
+    : dot_tile_(distanceKernels().dot_tile), points_(NULL), num_features_(0),
+      feature_block_(1), query_group_(kTileQueries)
+{}
+
+/**
+ * Transposes the training set into panels, computes the row norms and sizes
+ * the cache blocks for the number of features.
+ *
+ * @param training_set The labeled examples to compare against.
+ */
+void BatchedScan::build(const FeatureMatrix& training_set)
+{
+  points_ = &training_set;
+  num_features_ = training_set.get_num_features();
+  const int size = training_set.get_num_rows();
+  const int num_panels = (size + kTileRows - 1) / kTileRows;
+  DistanceFunction dot = distanceKernels().dot;
+
+  // Equal feature blocks, none wider than half of L1 holds in a panel.
+  const int widest = kL1Bytes / 2 / (kTileRows * sizeof(float));
+  const int num_blocks = max(1, (num_features_ + widest - 1) / widest);
+  feature_block_ = max(1, (num_features_ + num_blocks - 1) / num_blocks);
+  query_group_ = kL2Bytes / 2 / (feature_block_ * sizeof(float)) /
+                 kTileQueries * kTileQueries;
+  query_group_ = max(query_group_, kTileQueries);
+
+  panels_ = FeatureMatrix(num_features_ * kTileRows);
+  panels_.reserve(num_panels);
+  vector<float> panel(num_features_ * kTileRows + 1);
+  for (int p = 0; p < num_panels; ++p)
+  {
+    fill(panel.begin(), panel.end(), 0.0f);
+    for (int r = 0; r < kTileRows && p * kTileRows + r < size; ++r)
+    {
+      const float* row = training_set.row(p * kTileRows + r);
+      for (int j = 0; j < num_features_; ++j)
+        panel[j * kTileRows + r] = row[j];
+    }
+    panels_.appendRow(&panel[0], p);
+  }
+
+  norms_.resize(size);
+  for (int i = 0; i < size; ++i)
+    norms_[i] = dot(training_set.row(i), training_set.row(i), num_features_);
+}
+
+/**
+ * Ranks the training set for a block of queries. Every panel is multiplied
+ * with all the queries of a group, one feature block at a time, before
+ * moving on to the next panel; the dot products of the feature blocks are
+ * added up per query and row.
+ */
+void BatchedScan::search(const FeatureMatrix& queries, const int begin,
+                         const int end, vector<NeighbourList>& lists,
+                         SearchStats& stats) const
+{
+  const int count = end - begin;
+  const int size = points_->get_num_rows();
+  if (count <= 0) return;
+  DistanceFunction dot = distanceKernels().dot;
+  vector<double> query_norms(count);
+  for (int q = 0; q < count; ++q)
+  {
+    lists[q].reset();
+    const float* query = queries.row(begin + q);
+    query_norms[q] = dot(query, query, num_features_);
+  }
+
+  float tile_dots[kTileQueries * kTileRows];
+  const float* tile[kTileQueries];
+  vector<float> dots(static_cast<size_t>(count) * kTileRows);
+  for (int g0 = 0; g0 < count; g0 += query_group_)
+  {
+    const int group_end = min(count, g0 + query_group_);
+    for (int p = 0; p < panels_.get_num_rows(); ++p)
+    {
+      const float* panel = panels_.row(p);
+      for (int j0 = 0; j0 < num_features_; j0 += feature_block_)
+      {
+        const int width = min(feature_block_, num_features_ - j0);
+        for (int q0 = g0; q0 < group_end; q0 += kTileQueries)
+        {
+          // A short last tile repeats its last query; those sums are ignored.
+          const int tile_queries = min(kTileQueries, group_end - q0);
+          for (int t = 0; t < kTileQueries; ++t)
+            tile[t] = queries.row(begin + q0 + min(t, tile_queries - 1)) + j0;
+          dot_tile_(tile, panel + j0 * kTileRows, width, tile_dots);
+
+          float* sums = &dots[q0 * kTileRows];
+          const int filled = tile_queries * kTileRows;
+          if (j0 == 0)
+            copy(tile_dots, tile_dots + filled, sums);
+          else
+          {
+            for (int i = 0; i < filled; ++i)
+              sums[i] += tile_dots[i];
+          }
+        }
+      }
+
+      const int first_row = p * kTileRows;
+      const int rows = min(kTileRows, size - first_row);
+      for (int q = g0; q < group_end; ++q)
+      {
+        NeighbourList& neighbours = lists[q];
+        const double query_norm = query_norms[q];
+        const float* sums = &dots[q * kTileRows];
+        for (int r = 0; r < rows; ++r)
+        {
+          double distance = query_norm + norms_[first_row + r] - 2.0 * sums[r];
+          if (distance < 0.0) distance = 0.0;  // Rounding near duplicates.
+          neighbours.push(distance, first_row + r,
+                          points_->label(first_row + r));
+        }
+      }
+    }
+  }
+  stats.queries += count;
+  stats.distance_evaluations += static_cast<long>(count) * size;
+}
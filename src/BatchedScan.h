@@ -0,0 +1,65 @@
+/*
+ * File:   BatchedScan.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef BATCHEDSCAN_H
+#define	BATCHEDSCAN_H
+
+#include <vector>
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"
+
+class NeighbourList;
+struct SearchStats;
+
+/**
+ * Brute-force Euclidean kNN for a block of queries at a time, with the
+ * distances computed as a matrix multiplication:
+ *   ||q - x||^2 = ||q||^2 + ||x||^2 - 2 q.x
+ *
+ * The training rows are stored transposed in panels of kTileRows rows and
+ * their squared norms are computed once. The dot products come from the
+ * dot_tile kernel, kTileQueries queries by one panel at a time, so each
+ * training row is read from memory once per block of queries instead of
+ * once per query. The work is blocked for the caches:
+ *   - features are taken in blocks of at most 256 (feature_block_), so the
+ *     part of a panel in use (kTileRows x 256 floats, 16 KB) stays in half
+ *     of a 32 KB L1 cache while every query of the block passes over it;
+ *   - the queries are taken in groups (query_group_) whose rows for one
+ *     feature block fill at most half of a 256 KB L2 cache, so they stay
+ *     there while the group passes over every panel.
+ * With up to 256 features there is a single feature block and the sums are
+ * taken exactly as without blocking.
+ *
+ * The dot products are summed in single precision and the identity cancels
+ * large terms, so near-equal distances can rank differently than with the
+ * row-by-row scan (exactly as with -f); 0/1 data is exact.
+ */
+class BatchedScan
+{
+ public:
+  BatchedScan();
+  void build(const FeatureMatrix& training_set);
+  // Fills lists[0, end - begin) (reset here) with the nearest neighbours of
+  // queries begin to end - 1.
+  void search(const FeatureMatrix& queries, const int begin, const int end,
+              std::vector<NeighbourList>& lists, SearchStats& stats) const;
+
+ private:
+  static const int kL1Bytes = 32 * 1024;  // The smallest data caches of
+  static const int kL2Bytes = 256 * 1024;  // current x86 processors.
+  DotTileFunction dot_tile_;
+  const FeatureMatrix* points_;
+  int num_features_;
+  int feature_block_;  // Features summed per dot_tile call.
+  int query_group_;  // Queries passed over all the panels at a time.
+  // Panel p is row p: feature j of training row p * kTileRows + r is at
+  // j * kTileRows + r. Rows past the end of the training set are zero.
+  FeatureMatrix panels_;
+  std::vector<double> norms_;  // ||x||^2 of every training row.
+};
+
+#endif	/* BATCHEDSCAN_H */
@@ -0,0 +1,82 @@
+/*
+ * File:   BitPackedMatrix.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "BitPackedMatrix.h"
+#include <algorithm>  // find
+#include <vector>
+using namespace std;
+
+BitPackedMatrix::BitPackedMatrix(const vector<bool>& binary_columns)
+{
+  for (int j = 0; j < static_cast<int>(binary_columns.size()); ++j)
+  {
+    if (binary_columns[j])
+      binary_.push_back(j);
+    else
+      continuous_columns_.push_back(j);
+  }
+  num_words_ = (binary_.size() + kWordBits - 1) / kWordBits;
+  continuous_ = FeatureMatrix(continuous_columns_.size());
+}
+
+void BitPackedMatrix::orderContinuous(const vector<int>& feature_order)
+{
+  continuous_columns_.clear();
+  for (size_t j = 0; j < feature_order.size(); ++j)
+  {
+    if (find(binary_.begin(), binary_.end(), feature_order[j]) == binary_.end())
+      continuous_columns_.push_back(feature_order[j]);
+  }
+}
+
+/**
+ * Packs every row of the matrix (replacing any earlier contents).
+ */
+void BitPackedMatrix::build(const FeatureMatrix& matrix)
+{
+  const int size = matrix.get_num_rows();
+  bits_.assign(static_cast<size_t>(size) * num_words_, 0);
+  continuous_.clear();
+  continuous_.reserve(size);
+  vector<float> continuous(continuous_columns_.size() + 1);
+  for (int i = 0; i < size; ++i)
+  {
+    packRow(matrix.row(i), &bits_[0] + i * num_words_, &continuous[0]);
+    continuous_.appendRow(&continuous[0], matrix.label(i));
+  }
+}
+
+/**
+ * Splits one row into its packed bits and continuous attributes.
+ *
+ * @param features A row with all the attributes.
+ * @param bits Receives get_num_words() words.
+ * @param continuous Receives get_num_continuous() floats.
+ */
+void BitPackedMatrix::packRow(const float* features, Word* bits,
+                              float* continuous) const
+{
+  for (int w = 0; w < num_words_; ++w)
+    bits[w] = 0;
+  for (int b = 0; b < static_cast<int>(binary_.size()); ++b)
+  {
+    if (features[binary_[b]] != 0.0f)
+      bits[b / kWordBits] |= Word(1) << (b % kWordBits);
+  }
+  for (int c = 0; c < static_cast<int>(continuous_columns_.size()); ++c)
+    continuous[c] = features[continuous_columns_[c]];
+}
+
+/**
+ * Bytes one packed row takes, padding of the continuous part included.
+ */
+long BitPackedMatrix::bytes_per_row() const
+{
+  return num_words_ * sizeof(Word) +
+         (continuous_columns_.empty() ? 0 :
+          continuous_.get_stride() * sizeof(float));
+}
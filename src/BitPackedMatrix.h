@@ -0,0 +1,56 @@
+/*
+ * File:   BitPackedMatrix.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef BITPACKEDMATRIX_H
+#define	BITPACKEDMATRIX_H
+
+#include <vector>
+#include "FeatureMatrix.h"
+
+/**
+ * A copy of a FeatureMatrix with its binary (0/1) attributes packed into
+ * 64-bit words, one bit each, and the remaining continuous attributes kept
+ * as floats in a FeatureMatrix of their own.
+ *
+ * For a binary attribute the squared difference, absolute difference and
+ * inequality of two rows are all the same 0 or 1, so under every Metric the
+ * distance between two rows is
+ *   popcount(bits_a XOR bits_b) + metric(continuous_a, continuous_b)
+ * which is exact and reads 32 times less memory for the binary part.
+ */
+class BitPackedMatrix
+{
+ public:
+  typedef unsigned long long Word;
+  static const int kWordBits = 64;
+
+  // binary_columns[j] is true for the attributes to pack.
+  explicit BitPackedMatrix(const std::vector<bool>& binary_columns);
+  // Stores the continuous attributes in the order they have in
+  // feature_order (a permutation of all the attributes). Call before build().
+  void orderContinuous(const std::vector<int>& feature_order);
+  void build(const FeatureMatrix& matrix);
+  void packRow(const float* features, Word* bits, float* continuous) const;
+
+  const Word* bits(const int i) const { return &bits_[i * num_words_]; }
+  const float* continuous(const int i) const { return continuous_.row(i); }
+  int label(const int i) const { return continuous_.label(i); }
+  int get_num_rows() const { return continuous_.get_num_rows(); }
+  int get_num_words() const { return num_words_; }
+  int get_num_binary() const { return binary_.size(); }
+  int get_num_continuous() const { return continuous_columns_.size(); }
+  long bytes_per_row() const;
+
+ private:
+  std::vector<int> binary_;  // Attribute of each bit.
+  std::vector<int> continuous_columns_;  // Attribute of each float.
+  int num_words_;
+  std::vector<Word> bits_;  // num_words_ per row.
+  FeatureMatrix continuous_;
+};
+
+#endif	/* BITPACKEDMATRIX_H */
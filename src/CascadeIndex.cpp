@@ -0,0 +1,144 @@
+/*
+ * File:   CascadeIndex.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "CascadeIndex.h"
+#include "NeighbourList.h"
+#include "IndexBlob.h"
+#include <cstdlib>  // abort, strtol
+#include <iostream>
+
+CascadeIndex::CascadeIndex(const std::vector<int>& columns, const int factor,
+                           const Metric metric)
+    : columns_(columns), factor_(factor < 1 ? 1 : factor),
+      distance_(metricKernel(distanceKernels(), metric)), training_set_(NULL)
+{
+}
+
+/**
+ * Copies the subset columns of every training row.
+ *
+ * @param training_set The labeled examples to index.
+ */
+void CascadeIndex::build(const FeatureMatrix& training_set)
+{
+  if (columns_.empty())
+  {
+    std::cerr << "(!) The cascade engine needs the attributes of its first "
+              << "stage (--cascade-columns)\n";
+    abort();
+  }
+  for (size_t c = 0; c < columns_.size(); ++c)
+  {
+    if (columns_[c] < 0 || columns_[c] >= training_set.get_num_features())
+    {
+      std::cerr << "(!) Cascade attribute " << columns_[c] + 1
+                << " is not in the data set\n";
+      abort();
+    }
+  }
+  buildSubset(training_set);
+}
+
+void CascadeIndex::buildSubset(const FeatureMatrix& training_set)
+{
+  training_set_ = &training_set;
+  const int size = training_set.get_num_rows();
+  const int width = columns_.size();
+  subset_ = FeatureMatrix(width);
+  subset_.reserve(size);
+  std::vector<float> row(width + 1);
+  for (int i = 0; i < size; ++i)
+  {
+    const float* features = training_set.row(i);
+    for (int c = 0; c < width; ++c)
+      row[c] = features[columns_[c]];
+    subset_.appendRow(&row[0], training_set.label(i));
+  }
+}
+
+bool CascadeIndex::set_search_effort(const int effort)
+{
+  factor_ = effort < 1 ? 1 : effort;
+  return true;
+}
+
+bool CascadeIndex::save(IndexBlobWriter& out) const
+{
+  out.value(factor_);
+  out.array(columns_);
+  return true;
+}
+
+/**
+ * Reads the factor and columns written by save(); they replace those this
+ * engine was configured with, so a saved model loads without them.
+ */
+bool CascadeIndex::restore(IndexBlobReader& in,
+                           const FeatureMatrix& training_set)
+{
+  const int factor = in.value<int>();
+  std::vector<int> columns;
+  in.array(columns);
+  if (!in.ok() || factor < 1 || columns.empty()) return false;
+  for (size_t c = 0; c < columns.size(); ++c)
+  {
+    if (columns[c] < 0 || columns[c] >= training_set.get_num_features())
+      return false;
+  }
+  factor_ = factor;
+  columns_.swap(columns);
+  buildSubset(training_set);
+  return true;
+}
+
+/**
+ * Ranks every row on the subset, then re-ranks the best factor_ times the
+ * neighbours wanted on all the attributes.
+ */
+void CascadeIndex::search(const float* query, NeighbourList& neighbours,
+                          SearchStats& stats) const
+{
+  ++stats.queries;
+  const int width = columns_.size();
+  std::vector<float> coarse_query(width);
+  for (int c = 0; c < width; ++c)
+    coarse_query[c] = query[columns_[c]];
+
+  const int size = subset_.get_num_rows();
+  NeighbourList candidates(factor_ * neighbours.capacity());
+  for (int i = 0; i < size; ++i)
+    candidates.push(distance_(&coarse_query[0], subset_.row(i), width), i,
+                    subset_.label(i));
+
+  const int num_features = training_set_->get_num_features();
+  for (int j = 0; j < candidates.size(); ++j)
+  {
+    const int row = candidates[j].index;
+    neighbours.push(distance_(query, training_set_->row(row), num_features),
+                    row, candidates[j].classification);
+  }
+  // Both stages compute distances: every row on the subset, the candidates
+  // on all the attributes.
+  stats.candidates += candidates.size();
+  stats.distance_evaluations += size + candidates.size();
+}
+
+bool CascadeIndex::parseColumns(const char* list, std::vector<int>* columns)
+{
+  columns->clear();
+  const char* next = list;
+  for (;;)
+  {
+    char* end;
+    const long column = strtol(next, &end, 10);
+    if (end == next || column < 1) return false;
+    columns->push_back(column - 1);
+    if (*end == '\0') return true;
+    if (*end != ',') return false;
+    next = end + 1;
+  }
+}
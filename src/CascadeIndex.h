@@ -0,0 +1,57 @@
+/*
+ * File:   CascadeIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef CASCADEINDEX_H
+#define	CASCADEINDEX_H
+
+#include <vector>
+#include "KnnIndex.h"
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"
+
+/**
+ * Two-stage kNN (approximate). Every training row is first ranked on a
+ * few of its attributes (e.g. those picked by data/feature_selection.sh),
+ * which is cheap; the factor * k best of that ranking are then re-ranked on
+ * all the attributes. The true neighbours are missed when they rank below
+ * the cut on the subset, so the factor (the search effort) trades speed for
+ * recall; --recall-report shows how often that happens.
+ *
+ * The subset columns are copied into a compact matrix so the coarse scan
+ * reads only them.
+ */
+class CascadeIndex : public KnnIndex
+{
+ public:
+  // columns are attribute numbers (from 0); they may be empty for an index
+  // that is restored rather than built.
+  CascadeIndex(const std::vector<int>& columns, const int factor,
+               const Metric metric);
+  const char* name() const { return "cascade"; }
+  void build(const FeatureMatrix& training_set);
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  bool exact() const { return false; }
+  bool set_search_effort(const int effort);
+  int get_search_effort() const { return factor_; }
+  bool save(IndexBlobWriter& out) const;
+  bool restore(IndexBlobReader& in, const FeatureMatrix& training_set);
+
+  // Reads a comma-separated list of attribute numbers counted from 1 (as
+  // awk numbers the columns); false if it is not one.
+  static bool parseColumns(const char* list, std::vector<int>* columns);
+
+ private:
+  void buildSubset(const FeatureMatrix& training_set);
+  std::vector<int> columns_;
+  int factor_;  // Rows re-ranked per neighbour wanted.
+  DistanceFunction distance_;
+  const FeatureMatrix* training_set_;
+  FeatureMatrix subset_;  // The columns_ of every training row.
+};
+
+#endif	/* CASCADEINDEX_H */
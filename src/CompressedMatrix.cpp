@@ -0,0 +1,130 @@
+/*
+ * File:   CompressedMatrix.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "CompressedMatrix.h"
+#include <cmath>
+#include <cstdlib>  // abort
+#include <cstring>  // strcmp
+#include <iostream>
+#include <limits>
+using namespace std;
+
+namespace {
+
+const int kMaxCode = 255;
+
+}  // namespace
+
+CompressedMatrix::CompressedMatrix(const Precision precision,
+                                   const Metric metric)
+    : precision_(precision), metric_(metric), half_distance_(NULL),
+      byte_distance_(NULL), num_features_(0), stride_(0)
+{
+  const DistanceKernels& kernels = distanceKernels();
+  if (metric == kEuclidean)
+  {
+    half_distance_ = kernels.half_squared_l2;
+    byte_distance_ = kernels.byte_squared_l2;
+  }
+  else if (metric == kManhattan)
+  {
+    half_distance_ = kernels.half_l1;
+    byte_distance_ = kernels.byte_l1;
+  }
+  else
+  {
+    cerr << "(!) Reduced-precision storage only supports the euclidean and "
+         << "manhattan metrics\n";
+    abort();
+  }
+}
+
+/**
+ * Encodes every row of the matrix (replacing any earlier contents). The int8
+ * codes span each attribute's range in this matrix.
+ */
+void CompressedMatrix::build(const FeatureMatrix& matrix)
+{
+  num_features_ = matrix.get_num_features();
+  const int size = matrix.get_num_rows();
+  stride_ = (num_features_ + kRowValues - 1) / kRowValues * kRowValues;
+  labels_.assign(matrix.labels(), matrix.labels() + size);
+
+  if (precision_ == kFp16)
+  {
+    halves_.assign(static_cast<size_t>(size) * stride_, 0);
+    for (int i = 0; i < size; ++i)
+    {
+      const float* row = matrix.row(i);
+      for (int j = 0; j < num_features_; ++j)
+        halves_[i * stride_ + j] = floatToHalf(row[j]);
+    }
+    return;
+  }
+
+  offsets_.assign(num_features_, numeric_limits<float>::max());
+  vector<float> highest(num_features_, -numeric_limits<float>::max());
+  for (int i = 0; i < size; ++i)
+  {
+    const float* row = matrix.row(i);
+    for (int j = 0; j < num_features_; ++j)
+    {
+      if (row[j] < offsets_[j]) offsets_[j] = row[j];
+      if (row[j] > highest[j]) highest[j] = row[j];
+    }
+  }
+  scales_.resize(num_features_);
+  weights_.assign(stride_, 0.0f);
+  for (int j = 0; j < num_features_; ++j)
+  {
+    if (size == 0) offsets_[j] = 0.0f;
+    const float range = size > 0 ? highest[j] - offsets_[j] : 0.0f;
+    // A constant attribute gets scale 1 and code 0 for every row.
+    scales_[j] = range > 0.0f ? range / kMaxCode : 1.0f;
+    weights_[j] = metric_ == kEuclidean ? scales_[j] * scales_[j]
+                                        : scales_[j];
+  }
+  bytes_.assign(static_cast<size_t>(size) * stride_, 0);
+  for (int i = 0; i < size; ++i)
+  {
+    const float* row = matrix.row(i);
+    for (int j = 0; j < num_features_; ++j)
+    {
+      const int code = static_cast<int>(
+          floor((row[j] - offsets_[j]) / scales_[j] + 0.5f));
+      bytes_[i * stride_ + j] = static_cast<unsigned char>(
+          code < 0 ? 0 : code > kMaxCode ? kMaxCode : code);
+    }
+  }
+}
+
+void CompressedMatrix::prepareQuery(const float* query, float* prepared) const
+{
+  for (int j = 0; j < num_features_; ++j)
+  {
+    prepared[j] = precision_ == kFp16 ? query[j]
+                                      : (query[j] - offsets_[j]) / scales_[j];
+  }
+  for (int j = num_features_; j < stride_; ++j)
+    prepared[j] = 0.0f;
+}
+
+/**
+ * Bytes one encoded row takes, padding included.
+ */
+long CompressedMatrix::bytes_per_row() const
+{
+  return static_cast<long>(stride_) * (precision_ == kFp16 ? 2 : 1);
+}
+
+bool CompressedMatrix::parsePrecision(const char* name, Precision* precision)
+{
+  if (strcmp(name, "fp16") == 0) *precision = kFp16;
+  else if (strcmp(name, "int8") == 0) *precision = kInt8;
+  else return false;
+  return true;
+}
@@ -0,0 +1,74 @@
+/*
+ * File:   CompressedMatrix.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef COMPRESSEDMATRIX_H
+#define	COMPRESSEDMATRIX_H
+
+#include <vector>
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"
+
+/**
+ * A copy of a FeatureMatrix in reduced precision, for scanning with less
+ * memory traffic:
+ *   fp16  every value as an IEEE half (2 bytes; 11 significant bits, so
+ *         about 3 decimal digits for the normalized [0, 1] attributes)
+ *   int8  every value as a byte code c, x ~ offset + scale * c, with the
+ *         offset and scale of each attribute set by its training range
+ *
+ * Queries stay in full precision. For int8 a query is first mapped into
+ * code units once (prepareQuery) so the kernels only widen the codes.
+ * Distances are summed in single precision. Rows are padded with zeros (and
+ * zero weights) to a multiple of kRowValues, so the kernels run over whole
+ * vectors without a scalar tail.
+ */
+class CompressedMatrix
+{
+ public:
+  enum Precision { kFp16, kInt8 };
+  static const int kRowValues = 16;  // One AVX-512 vector of floats.
+
+  CompressedMatrix(const Precision precision, const Metric metric);
+  void build(const FeatureMatrix& matrix);
+  // Writes the query in the form distance() expects: for int8 it is mapped
+  // into code units, for fp16 it is copied. prepared needs room for
+  // get_stride() floats; the padding is zeroed.
+  void prepareQuery(const float* query, float* prepared) const;
+  // Distance under the metric from a prepared query to row i, ranked like
+  // the float kernels (squared for euclidean).
+  double distance(const float* prepared, const int i) const
+  {
+    if (precision_ == kFp16)
+      return half_distance_(prepared, &halves_[i * stride_], stride_);
+    return byte_distance_(prepared, &bytes_[i * stride_], &weights_[0],
+                          stride_);
+  }
+  int label(const int i) const { return labels_[i]; }
+  int get_num_rows() const { return labels_.size(); }
+  int get_num_features() const { return num_features_; }
+  int get_stride() const { return stride_; }
+  long bytes_per_row() const;
+
+  // Reads "fp16" or "int8"; returns false for anything else.
+  static bool parsePrecision(const char* name, Precision* precision);
+
+ private:
+  Precision precision_;
+  Metric metric_;
+  HalfDistanceFunction half_distance_;
+  ByteDistanceFunction byte_distance_;
+  int num_features_;
+  int stride_;  // Values between row starts (a multiple of kRowValues).
+  std::vector<unsigned short> halves_;  // fp16 rows.
+  std::vector<unsigned char> bytes_;  // int8 rows.
+  std::vector<float> offsets_;  // int8: value of code 0 per attribute.
+  std::vector<float> scales_;  // int8: value step per code.
+  std::vector<float> weights_;  // int8: scale^2 (euclidean) or scale.
+  std::vector<int> labels_;
+};
+
+#endif	/* COMPRESSEDMATRIX_H */
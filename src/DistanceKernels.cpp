@@ -0,0 +1,1425 @@
+/*
+ * File:   DistanceKernels.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ *
+ * Each kernel is compiled for its instruction set with a GCC target
+ * attribute. Differences are always taken in single precision (like the
+ * original scalar loop); with double-precision accumulation they are widened
+ * before being squared and summed. Leftover features that do not fill a
+ * vector are handled by a scalar tail (or a masked load on AVX-512).
+ */
+
+#include "DistanceKernels.h"
+#include <cmath>
+#include <algorithm>  // max
+#include <cstddef>  // NULL
+#include <cstring>  // strcmp, memcpy
+#include <immintrin.h>
+
+namespace {
+
+// The bounded kernels (the ...Kernel<true> instantiations) compare their
+// partial sum with the bound every kCheckFeatures features. The plain
+// kernels are the same code with the checks compiled out, so a row that is
+// not abandoned gets exactly the plain kernel's distance.
+const int kCheckFeatures = 16;
+
+// === Scalar (portable fallback)
+
+template <bool kBounded>
+double scalarSquaredL2Kernel(const float* a, const float* b, const int n,
+                             const double bound, int* examined)
+{
+  double sum = 0.0;
+  for (int i = 0; i < n; ++i)
+  {
+    double d = a[i] - b[i];
+    sum += d * d;
+    if (kBounded && (i + 1) % kCheckFeatures == 0 && sum > bound)
+    {
+      *examined = i + 1;
+      return sum;
+    }
+  }
+  if (kBounded) *examined = n;
+  return sum;
+}
+
+double scalarSquaredL2(const float* a, const float* b, const int n)
+{
+  return scalarSquaredL2Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+double scalarL1Kernel(const float* a, const float* b, const int n,
+                      const double bound, int* examined)
+{
+  double sum = 0.0;
+  for (int i = 0; i < n; ++i)
+  {
+    sum += std::fabs(a[i] - b[i]);
+    if (kBounded && (i + 1) % kCheckFeatures == 0 && sum > bound)
+    {
+      *examined = i + 1;
+      return sum;
+    }
+  }
+  if (kBounded) *examined = n;
+  return sum;
+}
+
+double scalarL1(const float* a, const float* b, const int n)
+{
+  return scalarL1Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+double scalarDot(const float* a, const float* b, const int n)
+{
+  double sum = 0.0;
+  for (int i = 0; i < n; ++i)
+    sum += static_cast<double>(a[i]) * b[i];
+  return sum;
+}
+
+double scalarHamming(const float* a, const float* b, const int n)
+{
+  int count = 0;
+  for (int i = 0; i < n; ++i)
+    count += (a[i] != b[i]);
+  return count;
+}
+
+template <bool kBounded>
+double scalarSquaredL2FloatKernel(const float* a, const float* b, const int n,
+                                  const double bound, int* examined)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < n; ++i)
+  {
+    float d = a[i] - b[i];
+    sum += d * d;
+    if (kBounded && (i + 1) % kCheckFeatures == 0 && sum > bound)
+    {
+      *examined = i + 1;
+      return sum;
+    }
+  }
+  if (kBounded) *examined = n;
+  return sum;
+}
+
+double scalarSquaredL2Float(const float* a, const float* b, const int n)
+{
+  return scalarSquaredL2FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+double scalarL1FloatKernel(const float* a, const float* b, const int n,
+                           const double bound, int* examined)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < n; ++i)
+  {
+    sum += std::fabs(a[i] - b[i]);
+    if (kBounded && (i + 1) % kCheckFeatures == 0 && sum > bound)
+    {
+      *examined = i + 1;
+      return sum;
+    }
+  }
+  if (kBounded) *examined = n;
+  return sum;
+}
+
+double scalarL1Float(const float* a, const float* b, const int n)
+{
+  return scalarL1FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+double scalarDotFloat(const float* a, const float* b, const int n)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < n; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+// Largest difference; exact, so one kernel serves both accumulations.
+double scalarChebyshev(const float* a, const float* b, const int n)
+{
+  float largest = 0.0f;
+  for (int i = 0; i < n; ++i)
+  {
+    const float d = std::fabs(a[i] - b[i]);
+    if (d > largest) largest = d;
+  }
+  return largest;
+}
+
+// 1 - cos(a, b) from the dot product and the squared norms. A zero row has
+// no direction: it is at distance 0 from another zero row, 1 from the rest.
+inline double cosineDistance(const double dot, const double a_norm,
+                             const double b_norm)
+{
+  if (a_norm <= 0.0 || b_norm <= 0.0)
+    return a_norm == b_norm ? 0.0 : 1.0;
+  const double distance = 1.0 - dot / std::sqrt(a_norm * b_norm);
+  return distance > 0.0 ? distance : 0.0;  // Rounding of parallel rows.
+}
+
+// Sums of a_i * b_i, a_i^2 and b_i^2, added to the totals given.
+template <typename Sum>
+void cosineSums(const float* a, const float* b, const int n, Sum* dot,
+                Sum* a_norm, Sum* b_norm)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    *dot += static_cast<Sum>(a[i]) * b[i];
+    *a_norm += static_cast<Sum>(a[i]) * a[i];
+    *b_norm += static_cast<Sum>(b[i]) * b[i];
+  }
+}
+
+double scalarCosine(const float* a, const float* b, const int n)
+{
+  double dot = 0.0, a_norm = 0.0, b_norm = 0.0;
+  cosineSums(a, b, n, &dot, &a_norm, &b_norm);
+  return cosineDistance(dot, a_norm, b_norm);
+}
+
+double scalarCosineFloat(const float* a, const float* b, const int n)
+{
+  float dot = 0.0f, a_norm = 0.0f, b_norm = 0.0f;
+  cosineSums(a, b, n, &dot, &a_norm, &b_norm);
+  return cosineDistance(dot, a_norm, b_norm);
+}
+
+int scalarBitHamming(const unsigned long long* a,
+                     const unsigned long long* b, const int words)
+{
+  int count = 0;
+  for (int i = 0; i < words; ++i)
+    count += __builtin_popcountll(a[i] ^ b[i]);
+  return count;
+}
+
+// The dot product tile is written once in plain C++; each instruction set
+// gets its own copy through the target attribute of the wrapper it is
+// inlined into, and the compiler keeps the whole tile of sums in vector
+// registers.
+inline __attribute__((always_inline))
+void dotTile(const float* const* queries, const float* panel, const int n,
+             float* dots)
+{
+  float sums[kTileQueries][kTileRows];
+  for (int q = 0; q < kTileQueries; ++q)
+  {
+    for (int r = 0; r < kTileRows; ++r)
+      sums[q][r] = 0.0f;
+  }
+  for (int j = 0; j < n; ++j)
+  {
+    const float* column = panel + j * kTileRows;
+    for (int q = 0; q < kTileQueries; ++q)
+    {
+      const float value = queries[q][j];
+      for (int r = 0; r < kTileRows; ++r)
+        sums[q][r] += value * column[r];
+    }
+  }
+  for (int q = 0; q < kTileQueries; ++q)
+  {
+    for (int r = 0; r < kTileRows; ++r)
+      dots[q * kTileRows + r] = sums[q][r];
+  }
+}
+
+void scalarDotTile(const float* const* queries, const float* panel,
+                   const int n, float* dots)
+{
+  dotTile(queries, panel, n, dots);
+}
+
+double scalarHalfSquaredL2(const float* query, const unsigned short* row,
+                           const int n)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < n; ++i)
+  {
+    float d = query[i] - halfToFloat(row[i]);
+    sum += d * d;
+  }
+  return sum;
+}
+
+double scalarHalfL1(const float* query, const unsigned short* row,
+                    const int n)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < n; ++i)
+    sum += std::fabs(query[i] - halfToFloat(row[i]));
+  return sum;
+}
+
+double scalarByteSquaredL2(const float* query, const unsigned char* row,
+                           const float* weights, const int n)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < n; ++i)
+  {
+    float d = query[i] - row[i];
+    sum += weights[i] * d * d;
+  }
+  return sum;
+}
+
+double scalarByteL1(const float* query, const unsigned char* row,
+                    const float* weights, const int n)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < n; ++i)
+    sum += weights[i] * std::fabs(query[i] - row[i]);
+  return sum;
+}
+
+// === POPCNT (one instruction per 64 bits; every SSE4.2 CPU has it)
+
+__attribute__((target("popcnt")))
+int popcntBitHamming(const unsigned long long* a,
+                     const unsigned long long* b, const int words)
+{
+  // Independent counters keep several popcnt instructions in flight.
+  int count0 = 0, count1 = 0, count2 = 0, count3 = 0;
+  int i = 0;
+  for (; i + 4 <= words; i += 4)
+  {
+    count0 += __builtin_popcountll(a[i] ^ b[i]);
+    count1 += __builtin_popcountll(a[i + 1] ^ b[i + 1]);
+    count2 += __builtin_popcountll(a[i + 2] ^ b[i + 2]);
+    count3 += __builtin_popcountll(a[i + 3] ^ b[i + 3]);
+  }
+  for (; i < words; ++i)
+    count0 += __builtin_popcountll(a[i] ^ b[i]);
+  return count0 + count1 + count2 + count3;
+}
+
+// === SSE4.2 (4 floats per vector)
+
+#define SSE_TARGET __attribute__((target("sse4.2")))
+
+SSE_TARGET inline double sseSum(const __m128d v)
+{
+  return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+SSE_TARGET inline float sseSum(const __m128 v)
+{
+  __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+template <bool kBounded>
+SSE_TARGET double sseSquaredL2Kernel(const float* a, const float* b,
+                                     const int n, const double bound,
+                                     int* examined)
+{
+  __m128d lo_sum = _mm_setzero_pd(), hi_sum = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    __m128d lo = _mm_cvtps_pd(d), hi = _mm_cvtps_pd(_mm_movehl_ps(d, d));
+    lo_sum = _mm_add_pd(lo_sum, _mm_mul_pd(lo, lo));
+    hi_sum = _mm_add_pd(hi_sum, _mm_mul_pd(hi, hi));
+    if (kBounded && (i + 4) % kCheckFeatures == 0 &&
+        sseSum(_mm_add_pd(lo_sum, hi_sum)) > bound)
+    {
+      *examined = i + 4;
+      return sseSum(_mm_add_pd(lo_sum, hi_sum));
+    }
+  }
+  if (kBounded) *examined = n;
+  return sseSum(_mm_add_pd(lo_sum, hi_sum)) + scalarSquaredL2(a + i, b + i,
+                                                               n - i);
+}
+
+SSE_TARGET double sseSquaredL2(const float* a, const float* b, const int n)
+{
+  return sseSquaredL2Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+SSE_TARGET double sseL1Kernel(const float* a, const float* b, const int n,
+                              const double bound, int* examined)
+{
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128d lo_sum = _mm_setzero_pd(), hi_sum = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 d = _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(a + i),
+                                              _mm_loadu_ps(b + i)));
+    lo_sum = _mm_add_pd(lo_sum, _mm_cvtps_pd(d));
+    hi_sum = _mm_add_pd(hi_sum, _mm_cvtps_pd(_mm_movehl_ps(d, d)));
+    if (kBounded && (i + 4) % kCheckFeatures == 0 &&
+        sseSum(_mm_add_pd(lo_sum, hi_sum)) > bound)
+    {
+      *examined = i + 4;
+      return sseSum(_mm_add_pd(lo_sum, hi_sum));
+    }
+  }
+  if (kBounded) *examined = n;
+  return sseSum(_mm_add_pd(lo_sum, hi_sum)) + scalarL1(a + i, b + i, n - i);
+}
+
+SSE_TARGET double sseL1(const float* a, const float* b, const int n)
+{
+  return sseL1Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+SSE_TARGET double sseDot(const float* a, const float* b, const int n)
+{
+  __m128d lo_sum = _mm_setzero_pd(), hi_sum = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 va = _mm_loadu_ps(a + i), vb = _mm_loadu_ps(b + i);
+    lo_sum = _mm_add_pd(lo_sum, _mm_mul_pd(_mm_cvtps_pd(va),
+                                           _mm_cvtps_pd(vb)));
+    hi_sum = _mm_add_pd(hi_sum,
+                        _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(va, va)),
+                                   _mm_cvtps_pd(_mm_movehl_ps(vb, vb))));
+  }
+  return sseSum(_mm_add_pd(lo_sum, hi_sum)) + scalarDot(a + i, b + i, n - i);
+}
+
+SSE_TARGET double sseHamming(const float* a, const float* b, const int n)
+{
+  int count = 0;
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    int differ = _mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(a + i),
+                                               _mm_loadu_ps(b + i)));
+    count += __builtin_popcount(differ);
+  }
+  return count + scalarHamming(a + i, b + i, n - i);
+}
+
+template <bool kBounded>
+SSE_TARGET double sseSquaredL2FloatKernel(const float* a, const float* b,
+                                          const int n, const double bound,
+                                          int* examined)
+{
+  __m128 sum = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+    if (kBounded && (i + 4) % kCheckFeatures == 0 && sseSum(sum) > bound)
+    {
+      *examined = i + 4;
+      return sseSum(sum);
+    }
+  }
+  if (kBounded) *examined = n;
+  return sseSum(sum) + scalarSquaredL2Float(a + i, b + i, n - i);
+}
+
+SSE_TARGET double sseSquaredL2Float(const float* a, const float* b, const int n)
+{
+  return sseSquaredL2FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+SSE_TARGET double sseL1FloatKernel(const float* a, const float* b, const int n,
+                                   const double bound, int* examined)
+{
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 sum = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    sum = _mm_add_ps(sum, _mm_andnot_ps(sign, d));
+    if (kBounded && (i + 4) % kCheckFeatures == 0 && sseSum(sum) > bound)
+    {
+      *examined = i + 4;
+      return sseSum(sum);
+    }
+  }
+  if (kBounded) *examined = n;
+  return sseSum(sum) + scalarL1Float(a + i, b + i, n - i);
+}
+
+SSE_TARGET double sseL1Float(const float* a, const float* b, const int n)
+{
+  return sseL1FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+SSE_TARGET double sseDotFloat(const float* a, const float* b, const int n)
+{
+  __m128 sum = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                     _mm_loadu_ps(b + i)));
+  return sseSum(sum) + scalarDotFloat(a + i, b + i, n - i);
+}
+
+SSE_TARGET double sseChebyshev(const float* a, const float* b, const int n)
+{
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 largest = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    largest = _mm_max_ps(largest, _mm_andnot_ps(
+        sign, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i))));
+  largest = _mm_max_ps(largest, _mm_movehl_ps(largest, largest));
+  largest = _mm_max_ss(largest, _mm_shuffle_ps(largest, largest, 1));
+  return std::max(static_cast<double>(_mm_cvtss_f32(largest)),
+                  scalarChebyshev(a + i, b + i, n - i));
+}
+
+SSE_TARGET double sseCosine(const float* a, const float* b, const int n)
+{
+  __m128d dot = _mm_setzero_pd(), a_norm = _mm_setzero_pd(),
+          b_norm = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 va = _mm_loadu_ps(a + i), vb = _mm_loadu_ps(b + i);
+    __m128d a_lo = _mm_cvtps_pd(va), a_hi = _mm_cvtps_pd(_mm_movehl_ps(va, va));
+    __m128d b_lo = _mm_cvtps_pd(vb), b_hi = _mm_cvtps_pd(_mm_movehl_ps(vb, vb));
+    dot = _mm_add_pd(dot, _mm_add_pd(_mm_mul_pd(a_lo, b_lo),
+                                     _mm_mul_pd(a_hi, b_hi)));
+    a_norm = _mm_add_pd(a_norm, _mm_add_pd(_mm_mul_pd(a_lo, a_lo),
+                                           _mm_mul_pd(a_hi, a_hi)));
+    b_norm = _mm_add_pd(b_norm, _mm_add_pd(_mm_mul_pd(b_lo, b_lo),
+                                           _mm_mul_pd(b_hi, b_hi)));
+  }
+  double dot_sum = sseSum(dot), a_sum = sseSum(a_norm), b_sum = sseSum(b_norm);
+  cosineSums(a + i, b + i, n - i, &dot_sum, &a_sum, &b_sum);
+  return cosineDistance(dot_sum, a_sum, b_sum);
+}
+
+SSE_TARGET double sseCosineFloat(const float* a, const float* b, const int n)
+{
+  __m128 dot = _mm_setzero_ps(), a_norm = _mm_setzero_ps(),
+         b_norm = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 va = _mm_loadu_ps(a + i), vb = _mm_loadu_ps(b + i);
+    dot = _mm_add_ps(dot, _mm_mul_ps(va, vb));
+    a_norm = _mm_add_ps(a_norm, _mm_mul_ps(va, va));
+    b_norm = _mm_add_ps(b_norm, _mm_mul_ps(vb, vb));
+  }
+  float dot_sum = sseSum(dot), a_sum = sseSum(a_norm), b_sum = sseSum(b_norm);
+  cosineSums(a + i, b + i, n - i, &dot_sum, &a_sum, &b_sum);
+  return cosineDistance(dot_sum, a_sum, b_sum);
+}
+
+SSE_TARGET void sseDotTile(const float* const* queries, const float* panel,
+                           const int n, float* dots)
+{
+  dotTile(queries, panel, n, dots);
+}
+
+// === AVX2 (8 floats per vector)
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET inline double avxSum(const __m256d v)
+{
+  __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v),
+                            _mm256_extractf128_pd(v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+AVX2_TARGET inline float avxSum(const __m256 v)
+{
+  __m128 quad = _mm_add_ps(_mm256_castps256_ps128(v),
+                           _mm256_extractf128_ps(v, 1));
+  __m128 pairs = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+  return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+template <bool kBounded>
+AVX2_TARGET double avx2SquaredL2Kernel(const float* a, const float* b,
+                                       const int n, const double bound,
+                                       int* examined)
+{
+  __m256d lo_sum = _mm256_setzero_pd(), hi_sum = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+    __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+    lo_sum = _mm256_add_pd(lo_sum, _mm256_mul_pd(lo, lo));
+    hi_sum = _mm256_add_pd(hi_sum, _mm256_mul_pd(hi, hi));
+    if (kBounded && (i + 8) % kCheckFeatures == 0 &&
+        avxSum(_mm256_add_pd(lo_sum, hi_sum)) > bound)
+    {
+      *examined = i + 8;
+      return avxSum(_mm256_add_pd(lo_sum, hi_sum));
+    }
+  }
+  if (kBounded) *examined = n;
+  return avxSum(_mm256_add_pd(lo_sum, hi_sum)) +
+         scalarSquaredL2(a + i, b + i, n - i);
+}
+
+AVX2_TARGET double avx2SquaredL2(const float* a, const float* b, const int n)
+{
+  return avx2SquaredL2Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+AVX2_TARGET double avx2L1Kernel(const float* a, const float* b, const int n,
+                                const double bound, int* examined)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256d lo_sum = _mm256_setzero_pd(), hi_sum = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_andnot_ps(sign, _mm256_sub_ps(_mm256_loadu_ps(a + i),
+                                                    _mm256_loadu_ps(b + i)));
+    lo_sum = _mm256_add_pd(lo_sum,
+                           _mm256_cvtps_pd(_mm256_castps256_ps128(d)));
+    hi_sum = _mm256_add_pd(hi_sum,
+                           _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1)));
+    if (kBounded && (i + 8) % kCheckFeatures == 0 &&
+        avxSum(_mm256_add_pd(lo_sum, hi_sum)) > bound)
+    {
+      *examined = i + 8;
+      return avxSum(_mm256_add_pd(lo_sum, hi_sum));
+    }
+  }
+  if (kBounded) *examined = n;
+  return avxSum(_mm256_add_pd(lo_sum, hi_sum)) + scalarL1(a + i, b + i, n - i);
+}
+
+AVX2_TARGET double avx2L1(const float* a, const float* b, const int n)
+{
+  return avx2L1Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+AVX2_TARGET double avx2Dot(const float* a, const float* b, const int n)
+{
+  __m256d lo_sum = _mm256_setzero_pd(), hi_sum = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 va = _mm256_loadu_ps(a + i), vb = _mm256_loadu_ps(b + i);
+    lo_sum = _mm256_add_pd(lo_sum, _mm256_mul_pd(
+        _mm256_cvtps_pd(_mm256_castps256_ps128(va)),
+        _mm256_cvtps_pd(_mm256_castps256_ps128(vb))));
+    hi_sum = _mm256_add_pd(hi_sum, _mm256_mul_pd(
+        _mm256_cvtps_pd(_mm256_extractf128_ps(va, 1)),
+        _mm256_cvtps_pd(_mm256_extractf128_ps(vb, 1))));
+  }
+  return avxSum(_mm256_add_pd(lo_sum, hi_sum)) + scalarDot(a + i, b + i,
+                                                           n - i);
+}
+
+AVX2_TARGET double avx2Hamming(const float* a, const float* b, const int n)
+{
+  int count = 0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    int differ = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a + i),
+                                                  _mm256_loadu_ps(b + i),
+                                                  _CMP_NEQ_UQ));
+    count += __builtin_popcount(differ);
+  }
+  return count + scalarHamming(a + i, b + i, n - i);
+}
+
+template <bool kBounded>
+AVX2_TARGET double avx2SquaredL2FloatKernel(const float* a, const float* b,
+                                            const int n, const double bound,
+                                            int* examined)
+{
+  __m256 sum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(d, d));
+    if (kBounded && (i + 8) % kCheckFeatures == 0 && avxSum(sum) > bound)
+    {
+      *examined = i + 8;
+      return avxSum(sum);
+    }
+  }
+  if (kBounded) *examined = n;
+  return avxSum(sum) + scalarSquaredL2Float(a + i, b + i, n - i);
+}
+
+AVX2_TARGET double avx2SquaredL2Float(const float* a, const float* b,
+                                      const int n)
+{
+  return avx2SquaredL2FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+AVX2_TARGET double avx2L1FloatKernel(const float* a, const float* b,
+                                     const int n, const double bound,
+                                     int* examined)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 sum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    sum = _mm256_add_ps(sum, _mm256_andnot_ps(sign, d));
+    if (kBounded && (i + 8) % kCheckFeatures == 0 && avxSum(sum) > bound)
+    {
+      *examined = i + 8;
+      return avxSum(sum);
+    }
+  }
+  if (kBounded) *examined = n;
+  return avxSum(sum) + scalarL1Float(a + i, b + i, n - i);
+}
+
+AVX2_TARGET double avx2L1Float(const float* a, const float* b, const int n)
+{
+  return avx2L1FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+AVX2_TARGET double avx2DotFloat(const float* a, const float* b, const int n)
+{
+  __m256 sum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                           _mm256_loadu_ps(b + i)));
+  return avxSum(sum) + scalarDotFloat(a + i, b + i, n - i);
+}
+
+AVX2_TARGET double avx2Chebyshev(const float* a, const float* b, const int n)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 largest = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    largest = _mm256_max_ps(largest, _mm256_andnot_ps(
+        sign, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i))));
+  __m128 quad = _mm_max_ps(_mm256_castps256_ps128(largest),
+                           _mm256_extractf128_ps(largest, 1));
+  quad = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+  quad = _mm_max_ss(quad, _mm_shuffle_ps(quad, quad, 1));
+  return std::max(static_cast<double>(_mm_cvtss_f32(quad)),
+                  scalarChebyshev(a + i, b + i, n - i));
+}
+
+AVX2_TARGET double avx2Cosine(const float* a, const float* b, const int n)
+{
+  __m256d dot = _mm256_setzero_pd(), a_norm = _mm256_setzero_pd(),
+          b_norm = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d va = _mm256_cvtps_pd(_mm_loadu_ps(a + i));
+    __m256d vb = _mm256_cvtps_pd(_mm_loadu_ps(b + i));
+    dot = _mm256_add_pd(dot, _mm256_mul_pd(va, vb));
+    a_norm = _mm256_add_pd(a_norm, _mm256_mul_pd(va, va));
+    b_norm = _mm256_add_pd(b_norm, _mm256_mul_pd(vb, vb));
+  }
+  double dot_sum = avxSum(dot), a_sum = avxSum(a_norm),
+         b_sum = avxSum(b_norm);
+  cosineSums(a + i, b + i, n - i, &dot_sum, &a_sum, &b_sum);
+  return cosineDistance(dot_sum, a_sum, b_sum);
+}
+
+AVX2_TARGET double avx2CosineFloat(const float* a, const float* b,
+                                   const int n)
+{
+  __m256 dot = _mm256_setzero_ps(), a_norm = _mm256_setzero_ps(),
+         b_norm = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 va = _mm256_loadu_ps(a + i), vb = _mm256_loadu_ps(b + i);
+    dot = _mm256_add_ps(dot, _mm256_mul_ps(va, vb));
+    a_norm = _mm256_add_ps(a_norm, _mm256_mul_ps(va, va));
+    b_norm = _mm256_add_ps(b_norm, _mm256_mul_ps(vb, vb));
+  }
+  float dot_sum = avxSum(dot), a_sum = avxSum(a_norm), b_sum = avxSum(b_norm);
+  cosineSums(a + i, b + i, n - i, &dot_sum, &a_sum, &b_sum);
+  return cosineDistance(dot_sum, a_sum, b_sum);
+}
+
+AVX2_TARGET void avx2DotTile(const float* const* queries,
+                             const float* panel, const int n, float* dots)
+{
+  dotTile(queries, panel, n, dots);
+}
+
+// The half-precision conversions need F16C as well; detectInstructionSet()
+// only picks the AVX2 kernels where both are present.
+#define F16C_TARGET __attribute__((target("avx2,f16c")))
+
+F16C_TARGET inline __m256 loadHalves(const unsigned short* row)
+{
+  return _mm256_cvtph_ps(_mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(row)));
+}
+
+AVX2_TARGET inline __m256 loadBytes(const unsigned char* row)
+{
+  return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(
+      reinterpret_cast<const __m128i*>(row))));
+}
+
+F16C_TARGET double avx2HalfSquaredL2(const float* query,
+                                     const unsigned short* row, const int n)
+{
+  __m256 sum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(query + i), loadHalves(row + i));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(d, d));
+  }
+  return avxSum(sum) + scalarHalfSquaredL2(query + i, row + i, n - i);
+}
+
+F16C_TARGET double avx2HalfL1(const float* query, const unsigned short* row,
+                              const int n)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 sum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(query + i), loadHalves(row + i));
+    sum = _mm256_add_ps(sum, _mm256_andnot_ps(sign, d));
+  }
+  return avxSum(sum) + scalarHalfL1(query + i, row + i, n - i);
+}
+
+AVX2_TARGET double avx2ByteSquaredL2(const float* query,
+                                     const unsigned char* row,
+                                     const float* weights, const int n)
+{
+  __m256 sum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(query + i), loadBytes(row + i));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(weights + i),
+                                           _mm256_mul_ps(d, d)));
+  }
+  return avxSum(sum) +
+         scalarByteSquaredL2(query + i, row + i, weights + i, n - i);
+}
+
+AVX2_TARGET double avx2ByteL1(const float* query, const unsigned char* row,
+                              const float* weights, const int n)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 sum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(query + i), loadBytes(row + i));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(weights + i),
+                                           _mm256_andnot_ps(sign, d)));
+  }
+  return avxSum(sum) + scalarByteL1(query + i, row + i, weights + i, n - i);
+}
+
+// === AVX-512 (16 floats per vector, masked tail)
+
+#define AVX512_TARGET __attribute__((target("avx512f")))
+
+// Mask selecting the first 'remaining' lanes (remaining < 16).
+AVX512_TARGET inline __mmask16 tailMask(const int remaining)
+{
+  return static_cast<__mmask16>((1u << remaining) - 1);
+}
+
+// Halves of a 512-bit vector. The zero-masked forms are used because the
+// unmasked intrinsics trip -Wuninitialized inside GCC's own headers.
+AVX512_TARGET inline __m256 lowHalf(const __m512 v)
+{
+  return _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(v),
+                                                       0));
+}
+
+AVX512_TARGET inline __m256 highHalf(const __m512 v)
+{
+  return _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(v),
+                                                       1));
+}
+
+AVX512_TARGET inline __m512d widen(const __m256 v)
+{
+  return _mm512_maskz_cvtps_pd(0xFF, v);
+}
+
+AVX512_TARGET inline double avx512Sum(const __m512d v)
+{
+  return avxSum(_mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, v, 0),
+                              _mm512_maskz_extractf64x4_pd(0xF, v, 1)));
+}
+
+AVX512_TARGET inline float avx512Sum(const __m512 v)
+{
+  return avxSum(_mm256_add_ps(lowHalf(v), highHalf(v)));
+}
+
+template <bool kBounded>
+AVX512_TARGET double avx512SquaredL2Kernel(const float* a, const float* b,
+                                           const int n, const double bound,
+                                           int* examined)
+{
+  __m512d lo_sum = _mm512_setzero_pd(), hi_sum = _mm512_setzero_pd();
+  int i = 0;
+  for (; i < n; i += 16)
+  {
+    __m512 d;
+    if (i + 16 <= n)
+      d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    else
+      d = _mm512_sub_ps(_mm512_maskz_loadu_ps(tailMask(n - i), a + i),
+                        _mm512_maskz_loadu_ps(tailMask(n - i), b + i));
+    __m512d lo = widen(lowHalf(d)), hi = widen(highHalf(d));
+    lo_sum = _mm512_add_pd(lo_sum, _mm512_mul_pd(lo, lo));
+    hi_sum = _mm512_add_pd(hi_sum, _mm512_mul_pd(hi, hi));
+    if (kBounded && i + 16 < n &&
+        avx512Sum(_mm512_add_pd(lo_sum, hi_sum)) > bound)
+    {
+      *examined = i + 16;
+      return avx512Sum(_mm512_add_pd(lo_sum, hi_sum));
+    }
+  }
+  if (kBounded) *examined = n;
+  return avx512Sum(_mm512_add_pd(lo_sum, hi_sum));
+}
+
+AVX512_TARGET double avx512SquaredL2(const float* a, const float* b,
+                                     const int n)
+{
+  return avx512SquaredL2Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+AVX512_TARGET double avx512L1Kernel(const float* a, const float* b, const int n,
+                                    const double bound, int* examined)
+{
+  __m512d lo_sum = _mm512_setzero_pd(), hi_sum = _mm512_setzero_pd();
+  int i = 0;
+  for (; i < n; i += 16)
+  {
+    __m512 d;
+    if (i + 16 <= n)
+      d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    else
+      d = _mm512_sub_ps(_mm512_maskz_loadu_ps(tailMask(n - i), a + i),
+                        _mm512_maskz_loadu_ps(tailMask(n - i), b + i));
+    d = _mm512_abs_ps(d);
+    lo_sum = _mm512_add_pd(lo_sum, widen(lowHalf(d)));
+    hi_sum = _mm512_add_pd(hi_sum, widen(highHalf(d)));
+    if (kBounded && i + 16 < n &&
+        avx512Sum(_mm512_add_pd(lo_sum, hi_sum)) > bound)
+    {
+      *examined = i + 16;
+      return avx512Sum(_mm512_add_pd(lo_sum, hi_sum));
+    }
+  }
+  if (kBounded) *examined = n;
+  return avx512Sum(_mm512_add_pd(lo_sum, hi_sum));
+}
+
+AVX512_TARGET double avx512L1(const float* a, const float* b, const int n)
+{
+  return avx512L1Kernel<false>(a, b, n, 0.0, NULL);
+}
+
+AVX512_TARGET double avx512Dot(const float* a, const float* b, const int n)
+{
+  __m512d lo_sum = _mm512_setzero_pd(), hi_sum = _mm512_setzero_pd();
+  int i = 0;
+  for (; i < n; i += 16)
+  {
+    __m512 va, vb;
+    if (i + 16 <= n)
+    {
+      va = _mm512_loadu_ps(a + i);
+      vb = _mm512_loadu_ps(b + i);
+    }
+    else
+    {
+      va = _mm512_maskz_loadu_ps(tailMask(n - i), a + i);
+      vb = _mm512_maskz_loadu_ps(tailMask(n - i), b + i);
+    }
+    lo_sum = _mm512_add_pd(lo_sum, _mm512_mul_pd(widen(lowHalf(va)),
+                                                 widen(lowHalf(vb))));
+    hi_sum = _mm512_add_pd(hi_sum, _mm512_mul_pd(widen(highHalf(va)),
+                                                 widen(highHalf(vb))));
+  }
+  return avx512Sum(_mm512_add_pd(lo_sum, hi_sum));
+}
+
+AVX512_TARGET double avx512Hamming(const float* a, const float* b,
+                                  const int n)
+{
+  int count = 0;
+  for (int i = 0; i < n; i += 16)
+  {
+    __mmask16 lanes = i + 16 <= n ? 0xFFFF : tailMask(n - i);
+    __mmask16 differ = _mm512_mask_cmp_ps_mask(
+        lanes, _mm512_maskz_loadu_ps(lanes, a + i),
+        _mm512_maskz_loadu_ps(lanes, b + i), _CMP_NEQ_UQ);
+    count += __builtin_popcount(differ);
+  }
+  return count;
+}
+
+template <bool kBounded>
+AVX512_TARGET double avx512SquaredL2FloatKernel(const float* a, const float* b,
+                                                const int n, const double bound,
+                                                int* examined)
+{
+  __m512 sum = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16)
+  {
+    __m512 d;
+    if (i + 16 <= n)
+      d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    else
+      d = _mm512_sub_ps(_mm512_maskz_loadu_ps(tailMask(n - i), a + i),
+                        _mm512_maskz_loadu_ps(tailMask(n - i), b + i));
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(d, d));
+    if (kBounded && i + 16 < n && avx512Sum(sum) > bound)
+    {
+      *examined = i + 16;
+      return avx512Sum(sum);
+    }
+  }
+  if (kBounded) *examined = n;
+  return avx512Sum(sum);
+}
+
+AVX512_TARGET double avx512SquaredL2Float(const float* a, const float* b,
+                                          const int n)
+{
+  return avx512SquaredL2FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+template <bool kBounded>
+AVX512_TARGET double avx512L1FloatKernel(const float* a, const float* b,
+                                         const int n, const double bound,
+                                         int* examined)
+{
+  __m512 sum = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16)
+  {
+    __m512 d;
+    if (i + 16 <= n)
+      d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    else
+      d = _mm512_sub_ps(_mm512_maskz_loadu_ps(tailMask(n - i), a + i),
+                        _mm512_maskz_loadu_ps(tailMask(n - i), b + i));
+    sum = _mm512_add_ps(sum, _mm512_abs_ps(d));
+    if (kBounded && i + 16 < n && avx512Sum(sum) > bound)
+    {
+      *examined = i + 16;
+      return avx512Sum(sum);
+    }
+  }
+  if (kBounded) *examined = n;
+  return avx512Sum(sum);
+}
+
+AVX512_TARGET double avx512L1Float(const float* a, const float* b, const int n)
+{
+  return avx512L1FloatKernel<false>(a, b, n, 0.0, NULL);
+}
+
+AVX512_TARGET double avx512DotFloat(const float* a, const float* b,
+                                    const int n)
+{
+  __m512 sum = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16)
+  {
+    if (i + 16 <= n)
+      sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(a + i),
+                                             _mm512_loadu_ps(b + i)));
+    else
+      sum = _mm512_add_ps(sum, _mm512_mul_ps(
+          _mm512_maskz_loadu_ps(tailMask(n - i), a + i),
+          _mm512_maskz_loadu_ps(tailMask(n - i), b + i)));
+  }
+  return avx512Sum(sum);
+}
+
+// The zero-masked conversions with an all-ones mask are the plain ones; the
+// unmasked intrinsics pass an undefined vector that GCC 12 warns about.
+AVX512_TARGET inline __m512 loadHalves16(const unsigned short* row)
+{
+  return _mm512_maskz_cvtph_ps(0xFFFF, _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(row)));
+}
+
+AVX512_TARGET inline __m512 loadBytes16(const unsigned char* row)
+{
+  return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(
+      0xFFFF, _mm_loadu_si128(reinterpret_cast<const __m128i*>(row))));
+}
+
+AVX512_TARGET double avx512HalfSquaredL2(const float* query,
+                                         const unsigned short* row,
+                                         const int n)
+{
+  __m512 sum = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m512 d = _mm512_sub_ps(_mm512_loadu_ps(query + i),
+                             loadHalves16(row + i));
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(d, d));
+  }
+  return avx512Sum(sum) + scalarHalfSquaredL2(query + i, row + i, n - i);
+}
+
+AVX512_TARGET double avx512HalfL1(const float* query,
+                                  const unsigned short* row, const int n)
+{
+  __m512 sum = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m512 d = _mm512_sub_ps(_mm512_loadu_ps(query + i),
+                             loadHalves16(row + i));
+    sum = _mm512_add_ps(sum, _mm512_abs_ps(d));
+  }
+  return avx512Sum(sum) + scalarHalfL1(query + i, row + i, n - i);
+}
+
+AVX512_TARGET double avx512ByteSquaredL2(const float* query,
+                                         const unsigned char* row,
+                                         const float* weights, const int n)
+{
+  __m512 sum = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m512 d = _mm512_sub_ps(_mm512_loadu_ps(query + i),
+                             loadBytes16(row + i));
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(weights + i),
+                                           _mm512_mul_ps(d, d)));
+  }
+  return avx512Sum(sum) +
+         scalarByteSquaredL2(query + i, row + i, weights + i, n - i);
+}
+
+AVX512_TARGET double avx512ByteL1(const float* query,
+                                  const unsigned char* row,
+                                  const float* weights, const int n)
+{
+  __m512 sum = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m512 d = _mm512_sub_ps(_mm512_loadu_ps(query + i),
+                             loadBytes16(row + i));
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(weights + i),
+                                           _mm512_abs_ps(d)));
+  }
+  return avx512Sum(sum) + scalarByteL1(query + i, row + i, weights + i, n - i);
+}
+
+AVX512_TARGET double avx512Chebyshev(const float* a, const float* b,
+                                     const int n)
+{
+  __m512 largest = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16)
+  {
+    __mmask16 lanes = i + 16 <= n ? 0xFFFF : tailMask(n - i);
+    __m512 d = _mm512_abs_ps(_mm512_sub_ps(
+        _mm512_maskz_loadu_ps(lanes, a + i),
+        _mm512_maskz_loadu_ps(lanes, b + i)));
+    largest = _mm512_maskz_max_ps(0xFFFF, largest, d);  // See lowHalf().
+  }
+  __m256 octet = _mm256_max_ps(lowHalf(largest), highHalf(largest));
+  __m128 quad = _mm_max_ps(_mm256_castps256_ps128(octet),
+                           _mm256_extractf128_ps(octet, 1));
+  quad = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+  quad = _mm_max_ss(quad, _mm_shuffle_ps(quad, quad, 1));
+  return _mm_cvtss_f32(quad);
+}
+
+AVX512_TARGET double avx512Cosine(const float* a, const float* b, const int n)
+{
+  __m512d dot = _mm512_setzero_pd(), a_norm = _mm512_setzero_pd(),
+          b_norm = _mm512_setzero_pd();
+  for (int i = 0; i < n; i += 16)
+  {
+    __m512 va, vb;
+    if (i + 16 <= n)
+    {
+      va = _mm512_loadu_ps(a + i);
+      vb = _mm512_loadu_ps(b + i);
+    }
+    else
+    {
+      va = _mm512_maskz_loadu_ps(tailMask(n - i), a + i);
+      vb = _mm512_maskz_loadu_ps(tailMask(n - i), b + i);
+    }
+    __m512d a_lo = widen(lowHalf(va)), a_hi = widen(highHalf(va));
+    __m512d b_lo = widen(lowHalf(vb)), b_hi = widen(highHalf(vb));
+    dot = _mm512_add_pd(dot, _mm512_add_pd(_mm512_mul_pd(a_lo, b_lo),
+                                           _mm512_mul_pd(a_hi, b_hi)));
+    a_norm = _mm512_add_pd(a_norm, _mm512_add_pd(_mm512_mul_pd(a_lo, a_lo),
+                                                 _mm512_mul_pd(a_hi, a_hi)));
+    b_norm = _mm512_add_pd(b_norm, _mm512_add_pd(_mm512_mul_pd(b_lo, b_lo),
+                                                 _mm512_mul_pd(b_hi, b_hi)));
+  }
+  return cosineDistance(avx512Sum(dot), avx512Sum(a_norm), avx512Sum(b_norm));
+}
+
+AVX512_TARGET double avx512CosineFloat(const float* a, const float* b,
+                                       const int n)
+{
+  __m512 dot = _mm512_setzero_ps(), a_norm = _mm512_setzero_ps(),
+         b_norm = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16)
+  {
+    __mmask16 lanes = i + 16 <= n ? 0xFFFF : tailMask(n - i);
+    __m512 va = _mm512_maskz_loadu_ps(lanes, a + i);
+    __m512 vb = _mm512_maskz_loadu_ps(lanes, b + i);
+    dot = _mm512_add_ps(dot, _mm512_mul_ps(va, vb));
+    a_norm = _mm512_add_ps(a_norm, _mm512_mul_ps(va, va));
+    b_norm = _mm512_add_ps(b_norm, _mm512_mul_ps(vb, vb));
+  }
+  return cosineDistance(avx512Sum(dot), avx512Sum(a_norm), avx512Sum(b_norm));
+}
+
+AVX512_TARGET void avx512DotTile(const float* const* queries,
+                                 const float* panel, const int n,
+                                 float* dots)
+{
+  dotTile(queries, panel, n, dots);
+}
+
+// === Dispatch
+
+enum InstructionSet { kScalar, kSse42, kAvx2, kAvx512, kNumInstructionSets };
+
+// Indexed by [instruction set][float accumulation]. The reduced-precision
+// kernels have no SSE4.2 version; those machines use the scalar ones.
+const DistanceKernels kKernels[kNumInstructionSets][2] =
+{
+  {
+    { "scalar", false, scalarSquaredL2, scalarL1, scalarDot, scalarHamming,
+      scalarChebyshev, scalarCosine, scalarBitHamming, scalarDotTile,
+      scalarHalfSquaredL2, scalarHalfL1, scalarByteSquaredL2, scalarByteL1,
+      scalarSquaredL2Kernel<true>, scalarL1Kernel<true> },
+    { "scalar", true, scalarSquaredL2Float, scalarL1Float, scalarDotFloat,
+      scalarHamming, scalarChebyshev, scalarCosineFloat, scalarBitHamming,
+      scalarDotTile,
+      scalarHalfSquaredL2, scalarHalfL1, scalarByteSquaredL2, scalarByteL1,
+      scalarSquaredL2FloatKernel<true>, scalarL1FloatKernel<true> }
+  },
+  {
+    { "sse4.2", false, sseSquaredL2, sseL1, sseDot, sseHamming,
+      sseChebyshev, sseCosine, popcntBitHamming, sseDotTile,
+      scalarHalfSquaredL2, scalarHalfL1, scalarByteSquaredL2, scalarByteL1,
+      sseSquaredL2Kernel<true>, sseL1Kernel<true> },
+    { "sse4.2", true, sseSquaredL2Float, sseL1Float, sseDotFloat, sseHamming,
+      sseChebyshev, sseCosineFloat, popcntBitHamming, sseDotTile,
+      scalarHalfSquaredL2, scalarHalfL1, scalarByteSquaredL2, scalarByteL1,
+      sseSquaredL2FloatKernel<true>, sseL1FloatKernel<true> }
+  },
+  {
+    { "avx2", false, avx2SquaredL2, avx2L1, avx2Dot, avx2Hamming,
+      avx2Chebyshev, avx2Cosine, popcntBitHamming, avx2DotTile,
+      avx2HalfSquaredL2, avx2HalfL1, avx2ByteSquaredL2, avx2ByteL1,
+      avx2SquaredL2Kernel<true>, avx2L1Kernel<true> },
+    { "avx2", true, avx2SquaredL2Float, avx2L1Float, avx2DotFloat,
+      avx2Hamming, avx2Chebyshev, avx2CosineFloat, popcntBitHamming,
+      avx2DotTile,
+      avx2HalfSquaredL2, avx2HalfL1, avx2ByteSquaredL2, avx2ByteL1,
+      avx2SquaredL2FloatKernel<true>, avx2L1FloatKernel<true> }
+  },
+  {
+    { "avx512", false, avx512SquaredL2, avx512L1, avx512Dot, avx512Hamming,
+      avx512Chebyshev, avx512Cosine, popcntBitHamming, avx512DotTile,
+      avx512HalfSquaredL2, avx512HalfL1, avx512ByteSquaredL2, avx512ByteL1,
+      avx512SquaredL2Kernel<true>, avx512L1Kernel<true> },
+    { "avx512", true, avx512SquaredL2Float, avx512L1Float, avx512DotFloat,
+      avx512Hamming, avx512Chebyshev, avx512CosineFloat, popcntBitHamming,
+      avx512DotTile, avx512HalfSquaredL2, avx512HalfL1, avx512ByteSquaredL2,
+      avx512ByteL1, avx512SquaredL2FloatKernel<true>,
+      avx512L1FloatKernel<true> }
+  }
+};
+
+const DistanceKernels* selected_kernels = NULL;
+
+InstructionSet detectInstructionSet()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return kAvx512;
+  // Virtual machines may hide F16C while showing AVX2; those get SSE4.2.
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+    return kAvx2;
+  if (__builtin_cpu_supports("sse4.2")) return kSse42;
+  return kScalar;
+}
+
+}  // namespace
+
+const DistanceKernels& selectDistanceKernels(const bool float_accumulation)
+{
+  selected_kernels = &kKernels[detectInstructionSet()][float_accumulation];
+  return *selected_kernels;
+}
+
+const DistanceKernels& distanceKernels()
+{
+  if (selected_kernels == NULL)
+    return selectDistanceKernels(false);
+  return *selected_kernels;
+}
+
+unsigned short floatToHalf(const float value)
+{
+  unsigned int bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const unsigned int sign = (bits >> 16) & 0x8000;
+  const int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127 + 15;
+  unsigned int mantissa = bits & 0x7FFFFF;
+  if (((bits >> 23) & 0xFF) == 0xFF)  // Infinity or NaN.
+    return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);
+  if (exponent >= 31) return sign | 0x7C00;  // Too large: infinity.
+  if (exponent <= 0)  // Subnormal half (or zero).
+  {
+    if (exponent < -10) return sign;
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    unsigned int half = mantissa >> shift;
+    const unsigned int rest = mantissa & ((1U << shift) - 1);
+    const unsigned int middle = 1U << (shift - 1);
+    if (rest > middle || (rest == middle && (half & 1))) ++half;
+    return sign | half;
+  }
+  unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+  const unsigned int rest = mantissa & 0x1FFF;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    ++half;  // A carry into the exponent is still correctly rounded.
+  return half;
+}
+
+float halfToFloat(const unsigned short half)
+{
+  const unsigned int sign = (half & 0x8000) << 16;
+  int exponent = (half >> 10) & 0x1F;
+  unsigned int mantissa = half & 0x3FF;
+  unsigned int bits;
+  if (exponent == 0)
+  {
+    if (mantissa == 0)
+    {
+      bits = sign;
+    }
+    else  // Subnormal: normalize it.
+    {
+      exponent = 127 - 15 + 1;
+      while ((mantissa & 0x400) == 0)
+      {
+        mantissa <<= 1;
+        --exponent;
+      }
+      bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+  }
+  else if (exponent == 31)
+  {
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  }
+  else
+  {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+bool parseMetric(const char* name, Metric* metric)
+{
+  if (strcmp(name, "euclidean") == 0) *metric = kEuclidean;
+  else if (strcmp(name, "manhattan") == 0) *metric = kManhattan;
+  else if (strcmp(name, "hamming") == 0) *metric = kHamming;
+  else if (strcmp(name, "chebyshev") == 0) *metric = kChebyshev;
+  else if (strcmp(name, "cosine") == 0) *metric = kCosine;
+  else return false;
+  return true;
+}
+
+const char* metricName(const Metric metric)
+{
+  switch (metric)
+  {
+    case kManhattan:
+      return "manhattan";
+    case kHamming:
+      return "hamming";
+    case kChebyshev:
+      return "chebyshev";
+    case kCosine:
+      return "cosine";
+    default:
+      return "euclidean";
+  }
+}
+
+DistanceFunction metricKernel(const DistanceKernels& kernels,
+                              const Metric metric)
+{
+  switch (metric)
+  {
+    case kManhattan:
+      return kernels.l1;
+    case kHamming:
+      return kernels.hamming;
+    case kChebyshev:
+      return kernels.chebyshev;
+    case kCosine:
+      return kernels.cosine;
+    default:
+      return kernels.squared_l2;
+  }
+}
+
+BoundedDistanceFunction boundedMetricKernel(const DistanceKernels& kernels,
+                                            const Metric metric)
+{
+  switch (metric)
+  {
+    case kEuclidean:
+      return kernels.bounded_squared_l2;
+    case kManhattan:
+      return kernels.bounded_l1;
+    default:
+      return NULL;
+  }
+}
+
+double metricDistance(const Metric metric, const double ranking_distance)
+{
+  return metric == kEuclidean ? std::sqrt(ranking_distance) : ranking_distance;
+}
@@ -0,0 +1,118 @@
+/*
+ * File:   DistanceKernels.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ *
+ * Vectorized distance functions over rows of floats. There is one family of
+ * kernels per instruction set (scalar, SSE4.2, AVX2, AVX-512); the best one
+ * the CPU supports is chosen once at startup through CPUID, so the whole
+ * program can be built without -march flags and still run anywhere.
+ */
+
+#ifndef DISTANCEKERNELS_H
+#define	DISTANCEKERNELS_H
+
+// Signature shared by all kernels. n is the number of features to compare;
+// it does not need to be a multiple of the vector width.
+typedef double (*DistanceFunction)(const float* a, const float* b,
+                                   const int n);
+
+// A kernel that may stop early: once a partial sum exceeds bound it returns
+// that partial sum (more than bound, at most the full distance), so a row
+// that cannot beat the bound costs only part of the features. Otherwise it
+// returns exactly what the plain kernel does. examined receives the number
+// of features summed.
+typedef double (*BoundedDistanceFunction)(const float* a, const float* b,
+                                          const int n, const double bound,
+                                          int* examined);
+
+// Number of differing bits between two bit-packed rows of 64-bit words.
+typedef int (*BitDistanceFunction)(const unsigned long long* a,
+                                   const unsigned long long* b,
+                                   const int words);
+
+// Dot products of a tile of kTileQueries query rows with a panel of
+// kTileRows training rows, for distances through matrix multiplication
+// (see BatchedScan.h). The panel is stored transposed, feature by feature:
+// panel[j * kTileRows + r] is feature j of row r. The result is
+// dots[q * kTileRows + r]; sums are kept in single precision.
+const int kTileQueries = 8;
+const int kTileRows = 16;
+typedef void (*DotTileFunction)(const float* const* queries,
+                                const float* panel, const int n, float* dots);
+
+// Distances from a float query to a row stored in reduced precision (see
+// CompressedMatrix.h), summed in single precision:
+//  - fp16 rows hold IEEE half-precision floats;
+//  - int8 rows hold codes c_i, compared with a query already mapped into
+//    code units, each term multiplied by a per-feature weight w_i.
+typedef double (*HalfDistanceFunction)(const float* query,
+                                       const unsigned short* row,
+                                       const int n);
+typedef double (*ByteDistanceFunction)(const float* query,
+                                       const unsigned char* row,
+                                       const float* weights, const int n);
+
+struct DistanceKernels
+{
+  const char* name;  // Instruction set of the kernels, e.g. "avx2".
+  bool float_accumulation;  // Sums in single instead of double precision.
+  DistanceFunction squared_l2;  // sum (a_i - b_i)^2
+  DistanceFunction l1;  // sum |a_i - b_i|
+  DistanceFunction dot;  // sum a_i * b_i
+  DistanceFunction hamming;  // Number of i where a_i != b_i
+  DistanceFunction chebyshev;  // max |a_i - b_i|
+  DistanceFunction cosine;  // 1 - a.b / (|a| |b|)
+  BitDistanceFunction bit_hamming;  // popcount(a XOR b)
+  DotTileFunction dot_tile;
+  HalfDistanceFunction half_squared_l2;  // sum (a_i - b_i)^2
+  HalfDistanceFunction half_l1;  // sum |a_i - b_i|
+  ByteDistanceFunction byte_squared_l2;  // sum w_i (a_i - c_i)^2
+  ByteDistanceFunction byte_l1;  // sum w_i |a_i - c_i|
+  BoundedDistanceFunction bounded_squared_l2;  // squared_l2 with a bound
+  BoundedDistanceFunction bounded_l1;  // l1 with a bound
+};
+
+// The distances a kNN engine can rank neighbours by.
+enum Metric
+{
+  kEuclidean,  // Ranked by the squared distance.
+  kManhattan,
+  kHamming,  // For binary (0/1) attributes.
+  kChebyshev,  // Largest difference of any attribute.
+  kCosine  // 1 - cosine similarity; ignores the length of the rows.
+};
+
+// Picks the fastest kernels supported by the CPU. Call once at startup.
+// Single-precision accumulation is faster but may reorder near-equal
+// distances; double precision is the default.
+const DistanceKernels& selectDistanceKernels(const bool float_accumulation);
+
+// The kernels picked by selectDistanceKernels() (double-precision
+// accumulation if it was never called).
+const DistanceKernels& distanceKernels();
+
+// Conversions between float and IEEE half precision (round to nearest even).
+unsigned short floatToHalf(const float value);
+float halfToFloat(const unsigned short half);
+
+// Reads a metric name ("euclidean", "manhattan", "hamming", "chebyshev" or
+// "cosine"). Returns false if the name is unknown.
+bool parseMetric(const char* name, Metric* metric);
+const char* metricName(const Metric metric);
+
+// The kernel that ranks neighbours under the metric. For kEuclidean this is
+// the squared distance; take its square root for the metric distance.
+DistanceFunction metricKernel(const DistanceKernels& kernels,
+                              const Metric metric);
+
+// The bounded form of metricKernel(); NULL for metrics that have none
+// (those that are not sums over the features).
+BoundedDistanceFunction boundedMetricKernel(const DistanceKernels& kernels,
+                                            const Metric metric);
+
+// The distance under the metric from what its kernel ranks by.
+double metricDistance(const Metric metric, const double ranking_distance);
+
+#endif	/* DISTANCEKERNELS_H */
@@ -0,0 +1,174 @@
+/*
+ * File:   EngineCalibration.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "EngineCalibration.h"
+#include "NearestNeighbour.h"
+#include "NeighbourList.h"
+#include "DistanceKernels.h"
+#include "Stopwatch.h"
+#include <algorithm>  // count, min
+#include <cstdlib>  // abort
+#include <iostream>
+using namespace std;
+
+// Another engine replaces plain brute only if it is this much faster.
+const double EngineCalibration::kMinSpeedup = 1.2;
+
+EngineCalibration::EngineCalibration(const int k, const int num_attributes,
+                                     const int num_classes,
+                                     const KnnParameters& parameters)
+    : k_(k), num_attributes_(num_attributes), num_classes_(num_classes),
+      parameters_(parameters), num_queries_(0), chosen_(0)
+{
+  if (parameters.storage != "float" || parameters.batch_size > 0 ||
+      parameters.anytime_budget > 0 || parameters.anytime_deadline > 0)
+  {
+    cerr << "(!) -n auto chooses among the exact engines on float rows; it "
+         << "cannot be combined with --storage, --batch, --budget or "
+         << "--deadline\n";
+    abort();
+  }
+}
+
+/**
+ * Times every exact engine that supports the metric. The sample queries are
+ * training rows spread evenly over the training set.
+ *
+ * @param training_set The labeled examples the model is built on.
+ * @return The parameters, with the engine (and brute variant) that answered
+ *         the sample fastest, if clearly faster than plain brute.
+ */
+KnnParameters EngineCalibration::select(const FeatureMatrix& training_set)
+{
+  const int size = training_set.get_num_rows();
+  num_queries_ = min(kSampleQueries, size);
+  FeatureMatrix queries(num_attributes_);
+  queries.reserve(num_queries_);
+  for (int q = 0; q < num_queries_; ++q)
+    queries.appendRow(training_set,
+                      static_cast<long>(size) * q / num_queries_);
+
+  // Timed one process, one thread; the engine is sharded (or threaded)
+  // afterwards if asked.
+  KnnParameters candidate = parameters_;
+  candidate.num_shards = 1;
+  candidate.num_threads = 1;
+  candidate.recall_report = false;
+  candidate.early_abandon = false;
+  candidate.variance_order = false;
+  measurements_.clear();
+
+  candidate.engine = "brute";
+  measure(candidate, training_set, queries);
+  // Early abandoning only changes the scan of the attributes that are not
+  // bit-packed; ordering them needs at least two.
+  const int continuous = continuousAttributes();
+  if (boundedMetricKernel(distanceKernels(), parameters_.metric) != NULL &&
+      continuous > 0)
+  {
+    candidate.early_abandon = true;
+    measure(candidate, training_set, queries);
+    // Shards keep the attribute order.
+    if (parameters_.num_shards <= 1 && continuous > 1)
+    {
+      candidate.variance_order = true;
+      measure(candidate, training_set, queries);
+      candidate.variance_order = false;
+    }
+    candidate.early_abandon = false;
+  }
+  if (parameters_.metric != kCosine)
+  {
+    const char* trees[] = { "kdtree", "vptree", "laesa" };
+    for (int t = 0; t < 3; ++t)
+    {
+      candidate.engine = trees[t];
+      measure(candidate, training_set, queries);
+    }
+  }
+
+  // The fastest other engine must beat plain brute (measurement 0) by
+  // kMinSpeedup, or timing noise on the small sample would decide.
+  int fastest = 0;
+  for (size_t m = 1; m < measurements_.size(); ++m)
+  {
+    if (measurements_[m].query_seconds < measurements_[fastest].query_seconds)
+      fastest = m;
+  }
+  chosen_ = measurements_[fastest].query_seconds * kMinSpeedup <=
+            measurements_[0].query_seconds ? fastest : 0;
+  KnnParameters chosen = parameters_;
+  chosen.engine = measurements_[chosen_].parameters.engine;
+  chosen.early_abandon = measurements_[chosen_].parameters.early_abandon;
+  chosen.variance_order = measurements_[chosen_].parameters.variance_order;
+  return chosen;
+}
+
+/**
+ * The attributes the brute engine scans as floats: all of them, unless it
+ * bit-packs the binary ones (see NearestNeighbour::prepare()).
+ */
+int EngineCalibration::continuousAttributes() const
+{
+  const int binary = count(parameters_.binary_columns.begin(),
+                           parameters_.binary_columns.end(), true);
+  if (parameters_.bit_pack && parameters_.metric != kChebyshev &&
+      parameters_.metric != kCosine && binary > 0)
+    return num_attributes_ - binary;
+  return num_attributes_;
+}
+
+void EngineCalibration::measure(const KnnParameters& parameters,
+                                const FeatureMatrix& training_set,
+                                const FeatureMatrix& queries)
+{
+  Measurement measurement;
+  measurement.parameters = parameters;
+  NearestNeighbour knn(k_, num_attributes_, num_classes_, parameters);
+  knn.set_report(false);
+  Stopwatch stopwatch;
+  knn.buildIndex(training_set);
+  measurement.build_seconds = stopwatch.seconds();
+
+  vector<NeighbourList> lists(num_queries_, NeighbourList(k_));
+  measurement.query_seconds = 0.0;
+  for (int round = 0; round < kRounds; ++round)
+  {
+    SearchStats stats;
+    stopwatch.restart();
+    knn.findNeighbours(queries, 0, num_queries_, lists, stats);
+    const double seconds = stopwatch.seconds() / max(num_queries_, 1);
+    if (round == 0 || seconds < measurement.query_seconds)
+      measurement.query_seconds = seconds;
+  }
+  measurements_.push_back(measurement);
+}
+
+void EngineCalibration::print() const
+{
+  cout << "Calibrated the kNN engine on " << num_queries_
+       << " training examples as queries (k = " << k_
+       << ")\nengine\tbuild s\tms/query\n";
+  for (size_t m = 0; m < measurements_.size(); ++m)
+  {
+    cout << engineName(measurements_[m].parameters) << "\t"
+         << measurements_[m].build_seconds << "\t"
+         << 1000 * measurements_[m].query_seconds << "\n";
+  }
+  cout << "Chose " << engineName(measurements_[chosen_].parameters)
+       << " (others must be " << kMinSpeedup
+       << " times as fast as brute; override with -n)\n";
+}
+
+string EngineCalibration::engineName(const KnnParameters& parameters)
+{
+  if (parameters.variance_order)
+    return parameters.engine + " --variance-order";
+  if (parameters.early_abandon)
+    return parameters.engine + " --early-abandon";
+  return parameters.engine;
+}
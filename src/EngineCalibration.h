@@ -0,0 +1,74 @@
+/*
+ * File:   EngineCalibration.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef ENGINECALIBRATION_H
+#define	ENGINECALIBRATION_H
+
+#include <string>
+#include <vector>
+#include "FeatureMatrix.h"
+#include "knn_parameters.h"
+
+/**
+ * Picks the kNN engine for a training set by timing them (-n auto). Which
+ * engine is fastest depends on the number of rows, the number of
+ * attributes and k: the trees prune well on a few attributes, the scan
+ * wins on many. Every exact engine that supports the metric is built on
+ * the training set and asked for the neighbours of a sample of its rows;
+ * the one with the least time per query is chosen, if it is at least
+ * kMinSpeedup times as fast as plain brute (otherwise brute). The variants
+ * of the brute engine (early abandoning, by variance order) are timed
+ * separately when they scan differently, i.e. when some attributes are left
+ * as floats after bit-packing.
+ *
+ * Only exact engines take part, so the choice changes the speed and never
+ * the classifications.
+ */
+class EngineCalibration
+{
+ public:
+  struct Measurement
+  {
+    KnnParameters parameters;  // The engine as timed.
+    double build_seconds;
+    double query_seconds;  // Per query, the best of kRounds.
+  };
+
+  EngineCalibration(const int k, const int num_attributes,
+                    const int num_classes, const KnnParameters& parameters);
+  // Times the engines; returns the parameters with the fastest one.
+  KnnParameters select(const FeatureMatrix& training_set);
+  // Prints the measurements of select() and the choice.
+  void print() const;
+  const std::vector<Measurement>& get_measurements() const
+  {
+    return measurements_;
+  }
+
+  // Name of a timed engine, with the brute variant, e.g.
+  // "brute --early-abandon".
+  static std::string engineName(const KnnParameters& parameters);
+
+ private:
+  static const int kSampleQueries = 32;  // Training rows used as queries.
+  static const int kRounds = 3;  // Times each engine answers the sample.
+  static const double kMinSpeedup;
+  int continuousAttributes() const;
+  void measure(const KnnParameters& parameters,
+               const FeatureMatrix& training_set,
+               const FeatureMatrix& queries);
+
+  int k_;
+  int num_attributes_;
+  int num_classes_;
+  KnnParameters parameters_;
+  int num_queries_;
+  std::vector<Measurement> measurements_;
+  int chosen_;  // Index into measurements_.
+};
+
+#endif	/* ENGINECALIBRATION_H */
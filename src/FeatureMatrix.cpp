@@ -0,0 +1,167 @@
+/*
+ * File:   FeatureMatrix.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "FeatureMatrix.h"
+#include <cstdlib>  // posix_memalign, free
+#include <cstring>  // memcpy, memset
+#include <new>  // bad_alloc
+#include <algorithm>  // std::swap
+
+namespace {
+
+const size_t kByteAlignment = FeatureMatrix::kRowAlignment * sizeof(float);
+
+// Rounds the number of features up to a whole number of aligned blocks.
+int paddedWidth(const int num_features)
+{
+  const int block = FeatureMatrix::kRowAlignment;
+  return ((num_features + block - 1) / block) * block;
+}
+
+}  // namespace
+
+FeatureMatrix::FeatureMatrix()
+    : data_(NULL), labels_(NULL), num_rows_(0), num_features_(0), stride_(0),
+      capacity_(0), owned_(true) {}
+
+FeatureMatrix::FeatureMatrix(const int num_features)
+    : data_(NULL), labels_(NULL), num_rows_(0), num_features_(num_features),
+      stride_(paddedWidth(num_features)), capacity_(0), owned_(true) {}
+
+FeatureMatrix::FeatureMatrix(const float* data, const int* labels,
+                             const int num_rows, const int num_features)
+    : data_(const_cast<float*>(data)), labels_(const_cast<int*>(labels)),
+      num_rows_(num_rows), num_features_(num_features),
+      stride_(paddedWidth(num_features)), capacity_(num_rows), owned_(false)
+{}
+
+FeatureMatrix::FeatureMatrix(const FeatureMatrix& orig)
+    : data_(NULL), labels_(NULL), num_rows_(0),
+      num_features_(orig.num_features_), stride_(orig.stride_), capacity_(0),
+      owned_(true)
+{
+  reserve(orig.num_rows_);
+  if (orig.num_rows_ > 0)
+  {
+    memcpy(data_, orig.data_, sizeof(float) * orig.num_rows_ * stride_);
+    memcpy(labels_, orig.labels_, sizeof(int) * orig.num_rows_);
+  }
+  num_rows_ = orig.num_rows_;
+}
+
+FeatureMatrix& FeatureMatrix::operator=(const FeatureMatrix& orig)
+{
+  if (this != &orig)
+  {
+    FeatureMatrix copy(orig);
+    swap(copy);
+  }
+  return *this;
+}
+
+FeatureMatrix::~FeatureMatrix()
+{
+  if (!owned_) return;
+  free(data_);
+  free(labels_);
+}
+
+/**
+ * Makes room for at least the given number of rows without reallocating.
+ *
+ * @param num_rows  The total number of rows expected
+ */
+void FeatureMatrix::reserve(const int num_rows)
+{
+  if (num_rows > capacity_)
+    grow(num_rows);
+}
+
+/**
+ * Copies an example onto the end of the table. Padding is zero filled.
+ *
+ * @param features  The num_features attribute values of the example
+ * @param label     The classification of the example
+ */
+void FeatureMatrix::appendRow(const float* features, const int label)
+{
+  if (num_rows_ == capacity_)
+    grow(capacity_ < 64 ? 64 : capacity_ * 2);
+  float* destination = row(num_rows_);
+  memcpy(destination, features, sizeof(float) * num_features_);
+  memset(destination + num_features_, 0,
+         sizeof(float) * (stride_ - num_features_));
+  labels_[num_rows_] = label;
+  ++num_rows_;
+}
+
+/**
+ * Copies a row (and its label) from another table with the same width.
+ */
+void FeatureMatrix::appendRow(const FeatureMatrix& other, const int i)
+{
+  appendRow(other.row(i), other.label(i));
+}
+
+/**
+ * Removes all rows but keeps the allocated memory (a view lets go of the
+ * memory it was given).
+ */
+void FeatureMatrix::clear()
+{
+  num_rows_ = 0;
+  if (!owned_)
+  {
+    data_ = NULL;
+    labels_ = NULL;
+    capacity_ = 0;
+    owned_ = true;
+  }
+}
+
+void FeatureMatrix::swap(FeatureMatrix& other)
+{
+  std::swap(data_, other.data_);
+  std::swap(labels_, other.labels_);
+  std::swap(num_rows_, other.num_rows_);
+  std::swap(num_features_, other.num_features_);
+  std::swap(stride_, other.stride_);
+  std::swap(capacity_, other.capacity_);
+  std::swap(owned_, other.owned_);
+}
+
+/**
+ * Reallocates the row and label storage to hold the given number of rows.
+ */
+void FeatureMatrix::grow(const int capacity)
+{
+  void* data = NULL;
+  size_t bytes = sizeof(float) * static_cast<size_t>(capacity) * stride_;
+  if (posix_memalign(&data, kByteAlignment, bytes > 0 ? bytes : 1) != 0)
+    throw std::bad_alloc();
+  int* labels = static_cast<int*>(malloc(sizeof(int) * capacity));
+  if (labels == NULL)
+  {
+    free(data);
+    throw std::bad_alloc();
+  }
+
+  if (num_rows_ > 0)
+  {
+    memcpy(data, data_, sizeof(float) * num_rows_ * stride_);
+    memcpy(labels, labels_, sizeof(int) * num_rows_);
+  }
+  if (owned_)
+  {
+    free(data_);
+    free(labels_);
+  }
+  data_ = static_cast<float*>(data);
+  labels_ = labels;
+  capacity_ = capacity;
+  owned_ = true;
+}
@@ -0,0 +1,60 @@
+/*
+ * File:   FeatureMatrix.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef FEATUREMATRIX_H
+#define	FEATUREMATRIX_H
+
+// A dataset of examples stored as one contiguous, aligned, row-major block of
+// floats plus a separate array of class labels (one per row).
+// Each row is padded with zeros up to a multiple of kRowAlignment floats, so
+// every row starts on a cache line and can be streamed through linearly.
+// Pass it by const reference; copying duplicates the whole table.
+class FeatureMatrix
+{
+ public:
+  static const int kRowAlignment = 16;  // In floats (64 bytes).
+
+  FeatureMatrix();
+  explicit FeatureMatrix(const int num_features);
+  // A view of rows laid out as this class lays them out (get_stride() floats
+  // per row, 64-byte aligned) in memory it does not own, e.g. a read-only
+  // mapped file; see KnnIndexFile.h. The memory must outlive the view.
+  // Appending copies the rows into memory of its own first.
+  FeatureMatrix(const float* data, const int* labels, const int num_rows,
+                const int num_features);
+  FeatureMatrix(const FeatureMatrix& orig);
+  FeatureMatrix& operator=(const FeatureMatrix& orig);
+  ~FeatureMatrix();
+  void reserve(const int num_rows);
+  void appendRow(const float* features, const int label);
+  void appendRow(const FeatureMatrix& other, const int row);
+  void clear();
+  void swap(FeatureMatrix& other);
+
+  float* row(const int i) { return data_ + static_cast<long>(i) * stride_; }
+  const float* row(const int i) const
+  {
+    return data_ + static_cast<long>(i) * stride_;
+  }
+  int label(const int i) const { return labels_[i]; }
+  const int* labels() const { return labels_; }
+  int get_num_rows() const { return num_rows_; }
+  int get_num_features() const { return num_features_; }
+  int get_stride() const { return stride_; }  // Floats between row starts.
+
+ private:
+  void grow(const int capacity);
+  float* data_;  // num_rows_ * stride_ floats, 64-byte aligned.
+  int* labels_;  // One classification per row.
+  int num_rows_;
+  int num_features_;
+  int stride_;
+  int capacity_;  // Rows allocated.
+  bool owned_;  // False for a view; data_ and labels_ are not freed.
+};
+
+#endif	/* FEATUREMATRIX_H */
@@ -0,0 +1,504 @@
+/*
+ * File:   HnswIndex.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "HnswIndex.h"
+#include "FeatureMatrix.h"
+#include "NeighbourList.h"
+#include "IndexBlob.h"
+#include <algorithm>  // push_heap, pop_heap, sort
+#include <cmath>  // log
+#include <functional>  // greater
+
+namespace {
+
+// Levels are drawn with a private generator so that building the graph does
+// not disturb rand() (which drives the data split and the ANN).
+class LevelGenerator
+{
+ public:
+  explicit LevelGenerator(const unsigned long long seed) : state_(seed) {}
+  double uniform()  // In (0, 1].
+  {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((state_ >> 11) + 1.0) / 9007199254740992.0;
+  }
+ private:
+  unsigned long long state_;
+};
+
+const unsigned long long kLevelSeed = 100;
+
+}  // namespace
+
+HnswIndex::HnswIndex(const int m, const int ef_construction,
+                     const int ef_search, const Metric metric,
+                     const int num_threads)
+    : m_(m < 2 ? 2 : m), ef_construction_(ef_construction),
+      ef_search_(ef_search), num_threads_(num_threads < 1 ? 1 : num_threads),
+      distance_(metricKernel(distanceKernels(), metric)), points_(NULL),
+      entry_point_(-1), max_level_(-1), next_node_(0)
+{
+  pthread_mutex_init(&entry_lock_, NULL);
+  pthread_mutex_init(&next_lock_, NULL);
+  pthread_mutex_init(&pool_lock_, NULL);
+}
+
+HnswIndex::~HnswIndex()
+{
+  for (size_t i = 0; i < visited_pool_.size(); ++i)
+    delete visited_pool_[i];
+  pthread_mutex_destroy(&entry_lock_);
+  pthread_mutex_destroy(&next_lock_);
+  pthread_mutex_destroy(&pool_lock_);
+}
+
+/**
+ * Inserts every training row into the graph, using num_threads threads.
+ *
+ * @param training_set The labeled examples to index.
+ */
+void HnswIndex::build(const FeatureMatrix& training_set)
+{
+  points_ = &training_set;
+  const int size = training_set.get_num_rows();
+
+  // Draw every node's level up front so the graph shape does not depend on
+  // the order in which threads insert the nodes.
+  LevelGenerator generator(kLevelSeed);
+  const double level_scale = 1.0 / std::log(static_cast<double>(m_));
+  levels_.resize(size);
+  upper_offset_.resize(size);
+  int upper_slots = 0;
+  for (int i = 0; i < size; ++i)
+  {
+    levels_[i] = static_cast<int>(-std::log(generator.uniform()) * level_scale);
+    upper_offset_[i] = upper_slots;
+    upper_slots += levels_[i];
+  }
+  links0_.assign(static_cast<size_t>(size) * max_links(0), -1);
+  count0_.assign(size, 0);
+  upper_links_.assign(static_cast<size_t>(upper_slots) * m_, -1);
+  upper_count_.assign(upper_slots, 0);
+
+  node_locks_.resize(size);
+  for (int i = 0; i < size; ++i)
+    pthread_mutex_init(&node_locks_[i], NULL);
+
+  entry_point_ = -1;
+  max_level_ = -1;
+  if (size > 0)
+  {
+    entry_point_ = 0;
+    max_level_ = levels_[0];
+  }
+  next_node_ = 1;
+
+  std::vector<pthread_t> threads(num_threads_ - 1);
+  for (size_t i = 0; i < threads.size(); ++i)
+    pthread_create(&threads[i], NULL, buildThread, this);
+  buildThread(this);
+  for (size_t i = 0; i < threads.size(); ++i)
+    pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < size; ++i)
+    pthread_mutex_destroy(&node_locks_[i]);
+  node_locks_.clear();
+}
+
+/**
+ * Writes the graph. efSearch is not saved; it is a setting of the run.
+ */
+bool HnswIndex::save(IndexBlobWriter& out) const
+{
+  out.value(m_);
+  out.value(entry_point_);
+  out.value(max_level_);
+  out.array(levels_);
+  out.array(links0_);
+  out.array(count0_);
+  out.array(upper_offset_);
+  out.array(upper_links_);
+  out.array(upper_count_);
+  return true;
+}
+
+bool HnswIndex::restore(IndexBlobReader& in, const FeatureMatrix& training_set)
+{
+  points_ = &training_set;
+  m_ = in.value<int>();
+  entry_point_ = in.value<int>();
+  max_level_ = in.value<int>();
+  in.array(levels_);
+  in.array(links0_);
+  in.array(count0_);
+  in.array(upper_offset_);
+  in.array(upper_links_);
+  in.array(upper_count_);
+  const size_t size = training_set.get_num_rows();
+  if (!in.ok() || m_ < 2 || levels_.size() != size ||
+      links0_.size() != size * max_links(0) || count0_.size() != size ||
+      upper_offset_.size() != size ||
+      upper_links_.size() != upper_count_.size() * m_)
+    return false;
+  if (size == 0 ? entry_point_ != -1 :
+      entry_point_ < 0 || entry_point_ >= static_cast<int>(size))
+    return false;
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (levels_[i] < 0 || count0_[i] < 0 || count0_[i] > max_links(0) ||
+        upper_offset_[i] < 0 ||
+        levels_[i] > static_cast<int>(upper_count_.size()) - upper_offset_[i])
+      return false;
+  }
+  for (size_t i = 0; i < upper_count_.size(); ++i)
+  {
+    if (upper_count_[i] < 0 || upper_count_[i] > m_) return false;
+  }
+  if (size > 0 && max_level_ != levels_[entry_point_]) return false;
+  // The search follows a link on level l only to nodes that reach level l.
+  for (size_t i = 0; i < size; ++i)
+  {
+    for (int l = 0; l <= levels_[i]; ++l)
+    {
+      const int* node_links = links(i, l);
+      for (int j = 0; j < num_links(i, l); ++j)
+      {
+        if (node_links[j] < 0 || node_links[j] >= static_cast<int>(size) ||
+            levels_[node_links[j]] < l)
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Worker loop of build(): takes the next uninserted node until none are left.
+ */
+void* HnswIndex::buildThread(void* index)
+{
+  HnswIndex* hnsw = static_cast<HnswIndex*>(index);
+  const int size = hnsw->points_->get_num_rows();
+  for (;;)
+  {
+    pthread_mutex_lock(&hnsw->next_lock_);
+    int node = hnsw->next_node_++;
+    pthread_mutex_unlock(&hnsw->next_lock_);
+    if (node >= size) break;
+    hnsw->insert(node);
+  }
+  return NULL;
+}
+
+/**
+ * Links a new node into every level up to its own.
+ */
+void HnswIndex::insert(const int node)
+{
+  const int level = levels_[node];
+  SearchStats unused;
+
+  // A node that raises the top level becomes the new entry point; hold the
+  // entry lock while it is linked so no other node starts from it too early.
+  pthread_mutex_lock(&entry_lock_);
+  int entry = entry_point_;
+  int top_level = max_level_;
+  const bool new_top = level > top_level;
+  if (!new_top)
+    pthread_mutex_unlock(&entry_lock_);
+
+  const float* query = points_->row(node);
+  entry = greedyClosest(query, entry, top_level, level, true, unused);
+
+  std::vector<Candidate> candidates;
+  std::vector<int> chosen;
+  for (int l = std::min(level, top_level); l >= 0; --l)
+  {
+    searchLevel(query, entry, ef_construction_, l, true, candidates, unused);
+    entry = candidates[0].second;  // Sorted nearest first.
+    selectNeighbours(candidates, m_);
+    chosen.clear();
+    for (size_t i = 0; i < candidates.size(); ++i)
+      chosen.push_back(candidates[i].second);
+    link(node, l, chosen);
+    for (size_t i = 0; i < chosen.size(); ++i)
+      addLink(chosen[i], l, node);
+  }
+
+  if (new_top)
+  {
+    entry_point_ = node;
+    max_level_ = level;
+    pthread_mutex_unlock(&entry_lock_);
+  }
+}
+
+/**
+ * Finds the k nearest training rows: a greedy walk down the upper levels
+ * followed by a best-first search of efSearch candidates on level 0.
+ */
+void HnswIndex::search(const float* query, NeighbourList& neighbours,
+                       SearchStats& stats) const
+{
+  ++stats.queries;
+  if (entry_point_ < 0) return;
+  int entry = greedyClosest(query, entry_point_, max_level_, 0, false, stats);
+  std::vector<Candidate> result;
+  searchLevel(query, entry, std::max(ef_search_, neighbours.capacity()), 0,
+              false, result, stats);
+  for (size_t i = 0; i < result.size(); ++i)
+  {
+    const int node = result[i].second;
+    neighbours.push(result[i].first, node, points_->label(node));
+  }
+}
+
+bool HnswIndex::set_search_effort(const int effort)
+{
+  ef_search_ = effort;
+  return true;
+}
+
+/**
+ * Walks from the current node to its nearest link on each level from
+ * from_level down to (not including) to_level, stopping at a local minimum.
+ *
+ * @return The node reached on level to_level.
+ */
+int HnswIndex::greedyClosest(const float* query, int current,
+                             const int from_level, const int to_level,
+                             const bool locked, SearchStats& stats) const
+{
+  double current_distance = distance(query, current);
+  ++stats.distance_evaluations;
+  std::vector<int> buffer;
+  for (int l = from_level; l > to_level; --l)
+  {
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      ++stats.nodes_visited;
+      if (locked) pthread_mutex_lock(&node_locks_[current]);
+      buffer.assign(links(current, l), links(current, l) +
+                                       num_links(current, l));
+      if (locked) pthread_mutex_unlock(&node_locks_[current]);
+      for (size_t i = 0; i < buffer.size(); ++i)
+      {
+        double d = distance(query, buffer[i]);
+        ++stats.distance_evaluations;
+        if (d < current_distance)
+        {
+          current_distance = d;
+          current = buffer[i];
+          changed = true;
+        }
+      }
+    }
+  }
+  return current;
+}
+
+/**
+ * Best-first search on one level, keeping the ef nearest nodes found.
+ *
+ * @param result Receives the nodes found, sorted nearest first.
+ * @param locked Lock each node while reading its links (during build).
+ */
+void HnswIndex::searchLevel(const float* query, const int entry, const int ef,
+                            const int level, const bool locked,
+                            std::vector<Candidate>& result,
+                            SearchStats& stats) const
+{
+  VisitedList* visited = acquireVisited();
+  // candidates: min-heap of nodes to expand; result: max-heap of the best ef.
+  std::vector<Candidate> candidates;
+  result.clear();
+  std::greater<Candidate> min_first;
+
+  Candidate start(distance(query, entry), entry);
+  ++stats.distance_evaluations;
+  visited->marks[entry] = visited->current;
+  candidates.push_back(start);
+  result.push_back(start);
+
+  std::vector<int> buffer;
+  while (!candidates.empty())
+  {
+    std::pop_heap(candidates.begin(), candidates.end(), min_first);
+    Candidate nearest = candidates.back();
+    candidates.pop_back();
+    if (nearest.first > result.front().first &&
+        static_cast<int>(result.size()) >= ef)
+      break;  // Nothing left that can improve the result.
+
+    ++stats.nodes_visited;
+    const int node = nearest.second;
+    if (locked) pthread_mutex_lock(&node_locks_[node]);
+    buffer.assign(links(node, level), links(node, level) +
+                                      num_links(node, level));
+    if (locked) pthread_mutex_unlock(&node_locks_[node]);
+
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+      const int next = buffer[i];
+      if (visited->marks[next] == visited->current) continue;
+      visited->marks[next] = visited->current;
+
+      double d = distance(query, next);
+      ++stats.distance_evaluations;
+      if (static_cast<int>(result.size()) < ef || d < result.front().first)
+      {
+        candidates.push_back(Candidate(d, next));
+        std::push_heap(candidates.begin(), candidates.end(), min_first);
+        result.push_back(Candidate(d, next));
+        std::push_heap(result.begin(), result.end());
+        if (static_cast<int>(result.size()) > ef)
+        {
+          std::pop_heap(result.begin(), result.end());
+          result.pop_back();
+        }
+      }
+    }
+  }
+  releaseVisited(visited);
+  std::sort(result.begin(), result.end());
+}
+
+/**
+ * Reduces the candidates (sorted nearest first) to at most max_links, using
+ * the HNSW heuristic: a candidate is kept only if it is closer to the new
+ * node than to every candidate kept so far. This keeps links pointing in
+ * different directions instead of all into the same cluster.
+ */
+void HnswIndex::selectNeighbours(std::vector<Candidate>& candidates,
+                                 const int max_links) const
+{
+  if (static_cast<int>(candidates.size()) <= max_links) return;
+  std::vector<Candidate> kept;
+  for (size_t i = 0; i < candidates.size() &&
+       static_cast<int>(kept.size()) < max_links; ++i)
+  {
+    bool diverse = true;
+    for (size_t j = 0; j < kept.size() && diverse; ++j)
+    {
+      if (distance(candidates[i].second, kept[j].second) <
+          candidates[i].first)
+        diverse = false;
+    }
+    if (diverse) kept.push_back(candidates[i]);
+  }
+  candidates.swap(kept);
+}
+
+/**
+ * Sets the links of a node on one level.
+ */
+void HnswIndex::link(const int node, const int level,
+                     const std::vector<int>& new_links)
+{
+  pthread_mutex_lock(&node_locks_[node]);
+  std::copy(new_links.begin(), new_links.end(), links(node, level));
+  num_links(node, level) = static_cast<int>(new_links.size());
+  pthread_mutex_unlock(&node_locks_[node]);
+}
+
+/**
+ * Adds a back link from an existing node to a new one. A full link list is
+ * shrunk again with the neighbour selection heuristic.
+ */
+void HnswIndex::addLink(const int node, const int level, const int new_link)
+{
+  pthread_mutex_lock(&node_locks_[node]);
+  int* slots = links(node, level);
+  int& count = num_links(node, level);
+  if (count < max_links(level))
+  {
+    slots[count++] = new_link;
+  }
+  else
+  {
+    std::vector<Candidate> candidates;
+    candidates.push_back(Candidate(distance(node, new_link), new_link));
+    for (int i = 0; i < count; ++i)
+      candidates.push_back(Candidate(distance(node, slots[i]), slots[i]));
+    std::sort(candidates.begin(), candidates.end());
+    selectNeighbours(candidates, max_links(level));
+    count = static_cast<int>(candidates.size());
+    for (int i = 0; i < count; ++i)
+      slots[i] = candidates[i].second;
+  }
+  pthread_mutex_unlock(&node_locks_[node]);
+}
+
+int* HnswIndex::links(const int node, const int level)
+{
+  if (level == 0) return &links0_[static_cast<size_t>(node) * max_links(0)];
+  return &upper_links_[static_cast<size_t>(upper_offset_[node] + level - 1) *
+                       m_];
+}
+
+const int* HnswIndex::links(const int node, const int level) const
+{
+  if (level == 0) return &links0_[static_cast<size_t>(node) * max_links(0)];
+  return &upper_links_[static_cast<size_t>(upper_offset_[node] + level - 1) *
+                       m_];
+}
+
+int& HnswIndex::num_links(const int node, const int level)
+{
+  if (level == 0) return count0_[node];
+  return upper_count_[upper_offset_[node] + level - 1];
+}
+
+int HnswIndex::num_links(const int node, const int level) const
+{
+  if (level == 0) return count0_[node];
+  return upper_count_[upper_offset_[node] + level - 1];
+}
+
+double HnswIndex::distance(const float* query, const int node) const
+{
+  return distance_(query, points_->row(node), points_->get_num_features());
+}
+
+double HnswIndex::distance(const int a, const int b) const
+{
+  return distance(points_->row(a), b);
+}
+
+HnswIndex::VisitedList* HnswIndex::acquireVisited() const
+{
+  VisitedList* visited = NULL;
+  pthread_mutex_lock(&pool_lock_);
+  if (!visited_pool_.empty())
+  {
+    visited = visited_pool_.back();
+    visited_pool_.pop_back();
+  }
+  pthread_mutex_unlock(&pool_lock_);
+
+  if (visited == NULL)
+  {
+    visited = new VisitedList;
+    visited->current = 0;
+  }
+  visited->marks.resize(points_->get_num_rows(), 0);
+  if (++visited->current == 0)  // Marks wrapped around; clear them.
+  {
+    std::fill(visited->marks.begin(), visited->marks.end(), 0);
+    visited->current = 1;
+  }
+  return visited;
+}
+
+void HnswIndex::releaseVisited(VisitedList* visited) const
+{
+  pthread_mutex_lock(&pool_lock_);
+  visited_pool_.push_back(visited);
+  pthread_mutex_unlock(&pool_lock_);
+}
@@ -0,0 +1,102 @@
+/*
+ * File:   HnswIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef HNSWINDEX_H
+#define	HNSWINDEX_H
+
+#include <vector>
+#include <utility>  // pair
+#include <pthread.h>
+#include "KnnIndex.h"
+#include "DistanceKernels.h"
+
+/**
+ * Approximate k-nearest neighbour search with a hierarchical navigable
+ * small world graph (Malkov & Yashunin, 2016).
+ *
+ * Every training row is a graph node with links to up to M near rows on each
+ * of its levels (2M on level 0). Levels are drawn from an exponential
+ * distribution, so the upper levels are sparse and let a greedy search
+ * jump across the data before a best-first search with a queue of efSearch
+ * candidates refines the answer on level 0. Larger M / efConstruction give a
+ * better graph, larger efSearch gives better recall; both cost time.
+ *
+ * Construction can use several threads; each node has its own lock.
+ * Links are stored in flat arrays (fixed-size slots per node and level).
+ */
+class HnswIndex : public KnnIndex
+{
+ public:
+  HnswIndex(const int m, const int ef_construction, const int ef_search,
+            const Metric metric, const int num_threads);
+  ~HnswIndex();
+  const char* name() const { return "hnsw"; }
+  void build(const FeatureMatrix& training_set);
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  bool exact() const { return false; }
+  bool set_search_effort(const int effort);
+  int get_search_effort() const { return ef_search_; }
+  bool save(IndexBlobWriter& out) const;
+  bool restore(IndexBlobReader& in, const FeatureMatrix& training_set);
+
+ private:
+  typedef std::pair<double, int> Candidate;  // (distance, node)
+  // Marks nodes seen during one search. Reused between searches through a
+  // small pool, so a query does not clear an N-sized array every time.
+  struct VisitedList
+  {
+    std::vector<unsigned short> marks;
+    unsigned short current;
+  };
+  static void* buildThread(void* index);
+  void insert(const int node);
+  int greedyClosest(const float* query, int current, const int from_level,
+                    const int to_level, const bool locked,
+                    SearchStats& stats) const;
+  void searchLevel(const float* query, const int entry, const int ef,
+                   const int level, const bool locked,
+                   std::vector<Candidate>& result, SearchStats& stats) const;
+  void selectNeighbours(std::vector<Candidate>& candidates,
+                        const int max_links) const;
+  void link(const int node, const int level, const std::vector<int>& links);
+  void addLink(const int node, const int level, const int new_link);
+  int* links(const int node, const int level);
+  const int* links(const int node, const int level) const;
+  int& num_links(const int node, const int level);
+  int num_links(const int node, const int level) const;
+  int max_links(const int level) const { return level == 0 ? 2 * m_ : m_; }
+  double distance(const float* query, const int node) const;
+  double distance(const int a, const int b) const;
+  VisitedList* acquireVisited() const;
+  void releaseVisited(VisitedList* visited) const;
+
+  int m_;
+  int ef_construction_;
+  int ef_search_;
+  int num_threads_;
+  DistanceFunction distance_;
+  const FeatureMatrix* points_;
+  int entry_point_;
+  int max_level_;
+  std::vector<int> levels_;  // Top level of each node.
+  std::vector<int> links0_;  // 2M slots per node for level 0.
+  std::vector<int> count0_;  // Links used per node on level 0.
+  std::vector<int> upper_offset_;  // First upper slot block of each node.
+  std::vector<int> upper_links_;  // M slots per node per level above 0.
+  std::vector<int> upper_count_;  // Links used per node per level above 0.
+  // Construction state.
+  mutable std::vector<pthread_mutex_t> node_locks_;
+  pthread_mutex_t entry_lock_;  // Guards entry_point_ and max_level_.
+  pthread_mutex_t next_lock_;  // Guards next_node_.
+  int next_node_;
+  // Pool of visited lists for concurrent searches.
+  mutable std::vector<VisitedList*> visited_pool_;
+  mutable pthread_mutex_t pool_lock_;
+};
+
+#endif	/* HNSWINDEX_H */
@@ -0,0 +1,103 @@
+/*
+ * File:   IndexBlob.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef INDEXBLOB_H
+#define	INDEXBLOB_H
+
+#include <vector>
+#include <cstring>  // memcpy
+
+/**
+ * Writes the state of a built KnnIndex as a flat run of bytes (see
+ * KnnIndexFile.h). Values are stored as they are in memory, so a blob is only
+ * read back on a machine with the same byte order and type sizes. Every
+ * value and array starts on an 8-byte boundary.
+ */
+class IndexBlobWriter
+{
+ public:
+  explicit IndexBlobWriter(std::vector<char>& blob) : blob_(blob) {}
+
+  template <typename T>
+  void value(const T& value)
+  {
+    append(&value, sizeof(T));
+  }
+
+  // The element count followed by the elements.
+  template <typename T>
+  void array(const std::vector<T>& values)
+  {
+    const long long count = values.size();
+    value(count);
+    if (count > 0) append(&values[0], sizeof(T) * values.size());
+  }
+
+ private:
+  void append(const void* data, const size_t bytes)
+  {
+    const size_t start = blob_.size();
+    blob_.resize(start + (bytes + 7) / 8 * 8, 0);
+    memcpy(&blob_[start], data, bytes);
+  }
+  std::vector<char>& blob_;
+};
+
+/**
+ * Reads back what an IndexBlobWriter wrote, in the same order. Reading past
+ * the end (a truncated or mismatched blob) yields zeros and clears ok().
+ */
+class IndexBlobReader
+{
+ public:
+  IndexBlobReader(const char* data, const long bytes)
+      : data_(data), bytes_(bytes), offset_(0), ok_(true) {}
+
+  template <typename T>
+  T value()
+  {
+    T value = T();
+    read(&value, sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  void array(std::vector<T>& values)
+  {
+    const long long count = value<long long>();
+    if (count < 0 || count > (bytes_ - offset_) / static_cast<long>(sizeof(T)))
+    {
+      ok_ = false;
+      values.clear();
+      return;
+    }
+    values.resize(count);
+    if (count > 0) read(&values[0], sizeof(T) * count);
+  }
+
+  bool ok() const { return ok_; }
+  bool at_end() const { return offset_ == bytes_; }
+
+ private:
+  void read(void* data, const size_t bytes)
+  {
+    const long padded = (bytes + 7) / 8 * 8;
+    if (!ok_ || offset_ + padded > bytes_)
+    {
+      ok_ = false;
+      return;
+    }
+    memcpy(data, data_ + offset_, bytes);
+    offset_ += padded;
+  }
+  const char* data_;
+  long bytes_;
+  long offset_;
+  bool ok_;
+};
+
+#endif	/* INDEXBLOB_H */
@@ -0,0 +1,308 @@
+/*
+ * File:   IvfPqIndex.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "IvfPqIndex.h"
+#include "FeatureMatrix.h"
+#include "NeighbourList.h"
+#include "IndexBlob.h"
+#include "KMeans.h"
+#include <algorithm>  // partial_sort, min, max
+#include <cmath>
+#include <cstdlib>  // abort
+#include <iostream>
+#include <utility>  // pair
+using namespace std;
+
+namespace {
+
+const int kIterations = 25;  // Lloyd iterations for every k-means run.
+const unsigned long kCoarseSeed = 1;
+
+}  // namespace
+
+const int IvfPqIndex::kCodebookSize;  // Bound by reference in min().
+
+/**
+ * @param nlist Number of inverted lists; 0 picks sqrt(rows) at build time.
+ * @param nprobe Number of lists visited per query.
+ * @param num_subquantizers Subvectors (bytes) per row; 0 picks features / 4.
+ * @param rerank Candidates re-scored with the exact distance; 0 for none.
+ */
+IvfPqIndex::IvfPqIndex(const int nlist, const int nprobe,
+                       const int num_subquantizers, const int rerank,
+                       const Metric metric)
+    : nlist_(nlist), nprobe_(nprobe < 1 ? 1 : nprobe),
+      num_subquantizers_(num_subquantizers), rerank_(max(rerank, 0)),
+      num_features_(0), codebook_size_(0),
+      squared_l2_(distanceKernels().squared_l2), points_(NULL)
+{
+  if (metric != kEuclidean)
+  {
+    cerr << "(!) The ivfpq engine only supports the euclidean metric\n";
+    abort();
+  }
+}
+
+/**
+ * Trains the coarse quantizer and the codebooks on the training set and
+ * encodes every row.
+ *
+ * @param training_set The labeled examples to index.
+ */
+void IvfPqIndex::build(const FeatureMatrix& training_set)
+{
+  points_ = &training_set;
+  num_features_ = training_set.get_num_features();
+  const int size = training_set.get_num_rows();
+  const int stride = training_set.get_stride();
+  const float* data = size > 0 ? training_set.row(0) : NULL;
+
+  if (nlist_ <= 0)
+    nlist_ = max(1, static_cast<int>(sqrt(static_cast<double>(size)) + 0.5));
+  nlist_ = max(1, min(nlist_, size));
+  if (num_subquantizers_ <= 0) num_subquantizers_ = max(1, num_features_ / 4);
+  num_subquantizers_ = max(1, min(num_subquantizers_, num_features_));
+  codebook_size_ = max(1, min(kCodebookSize, size));
+
+  // Coarse quantizer.
+  vector<int> assignment;
+  kmeans(data, size, num_features_, stride, nlist_, kIterations, kCoarseSeed,
+         centroids_, assignment);
+
+  // Residuals of every row from its list centroid.
+  vector<float> residuals(static_cast<size_t>(size) * num_features_);
+  for (int i = 0; i < size; ++i)
+  {
+    const float* row = training_set.row(i);
+    const float* centroid = &centroids_[assignment[i] * num_features_];
+    for (int j = 0; j < num_features_; ++j)
+      residuals[i * num_features_ + j] = row[j] - centroid[j];
+  }
+
+  // One codebook per subvector, trained on the residuals.
+  sub_begin_.resize(num_subquantizers_ + 1);
+  for (int s = 0; s <= num_subquantizers_; ++s)
+    sub_begin_[s] = s * num_features_ / num_subquantizers_;
+  codebooks_.assign(static_cast<size_t>(codebook_size_) * num_features_, 0.0f);
+  vector<unsigned char> row_codes(static_cast<size_t>(size) *
+                                  num_subquantizers_);
+  vector<float> codebook;
+  vector<int> words;
+  for (int s = 0; s < num_subquantizers_; ++s)
+  {
+    const int width = sub_begin_[s + 1] - sub_begin_[s];
+    kmeans(size > 0 ? &residuals[sub_begin_[s]] : NULL, size, width,
+           num_features_, codebook_size_, kIterations, kCoarseSeed + 1 + s,
+           codebook, words);
+    copy(codebook.begin(), codebook.end(),
+         codebooks_.begin() + codebook_size_ * sub_begin_[s]);
+    for (int i = 0; i < size; ++i)
+      row_codes[i * num_subquantizers_ + s] =
+          static_cast<unsigned char>(words[i]);
+  }
+
+  // Lay the codes out list by list.
+  list_begin_.assign(nlist_ + 1, 0);
+  for (int i = 0; i < size; ++i)
+    ++list_begin_[assignment[i] + 1];
+  for (int l = 0; l < nlist_; ++l)
+    list_begin_[l + 1] += list_begin_[l];
+  vector<int> next(list_begin_.begin(), list_begin_.end() - 1);
+  list_rows_.resize(size);
+  codes_.resize(row_codes.size());
+  for (int i = 0; i < size; ++i)
+  {
+    const int entry = next[assignment[i]]++;
+    list_rows_[entry] = i;
+    copy(row_codes.begin() + i * num_subquantizers_,
+         row_codes.begin() + (i + 1) * num_subquantizers_,
+         codes_.begin() + entry * num_subquantizers_);
+  }
+}
+
+/**
+ * Writes the quantizers and the encoded lists. nprobe and rerank are
+ * settings of the run and are not saved.
+ */
+bool IvfPqIndex::save(IndexBlobWriter& out) const
+{
+  out.value(nlist_);
+  out.value(num_subquantizers_);
+  out.value(codebook_size_);
+  out.value(num_features_);
+  out.array(centroids_);
+  out.array(sub_begin_);
+  out.array(codebooks_);
+  out.array(list_begin_);
+  out.array(list_rows_);
+  out.array(codes_);
+  return true;
+}
+
+bool IvfPqIndex::restore(IndexBlobReader& in,
+                         const FeatureMatrix& training_set)
+{
+  points_ = &training_set;
+  nlist_ = in.value<int>();
+  num_subquantizers_ = in.value<int>();
+  codebook_size_ = in.value<int>();
+  num_features_ = in.value<int>();
+  in.array(centroids_);
+  in.array(sub_begin_);
+  in.array(codebooks_);
+  in.array(list_begin_);
+  in.array(list_rows_);
+  in.array(codes_);
+  const int size = training_set.get_num_rows();
+  if (!in.ok() || num_features_ != training_set.get_num_features() ||
+      nlist_ < 1 || num_subquantizers_ < 1 ||
+      codebook_size_ < 1 || codebook_size_ > kCodebookSize ||
+      centroids_.size() != static_cast<size_t>(nlist_) * num_features_ ||
+      static_cast<int>(sub_begin_.size()) != num_subquantizers_ + 1 ||
+      codebooks_.size() !=
+          static_cast<size_t>(codebook_size_) * num_features_ ||
+      static_cast<int>(list_begin_.size()) != nlist_ + 1 ||
+      static_cast<int>(list_rows_.size()) != size ||
+      codes_.size() != static_cast<size_t>(size) * num_subquantizers_ ||
+      sub_begin_[0] != 0 || sub_begin_[num_subquantizers_] != num_features_ ||
+      list_begin_[0] != 0 || list_begin_[nlist_] != size)
+    return false;
+  for (int s = 0; s < num_subquantizers_; ++s)
+  {
+    if (sub_begin_[s] > sub_begin_[s + 1]) return false;
+  }
+  for (int l = 0; l < nlist_; ++l)
+  {
+    if (list_begin_[l] > list_begin_[l + 1]) return false;
+  }
+  for (int i = 0; i < size; ++i)
+  {
+    if (list_rows_[i] < 0 || list_rows_[i] >= size) return false;
+  }
+  for (size_t i = 0; i < codes_.size(); ++i)
+  {
+    if (codes_[i] >= codebook_size_) return false;
+  }
+  return true;
+}
+
+/**
+ * Scores the codes of the nprobe lists nearest to the query, then re-scores
+ * the best of them exactly if reranking is enabled.
+ */
+void IvfPqIndex::search(const float* query, NeighbourList& neighbours,
+                        SearchStats& stats) const
+{
+  ++stats.queries;
+  if (list_rows_.empty()) return;
+
+  // Nearest list centroids.
+  vector<pair<double, int> > lists(nlist_);
+  for (int l = 0; l < nlist_; ++l)
+  {
+    lists[l].first = squared_l2_(query, &centroids_[l * num_features_],
+                                 num_features_);
+    lists[l].second = l;
+  }
+  stats.distance_evaluations += nlist_;
+  const int probes = min(nprobe_, nlist_);
+  partial_sort(lists.begin(), lists.begin() + probes, lists.end());
+
+  // Distance table followed by the query residual.
+  vector<float> table(static_cast<size_t>(codebook_size_) *
+                      num_subquantizers_ + num_features_);
+  if (rerank_ == 0)
+  {
+    for (int p = 0; p < probes; ++p)
+      scanList(query, lists[p].second, table, neighbours, stats);
+    return;
+  }
+
+  NeighbourList candidates(max(rerank_, neighbours.capacity()));
+  for (int p = 0; p < probes; ++p)
+    scanList(query, lists[p].second, table, candidates, stats);
+  for (int c = 0; c < candidates.size(); ++c)
+  {
+    const int row = candidates[c].index;
+    neighbours.push(squared_l2_(query, points_->row(row), num_features_), row,
+                    candidates[c].classification);
+  }
+  stats.distance_evaluations += candidates.size();
+}
+
+/**
+ * Builds the distance table of the query residual for one list and offers
+ * every entry of the list to the candidates with its table-summed distance.
+ */
+void IvfPqIndex::scanList(const float* query, const int list,
+                          vector<float>& table, NeighbourList& candidates,
+                          SearchStats& stats) const
+{
+  const int begin = list_begin_[list];
+  const int end = list_begin_[list + 1];
+  if (begin == end) return;
+
+  // table[s * codebook_size_ + c]: squared distance from subvector s of the
+  // query residual to word c of codebook s.
+  float* residual = &table[codebook_size_ * num_subquantizers_];
+  const float* centroid = &centroids_[list * num_features_];
+  for (int j = 0; j < num_features_; ++j)
+    residual[j] = query[j] - centroid[j];
+  // Subvectors are only a few floats wide, too short for the SIMD kernels
+  // to pay for their call, so the table is filled with a plain loop.
+  float* entry_distance = &table[0];
+  for (int s = 0; s < num_subquantizers_; ++s)
+  {
+    const int width = sub_begin_[s + 1] - sub_begin_[s];
+    const float* sub_residual = residual + sub_begin_[s];
+    const float* word = &codebooks_[codebook_size_ * sub_begin_[s]];
+    for (int c = 0; c < codebook_size_; ++c, word += width)
+    {
+      float sum = 0.0f;
+      for (int j = 0; j < width; ++j)
+      {
+        const float difference = sub_residual[j] - word[j];
+        sum += difference * difference;
+      }
+      *entry_distance++ = sum;
+    }
+  }
+
+  for (int entry = begin; entry < end; ++entry)
+  {
+    const unsigned char* code = &codes_[entry * num_subquantizers_];
+    const float* lookup = &table[0];
+    float distance = 0.0f;
+    for (int s = 0; s < num_subquantizers_; ++s, lookup += codebook_size_)
+      distance += lookup[code[s]];
+    const int row = list_rows_[entry];
+    candidates.push(distance, row, points_->label(row));
+  }
+  stats.nodes_visited += end - begin;
+}
+
+/**
+ * The speed/recall knob is the number of lists visited per query.
+ */
+bool IvfPqIndex::set_search_effort(const int effort)
+{
+  nprobe_ = effort < 1 ? 1 : effort;
+  return true;
+}
+
+/**
+ * Bytes held by the index: codes, row numbers, centroids and codebooks.
+ * The full rows are only kept for reranking and are not counted.
+ */
+long IvfPqIndex::memory_bytes() const
+{
+  return codes_.size() * sizeof(unsigned char) +
+         list_rows_.size() * sizeof(int) +
+         list_begin_.size() * sizeof(int) +
+         centroids_.size() * sizeof(float) +
+         codebooks_.size() * sizeof(float);
+}
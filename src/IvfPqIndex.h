@@ -0,0 +1,67 @@
+/*
+ * File:   IvfPqIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef IVFPQINDEX_H
+#define	IVFPQINDEX_H
+
+#include <vector>
+#include "KnnIndex.h"
+#include "DistanceKernels.h"
+
+/**
+ * Approximate k-nearest neighbour search over compressed rows: an inverted
+ * file with product quantization (IVFADC, Jegou, Douze & Schmid, 2011).
+ *
+ * A k-means coarse quantizer splits the training set into nlist lists. The
+ * residual of each row from its list centroid is cut into M subvectors and
+ * each subvector is replaced by the number of its nearest centroid in a
+ * 256-word codebook, so a row is stored in M bytes. A query visits only the
+ * nprobe lists with the nearest centroids and scores their codes with one
+ * table lookup per subvector (asymmetric distance computation). The best
+ * rerank candidates can then be re-scored exactly against the full rows.
+ *
+ * Euclidean metric only.
+ */
+class IvfPqIndex : public KnnIndex
+{
+ public:
+  IvfPqIndex(const int nlist, const int nprobe, const int num_subquantizers,
+             const int rerank, const Metric metric);
+  const char* name() const { return "ivfpq"; }
+  void build(const FeatureMatrix& training_set);
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  bool exact() const { return false; }
+  bool set_search_effort(const int effort);
+  int get_search_effort() const { return nprobe_; }
+  long memory_bytes() const;
+  bool save(IndexBlobWriter& out) const;
+  bool restore(IndexBlobReader& in, const FeatureMatrix& training_set);
+
+ private:
+  static const int kCodebookSize = 256;  // One byte per code.
+  void scanList(const float* query, const int list, std::vector<float>& table,
+                NeighbourList& candidates, SearchStats& stats) const;
+
+  int nlist_;
+  int nprobe_;
+  int num_subquantizers_;
+  int rerank_;  // Candidates re-scored exactly; 0 keeps the PQ distances.
+  int num_features_;
+  int codebook_size_;  // Words per codebook (fewer with few training rows).
+  DistanceFunction squared_l2_;
+  const FeatureMatrix* points_;
+  std::vector<float> centroids_;  // nlist_ coarse centroids, row-major.
+  std::vector<int> sub_begin_;  // First feature of each subvector (M + 1).
+  // Codebook of subvector s starts at codebook_size_ * sub_begin_[s].
+  std::vector<float> codebooks_;
+  std::vector<int> list_begin_;  // First entry of each list (nlist_ + 1).
+  std::vector<int> list_rows_;  // Training row of each entry.
+  std::vector<unsigned char> codes_;  // M codes per entry.
+};
+
+#endif	/* IVFPQINDEX_H */
@@ -0,0 +1,101 @@
+/*
+ * File:   KMeans.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "KMeans.h"
+#include "DistanceKernels.h"
+#include "Random.h"
+#include <algorithm>
+#include <limits>
+
+void kmeans(const float* data, const int n, const int dim, const int stride,
+            const int k, const int iterations, const unsigned long seed,
+            std::vector<float>& centroids, std::vector<int>& assignment)
+{
+  DistanceFunction squared_l2 = distanceKernels().squared_l2;
+  centroids.assign(static_cast<size_t>(k) * dim, 0.0f);
+  assignment.assign(n, 0);
+  if (n == 0 || k == 0) return;
+
+  // k-means++ seeding: each new centroid is a point drawn with probability
+  // proportional to its squared distance from the nearest centroid so far.
+  Random generator(seed * 2654435761UL + 1);
+  std::vector<double> nearest(n, std::numeric_limits<double>::max());
+  int chosen = static_cast<int>(generator.uniform() * n);
+  for (int c = 0; c < k; ++c)
+  {
+    const float* point = data + static_cast<long>(chosen) * stride;
+    std::copy(point, point + dim, centroids.begin() + c * dim);
+    double total = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+      double d = squared_l2(data + static_cast<long>(i) * stride,
+                            &centroids[c * dim], dim);
+      if (d < nearest[i]) nearest[i] = d;
+      total += nearest[i];
+    }
+    if (total <= 0.0)  // Fewer distinct points than centroids.
+    {
+      chosen = static_cast<int>(generator.uniform() * n);
+      continue;
+    }
+    double target = generator.uniform() * total;
+    chosen = n - 1;
+    for (int i = 0; i < n; ++i)
+    {
+      target -= nearest[i];
+      if (target < 0.0)
+      {
+        chosen = i;
+        break;
+      }
+    }
+  }
+
+  std::vector<double> sums(static_cast<size_t>(k) * dim);
+  std::vector<int> counts(k);
+  for (int iteration = 0; iteration < iterations; ++iteration)
+  {
+    // Assign every point to its nearest centroid.
+    bool changed = false;
+    for (int i = 0; i < n; ++i)
+    {
+      const float* point = data + static_cast<long>(i) * stride;
+      int best = 0;
+      double best_distance = std::numeric_limits<double>::max();
+      for (int c = 0; c < k; ++c)
+      {
+        double d = squared_l2(point, &centroids[c * dim], dim);
+        if (d < best_distance)
+        {
+          best_distance = d;
+          best = c;
+        }
+      }
+      if (iteration == 0 || assignment[i] != best) changed = true;
+      assignment[i] = best;
+    }
+    if (!changed) break;
+
+    // Move every centroid to the mean of its points (empty ones stay put).
+    std::fill(sums.begin(), sums.end(), 0.0);
+    std::fill(counts.begin(), counts.end(), 0);
+    for (int i = 0; i < n; ++i)
+    {
+      const float* point = data + static_cast<long>(i) * stride;
+      double* sum = &sums[assignment[i] * dim];
+      for (int j = 0; j < dim; ++j)
+        sum[j] += point[j];
+      ++counts[assignment[i]];
+    }
+    for (int c = 0; c < k; ++c)
+    {
+      if (counts[c] == 0) continue;
+      for (int j = 0; j < dim; ++j)
+        centroids[c * dim + j] = sums[c * dim + j] / counts[c];
+    }
+  }
+}
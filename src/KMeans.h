@@ -0,0 +1,26 @@
+/*
+ * File:   KMeans.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef KMEANS_H
+#define	KMEANS_H
+
+#include <vector>
+
+/**
+ * Lloyd's k-means clustering of n points of dim floats each.
+ * Point i starts at data + i * stride. Initial centroids are drawn with
+ * k-means++ seeding from a private generator (see Random.h), so the result
+ * depends only on the data and the seed.
+ *
+ * @param centroids   Receives k * dim floats, row-major.
+ * @param assignment  Receives the centroid of each point.
+ */
+void kmeans(const float* data, const int n, const int dim, const int stride,
+            const int k, const int iterations, const unsigned long seed,
+            std::vector<float>& centroids, std::vector<int>& assignment);
+
+#endif	/* KMEANS_H */
@@ -0,0 +1,261 @@
+/*
+ * File:   KdTreeIndex.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "KdTreeIndex.h"
+#include "NeighbourList.h"
+#include "IndexBlob.h"
+#include <algorithm>  // nth_element, max
+#include <cstdlib>  // abort
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// A box is skipped only if it is clearly further than the k-th neighbour.
+// The slack absorbs rounding differences between the box bound and the
+// distance kernel, so pruning never changes the exact answer.
+const double kPruneSlack = 1e-9;
+
+// Orders training rows by their value in one dimension.
+class CompareDimension
+{
+ public:
+  CompareDimension(const FeatureMatrix& training_set, const int dimension)
+      : training_set_(training_set), dimension_(dimension) {}
+  bool operator()(const int a, const int b) const
+  {
+    return training_set_.row(a)[dimension_] < training_set_.row(b)[dimension_];
+  }
+ private:
+  const FeatureMatrix& training_set_;
+  int dimension_;
+};
+
+}  // namespace
+
+KdTreeIndex::KdTreeIndex(const int leaf_size, const Metric metric)
+    : leaf_size_(leaf_size < 1 ? 1 : leaf_size), num_features_(0),
+      metric_(metric), distance_(metricKernel(distanceKernels(), metric)),
+      training_set_(NULL)
+{
+  if (metric == kCosine)
+  {
+    std::cerr << "(!) The kdtree engine does not support the cosine metric\n";
+    abort();
+  }
+}
+
+/**
+ * Builds the tree over the whole training set.
+ *
+ * @param training_set The labeled examples to index.
+ */
+void KdTreeIndex::build(const FeatureMatrix& training_set)
+{
+  training_set_ = &training_set;
+  num_features_ = training_set.get_num_features();
+  const int size = training_set.get_num_rows();
+  rows_.resize(size);
+  for (int i = 0; i < size; ++i)
+    rows_[i] = i;
+  left_.clear();
+  right_.clear();
+  begin_.clear();
+  end_.clear();
+  lower_.clear();
+  upper_.clear();
+  buildNode(training_set, 0, size);
+
+  points_ = FeatureMatrix(num_features_);
+  points_.reserve(size);
+  for (int i = 0; i < size; ++i)
+    points_.appendRow(training_set, rows_[i]);
+}
+
+bool KdTreeIndex::save(IndexBlobWriter& out) const
+{
+  out.value(num_features_);
+  out.array(rows_);
+  out.array(left_);
+  out.array(right_);
+  out.array(begin_);
+  out.array(end_);
+  out.array(lower_);
+  out.array(upper_);
+  return true;
+}
+
+/**
+ * Reads a tree written by save(). The leaves are scanned through rows_, in
+ * the training set as given, instead of from a copy in leaf order.
+ */
+bool KdTreeIndex::restore(IndexBlobReader& in,
+                          const FeatureMatrix& training_set)
+{
+  num_features_ = in.value<int>();
+  in.array(rows_);
+  in.array(left_);
+  in.array(right_);
+  in.array(begin_);
+  in.array(end_);
+  in.array(lower_);
+  in.array(upper_);
+  const int size = training_set.get_num_rows();
+  const size_t nodes = left_.size();
+  if (!in.ok() || num_features_ != training_set.get_num_features() ||
+      static_cast<int>(rows_.size()) != size || right_.size() != nodes ||
+      begin_.size() != nodes || end_.size() != nodes ||
+      lower_.size() != nodes * num_features_ ||
+      upper_.size() != nodes * num_features_)
+    return false;
+  // Children are numbered after their node, so the search always ends.
+  for (size_t node = 0; node < nodes; ++node)
+  {
+    const bool leaf = left_[node] == -1;
+    if (leaf ? right_[node] != -1 :
+        left_[node] <= static_cast<int>(node) ||
+        left_[node] >= static_cast<int>(nodes) ||
+        right_[node] <= static_cast<int>(node) ||
+        right_[node] >= static_cast<int>(nodes))
+      return false;
+    if (begin_[node] < 0 || end_[node] > size || begin_[node] > end_[node])
+      return false;
+  }
+  for (int i = 0; i < size; ++i)
+  {
+    if (rows_[i] < 0 || rows_[i] >= size) return false;
+  }
+  training_set_ = &training_set;
+  points_ = FeatureMatrix(num_features_);
+  return true;
+}
+
+/**
+ * Creates the node for rows_[begin, end) and, unless it is small enough to be
+ * a leaf, splits it at the median of its widest dimension.
+ *
+ * @return The number of the new node.
+ */
+int KdTreeIndex::buildNode(const FeatureMatrix& training_set, const int begin,
+                           const int end)
+{
+  const int node = static_cast<int>(left_.size());
+  left_.push_back(-1);
+  right_.push_back(-1);
+  begin_.push_back(begin);
+  end_.push_back(end);
+
+  // Bounding box of the rows in this node.
+  lower_.resize(lower_.size() + num_features_,
+                std::numeric_limits<float>::max());
+  upper_.resize(upper_.size() + num_features_,
+                -std::numeric_limits<float>::max());
+  float* lower = &lower_[node * num_features_];
+  float* upper = &upper_[node * num_features_];
+  for (int i = begin; i < end; ++i)
+  {
+    const float* row = training_set.row(rows_[i]);
+    for (int j = 0; j < num_features_; ++j)
+    {
+      if (row[j] < lower[j]) lower[j] = row[j];
+      if (row[j] > upper[j]) upper[j] = row[j];
+    }
+  }
+
+  if (end - begin <= leaf_size_)
+    return node;
+
+  int split_dimension = 0;
+  for (int j = 1; j < num_features_; ++j)
+  {
+    if (upper[j] - lower[j] > upper[split_dimension] - lower[split_dimension])
+      split_dimension = j;
+  }
+  if (upper[split_dimension] == lower[split_dimension])
+    return node;  // All rows are identical; no split can separate them.
+
+  const int middle = begin + (end - begin) / 2;
+  std::nth_element(rows_.begin() + begin, rows_.begin() + middle,
+                   rows_.begin() + end,
+                   CompareDimension(training_set, split_dimension));
+
+  // Children are created after this node, so refer to them by number.
+  int left = buildNode(training_set, begin, middle);
+  int right = buildNode(training_set, middle, end);
+  left_[node] = left;
+  right_[node] = right;
+  return node;
+}
+
+/**
+ * Finds the k nearest training rows to the query.
+ */
+void KdTreeIndex::search(const float* query, NeighbourList& neighbours,
+                         SearchStats& stats) const
+{
+  ++stats.queries;
+  if (!left_.empty())
+    searchNode(0, query, neighbours, stats);
+}
+
+/**
+ * Depth-first search that visits the nearer child first and skips any child
+ * whose bounding box cannot hold a better neighbour.
+ */
+void KdTreeIndex::searchNode(const int node, const float* query,
+                             NeighbourList& neighbours,
+                             SearchStats& stats) const
+{
+  ++stats.nodes_visited;
+  if (left_[node] < 0)  // Leaf: scan its rows.
+  {
+    for (int i = begin_[node]; i < end_[node]; ++i)
+    {
+      neighbours.push(distance_(query, leafRow(i), num_features_), rows_[i],
+                      training_set_->label(rows_[i]));
+    }
+    stats.distance_evaluations += end_[node] - begin_[node];
+    return;
+  }
+
+  int near = left_[node], far = right_[node];
+  double near_distance = boxDistance(near, query);
+  double far_distance = boxDistance(far, query);
+  if (far_distance < near_distance)
+  {
+    std::swap(near, far);
+    std::swap(near_distance, far_distance);
+  }
+  if (near_distance <= neighbours.threshold() * (1 + kPruneSlack))
+    searchNode(near, query, neighbours, stats);
+  if (far_distance <= neighbours.threshold() * (1 + kPruneSlack))
+    searchNode(far, query, neighbours, stats);
+}
+
+/**
+ * Distance from the query to the nearest point of a node's bounding box
+ * (zero if the query is inside it), in the same units the metric kernel
+ * ranks by. A lower bound for every row inside.
+ */
+double KdTreeIndex::boxDistance(const int node, const float* query) const
+{
+  const float* lower = &lower_[node * num_features_];
+  const float* upper = &upper_[node * num_features_];
+  double distance = 0.0;
+  for (int j = 0; j < num_features_; ++j)
+  {
+    float gap = 0.0f;
+    if (query[j] < lower[j]) gap = lower[j] - query[j];
+    else if (query[j] > upper[j]) gap = query[j] - upper[j];
+    if (metric_ == kEuclidean) distance += static_cast<double>(gap) * gap;
+    else if (metric_ == kManhattan) distance += gap;
+    else if (metric_ == kChebyshev)
+      distance = std::max(distance, static_cast<double>(gap));
+    else if (gap > 0.0f) distance += 1;  // Every row differs here.
+  }
+  return distance;
+}
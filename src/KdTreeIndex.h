@@ -0,0 +1,68 @@
+/*
+ * File:   KdTreeIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef KDTREEINDEX_H
+#define	KDTREEINDEX_H
+
+#include <vector>
+#include "KnnIndex.h"
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"
+
+/**
+ * Exact k-nearest neighbour search with a KD-tree. Works for the Euclidean,
+ * Manhattan, Hamming and Chebyshev metrics (see boxDistance()).
+ * Every internal node splits its rows at the median of the dimension with
+ * the widest spread; leaves hold up to leaf_size rows. A subtree is skipped
+ * when its bounding box is further away than the current k-th neighbour.
+ *
+ * The tree is stored as flat arrays indexed by node number. A built tree
+ * copies the rows in leaf order so each leaf is scanned as one contiguous
+ * block; a restored tree reads them through rows_ where they lie in the
+ * mapped index file, so loading it copies no rows.
+ */
+class KdTreeIndex : public KnnIndex
+{
+ public:
+  KdTreeIndex(const int leaf_size, const Metric metric);
+  const char* name() const { return "kdtree"; }
+  void build(const FeatureMatrix& training_set);
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  bool save(IndexBlobWriter& out) const;
+  bool restore(IndexBlobReader& in, const FeatureMatrix& training_set);
+  int get_num_nodes() const { return static_cast<int>(left_.size()); }
+
+ private:
+  int buildNode(const FeatureMatrix& training_set, const int begin,
+                const int end);
+  void searchNode(const int node, const float* query,
+                  NeighbourList& neighbours, SearchStats& stats) const;
+  double boxDistance(const int node, const float* query) const;
+  // Features of row i in leaf order.
+  const float* leafRow(const int i) const
+  {
+    return points_.get_num_rows() > 0 ? points_.row(i) :
+                                        training_set_->row(rows_[i]);
+  }
+  int leaf_size_;
+  int num_features_;
+  Metric metric_;
+  DistanceFunction distance_;
+  const FeatureMatrix* training_set_;
+  FeatureMatrix points_;  // The rows in leaf order; empty if restored.
+  std::vector<int> rows_;  // Training set row of each row in leaf order.
+  // One entry per node. Leaves have left_ == -1.
+  std::vector<int> left_;
+  std::vector<int> right_;
+  std::vector<int> begin_;  // First row of the node in leaf order.
+  std::vector<int> end_;  // One past the last row of the node.
+  std::vector<float> lower_;  // Bounding boxes, num_features_ per node.
+  std::vector<float> upper_;
+};
+
+#endif	/* KDTREEINDEX_H */
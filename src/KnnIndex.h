@@ -0,0 +1,86 @@
+/*
+ * File:   KnnIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef KNNINDEX_H
+#define	KNNINDEX_H
+
+class FeatureMatrix;
+class NeighbourList;
+class IndexBlobWriter;
+class IndexBlobReader;
+
+/**
+ * Counters gathered while searching. Each thread of work keeps its own and
+ * they are added together at the end, so searching needs no locks.
+ */
+struct SearchStats
+{
+  long queries;
+  long distance_evaluations;  // Full distance computations against rows.
+  long nodes_visited;  // Index nodes (tree nodes, graph nodes, ...) touched.
+  // Rows proposed for the exact distance by a cheaper first stage: the rows
+  // of the LSH buckets (before duplicates go), the cascade's survivors of
+  // the subset ranking.
+  long candidates;
+  long features_examined;  // Attributes summed by early-abandoning scans.
+  long early_stops;  // Anytime queries cut short by their budget.
+
+  SearchStats()
+      : queries(0), distance_evaluations(0), nodes_visited(0), candidates(0),
+        features_examined(0), early_stops(0) {}
+
+  void add(const SearchStats& other)
+  {
+    queries += other.queries;
+    distance_evaluations += other.distance_evaluations;
+    nodes_visited += other.nodes_visited;
+    candidates += other.candidates;
+    features_examined += other.features_examined;
+    early_stops += other.early_stops;
+  }
+};
+
+/**
+ * A search structure over the training set that NearestNeighbour can use
+ * instead of scanning every row. An index is built once and then queried
+ * many times; search() must be safe to call from several threads at once.
+ * Neighbours are reported with their row in the training set, so an exact
+ * index gives the same answer (ties included) as the brute-force scan.
+ */
+class KnnIndex
+{
+ public:
+  virtual ~KnnIndex() {}
+  virtual const char* name() const = 0;
+  // The training set must outlive the index.
+  virtual void build(const FeatureMatrix& training_set) = 0;
+  // Fills neighbours (which was reset by the caller) with the nearest rows.
+  virtual void search(const float* query, NeighbourList& neighbours,
+                      SearchStats& stats) const = 0;
+  // False for approximate engines, which may miss some true neighbours.
+  virtual bool exact() const { return true; }
+  // Approximate engines expose their speed/recall knob (e.g. efSearch) here
+  // so a recall-vs-latency curve can be traced. Returns false if there is
+  // no such knob.
+  virtual bool set_search_effort(const int effort) { return false; }
+  virtual int get_search_effort() const { return 0; }
+  // Bytes the index stores in place of the training rows, for engines that
+  // compress them; 0 if the index does not replace the rows.
+  virtual long memory_bytes() const { return 0; }
+  // Writes the built structure (not the training rows) so that restore()
+  // can stand in for build() in a later run; see KnnIndexFile.h. Returns
+  // false if the engine cannot be saved.
+  virtual bool save(IndexBlobWriter& out) const { return false; }
+  // Instead of build(): reads what save() wrote for the same training set.
+  // Returns false if the saved structure does not fit the training set.
+  virtual bool restore(IndexBlobReader& in, const FeatureMatrix& training_set)
+  {
+    return false;
+  }
+};
+
+#endif	/* KNNINDEX_H */
@@ -0,0 +1,267 @@
+/*
+ * File:   KnnIndexFile.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "KnnIndexFile.h"
+#include <cstdlib>  // abort
+#include <cstring>  // memcmp, memcpy, strncpy
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>  // open
+#include <sys/mman.h>  // mmap, munmap
+#include <sys/stat.h>  // fstat
+#include <unistd.h>  // close
+using namespace std;
+
+namespace {
+
+const char kMagic[8] = {'K', 'N', 'N', 'I', 'N', 'D', 'E', 'X'};
+const unsigned int kByteOrderMark = 0x01020304;
+const long long kSectionAlignment = 64;  // Bytes; FeatureMatrix rows need it.
+
+struct Header
+{
+  char magic[8];
+  int version;
+  unsigned int byte_order;
+  int num_rows;
+  int num_features;
+  int stride;  // Floats per row.
+  int num_classes;
+  int metric;
+  int reserved;
+  char engine[16];  // NUL-terminated.
+  long long rows_offset;
+  long long labels_offset;
+  long long min_offset;
+  long long max_offset;
+  long long binary_offset;
+  long long structure_offset;
+  long long structure_bytes;
+  long long file_bytes;
+};
+
+long long aligned(const long long offset)
+{
+  return (offset + kSectionAlignment - 1) / kSectionAlignment *
+         kSectionAlignment;
+}
+
+// Writes a section at its offset, zero filling the gap before it.
+void writeSection(ofstream& out, long long& position, const long long offset,
+                  const void* data, const long long bytes)
+{
+  static const char kZeros[kSectionAlignment] = {0};
+  out.write(kZeros, offset - position);
+  if (bytes > 0) out.write(static_cast<const char*>(data), bytes);
+  position = offset + bytes;
+}
+
+// True if [offset, offset + bytes) lies inside a file of the given size.
+bool inside(const long long offset, const long long bytes,
+            const long long file_bytes)
+{
+  return offset >= static_cast<long long>(sizeof(Header)) && bytes >= 0 &&
+         offset <= file_bytes && bytes <= file_bytes - offset;
+}
+
+}  // namespace
+
+KnnIndexFile::KnnIndexFile()
+    : map_(NULL), map_bytes_(0), num_classes_(0), metric_(kEuclidean),
+      structure_(NULL), structure_bytes_(0) {}
+
+KnnIndexFile::~KnnIndexFile()
+{
+  close();
+}
+
+void KnnIndexFile::close()
+{
+  training_set_ = FeatureMatrix();  // Drop the view before unmapping.
+  if (map_ != NULL) munmap(map_, map_bytes_);
+  map_ = NULL;
+  map_bytes_ = 0;
+  structure_ = NULL;
+  structure_bytes_ = 0;
+}
+
+/**
+ * Writes a trained model to a new index file (replacing any file there).
+ *
+ * @param training_set The normalized training rows.
+ * @param min_values Attribute values that were mapped to 0.
+ * @param max_values Attribute values that were mapped to 1.
+ * @param binary_columns Which attributes are binary (0/1).
+ * @param structure The built engine, from KnnIndex::save(); may be empty.
+ */
+void KnnIndexFile::write(const string& path, const FeatureMatrix& training_set,
+                         const int num_classes, const Metric metric,
+                         const string& engine,
+                         const vector<float>& min_values,
+                         const vector<float>& max_values,
+                         const vector<bool>& binary_columns,
+                         const vector<char>& structure)
+{
+  const int num_rows = training_set.get_num_rows();
+  const int num_features = training_set.get_num_features();
+  if (static_cast<int>(min_values.size()) != num_features ||
+      static_cast<int>(max_values.size()) != num_features ||
+      static_cast<int>(binary_columns.size()) != num_features ||
+      engine.size() >= sizeof(Header().engine))
+  {
+    cerr << "(!) Inconsistent kNN model; the index file was not written\n";
+    abort();
+  }
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrderMark;
+  header.num_rows = num_rows;
+  header.num_features = num_features;
+  header.stride = training_set.get_stride();
+  header.num_classes = num_classes;
+  header.metric = metric;
+  strncpy(header.engine, engine.c_str(), sizeof(header.engine) - 1);
+  const long long row_bytes = sizeof(float) *
+                              static_cast<long long>(num_rows) * header.stride;
+  header.rows_offset = aligned(sizeof(Header));
+  header.labels_offset = aligned(header.rows_offset + row_bytes);
+  header.min_offset = aligned(header.labels_offset +
+                              sizeof(int) * static_cast<long long>(num_rows));
+  header.max_offset = aligned(header.min_offset +
+                              sizeof(float) * num_features);
+  header.binary_offset = aligned(header.max_offset +
+                                 sizeof(float) * num_features);
+  header.structure_offset = aligned(header.binary_offset + num_features);
+  header.structure_bytes = structure.size();
+  header.file_bytes = header.structure_offset + header.structure_bytes;
+
+  ofstream out(path.c_str(), ios::binary | ios::trunc);
+  if (!out.is_open())
+  {
+    cerr << "(!) Unable to create index file " << path << "\n";
+    abort();
+  }
+  vector<char> binary(binary_columns.begin(), binary_columns.end());
+  long long position = 0;
+  writeSection(out, position, 0, &header, sizeof(header));
+  writeSection(out, position, header.rows_offset,
+               num_rows > 0 ? training_set.row(0) : NULL, row_bytes);
+  writeSection(out, position, header.labels_offset, training_set.labels(),
+               sizeof(int) * static_cast<long long>(num_rows));
+  writeSection(out, position, header.min_offset, &min_values[0],
+               sizeof(float) * num_features);
+  writeSection(out, position, header.max_offset, &max_values[0],
+               sizeof(float) * num_features);
+  writeSection(out, position, header.binary_offset, &binary[0], num_features);
+  writeSection(out, position, header.structure_offset,
+               structure.empty() ? NULL : &structure[0], structure.size());
+  out.close();
+  if (out.fail())
+  {
+    cerr << "(!) Failed to write index file " << path << "\n";
+    abort();
+  }
+}
+
+/**
+ * Maps an index file read-only and checks its header and labels. The training
+ * rows are used where they lie in the mapping, so nothing is parsed or
+ * copied; their pages are read on first use.
+ */
+void KnnIndexFile::open(const string& path)
+{
+  close();
+  const int descriptor = ::open(path.c_str(), O_RDONLY);
+  struct stat status;
+  if (descriptor < 0 || fstat(descriptor, &status) != 0)
+  {
+    cerr << "(!) Unable to open index file " << path << "\n";
+    abort();
+  }
+  map_bytes_ = status.st_size;
+  if (map_bytes_ < static_cast<long>(sizeof(Header)))
+  {
+    cerr << "(!) " << path << " is not a kNN index file\n";
+    abort();
+  }
+  map_ = mmap(NULL, map_bytes_, PROT_READ, MAP_SHARED, descriptor, 0);
+  ::close(descriptor);  // The mapping stays valid.
+  if (map_ == MAP_FAILED)
+  {
+    map_ = NULL;
+    cerr << "(!) Unable to map index file " << path << "\n";
+    abort();
+  }
+
+  const char* base = static_cast<const char*>(map_);
+  Header header;
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+  {
+    cerr << "(!) " << path << " is not a kNN index file\n";
+    abort();
+  }
+  if (header.byte_order != kByteOrderMark || header.version != kVersion)
+  {
+    cerr << "(!) Index file " << path << " has version " << header.version
+         << " or another byte order; this program reads version " << kVersion
+         << "\n";
+    abort();
+  }
+  const long long num_rows = header.num_rows;
+  const int num_features = header.num_features;
+  const int block = FeatureMatrix::kRowAlignment;
+  if (header.file_bytes != map_bytes_ || num_rows < 0 || num_features < 1 ||
+      header.num_classes < 1 ||
+      header.stride != (num_features + block - 1) / block * block ||
+      header.metric < kEuclidean || header.metric > kCosine ||
+      header.engine[sizeof(header.engine) - 1] != '\0' ||
+      header.rows_offset % kSectionAlignment != 0 ||
+      !inside(header.rows_offset,
+              sizeof(float) * num_rows * header.stride, map_bytes_) ||
+      header.labels_offset % sizeof(int) != 0 ||
+      !inside(header.labels_offset, sizeof(int) * num_rows, map_bytes_) ||
+      !inside(header.min_offset, sizeof(float) * num_features, map_bytes_) ||
+      !inside(header.max_offset, sizeof(float) * num_features, map_bytes_) ||
+      !inside(header.binary_offset, num_features, map_bytes_) ||
+      !inside(header.structure_offset, header.structure_bytes, map_bytes_))
+  {
+    cerr << "(!) Index file " << path << " is damaged or truncated\n";
+    abort();
+  }
+  // The votes are tallied in an array indexed by label.
+  const int* labels = reinterpret_cast<const int*>(base + header.labels_offset);
+  for (long long i = 0; i < num_rows; ++i)
+  {
+    if (labels[i] < 1 || labels[i] > header.num_classes)
+    {
+      cerr << "(!) Index file " << path << " is damaged: example " << i + 1
+           << " has class " << labels[i] << " of " << header.num_classes
+           << "\n";
+      abort();
+    }
+  }
+
+  FeatureMatrix view(reinterpret_cast<const float*>(base + header.rows_offset),
+                     labels, header.num_rows, num_features);
+  training_set_.swap(view);
+  num_classes_ = header.num_classes;
+  metric_ = static_cast<Metric>(header.metric);
+  engine_ = header.engine;
+  const float* lowest = reinterpret_cast<const float*>(base + header.min_offset);
+  const float* highest =
+      reinterpret_cast<const float*>(base + header.max_offset);
+  min_values_.assign(lowest, lowest + num_features);
+  max_values_.assign(highest, highest + num_features);
+  const char* binary = base + header.binary_offset;
+  binary_columns_.assign(binary, binary + num_features);
+  structure_ = base + header.structure_offset;
+  structure_bytes_ = header.structure_bytes;
+}
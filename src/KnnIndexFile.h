@@ -0,0 +1,82 @@
+/*
+ * File:   KnnIndexFile.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef KNNINDEXFILE_H
+#define	KNNINDEXFILE_H
+
+#include <string>
+#include <vector>
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"  // Metric
+
+/**
+ * A trained kNN model on disk: the normalized training set, its labels, the
+ * normalization of every attribute and the built search structure of the
+ * engine (tree, graph, ...; see KnnIndex::save()). A classifier process maps
+ * the file read-only and answers queries straight away, without parsing the
+ * data set or rebuilding the index; processes that map the same file share
+ * its pages.
+ *
+ * Layout (version 1), every section starting on a 64-byte boundary:
+ *   header     magic "KNNINDEX", version, byte order mark, sizes, metric,
+ *              engine name and the offset of every section
+ *   rows       num_rows * stride floats, exactly as FeatureMatrix lays them
+ *              out, so they are used in place (see the view constructor)
+ *   labels     num_rows ints
+ *   minimum    num_features floats: attribute value mapped to 0
+ *   maximum    num_features floats: attribute value mapped to 1
+ *   binary     num_features bytes: 1 for 0/1 attributes (bit-packing)
+ *   structure  the engine's blob (IndexBlob.h); empty for brute
+ * Values are stored in the byte order of the machine that wrote the file;
+ * another byte order, version, a truncated file or a label outside
+ * 1..num_classes is rejected on open().
+ */
+class KnnIndexFile
+{
+ public:
+  KnnIndexFile();
+  ~KnnIndexFile();
+  static void write(const std::string& path, const FeatureMatrix& training_set,
+                    const int num_classes, const Metric metric,
+                    const std::string& engine,
+                    const std::vector<float>& min_values,
+                    const std::vector<float>& max_values,
+                    const std::vector<bool>& binary_columns,
+                    const std::vector<char>& structure);
+  void open(const std::string& path);
+
+  // The training rows in the mapped file.
+  const FeatureMatrix& training_set() const { return training_set_; }
+  int get_num_classes() const { return num_classes_; }
+  Metric get_metric() const { return metric_; }
+  const std::string& get_engine() const { return engine_; }
+  const std::vector<float>& min_values() const { return min_values_; }
+  const std::vector<float>& max_values() const { return max_values_; }
+  const std::vector<bool>& binary_columns() const { return binary_columns_; }
+  const char* structure() const { return structure_; }
+  long structure_bytes() const { return structure_bytes_; }
+
+ private:
+  static const int kVersion = 1;
+  void close();
+  void* map_;
+  long map_bytes_;
+  FeatureMatrix training_set_;
+  int num_classes_;
+  Metric metric_;
+  std::string engine_;
+  std::vector<float> min_values_;
+  std::vector<float> max_values_;
+  std::vector<bool> binary_columns_;
+  const char* structure_;
+  long structure_bytes_;
+
+  KnnIndexFile(const KnnIndexFile&);
+  void operator=(const KnnIndexFile&);
+};
+
+#endif	/* KNNINDEXFILE_H */
@@ -0,0 +1,164 @@
+/*
+ * File:   LaesaIndex.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "LaesaIndex.h"
+#include "NeighbourList.h"
+#include "IndexBlob.h"
+#include <algorithm>  // min
+#include <cmath>  // fabs
+#include <cstdlib>  // abort
+#include <iostream>
+
+namespace {
+
+// Relative slack on every pivot bound. It absorbs rounding in the stored
+// float distances (and square roots), so pruning never changes the exact
+// answer.
+const double kPruneSlack = 1e-6;
+
+}  // namespace
+
+LaesaIndex::LaesaIndex(const int num_pivots, const Metric metric)
+    : num_pivots_(num_pivots < 1 ? 1 : num_pivots), num_features_(0),
+      metric_(metric), distance_(metricKernel(distanceKernels(), metric)),
+      training_set_(NULL)
+{
+  if (metric == kCosine)
+  {
+    std::cerr << "(!) The laesa engine needs a true metric; cosine distance "
+              << "breaks the triangle inequality\n";
+    abort();
+  }
+}
+
+/**
+ * Picks the pivots and computes the distance of every row to each of them.
+ *
+ * @param training_set The labeled examples to index.
+ */
+void LaesaIndex::build(const FeatureMatrix& training_set)
+{
+  training_set_ = &training_set;
+  num_features_ = training_set.get_num_features();
+  const int size = training_set.get_num_rows();
+  const int num_pivots = std::min(num_pivots_, size);
+  pivots_.clear();
+  is_pivot_.assign(size, false);
+  pivot_distances_.assign(static_cast<size_t>(size) * num_pivots, 0.0f);
+
+  // The first pivot is row 0; each next one has the largest sum of
+  // distances to those already chosen (ties go to the lower row).
+  std::vector<double> sums(size, 0.0);
+  int next = 0;
+  for (int p = 0; p < num_pivots; ++p)
+  {
+    pivots_.push_back(next);
+    is_pivot_[next] = true;
+    const float* pivot = training_set.row(next);
+    int furthest = -1;
+    for (int i = 0; i < size; ++i)
+    {
+      const double d = metricDistance(
+          distance_(training_set.row(i), pivot, num_features_));
+      pivot_distances_[static_cast<size_t>(i) * num_pivots + p] = d;
+      sums[i] += d;
+      if (!is_pivot_[i] && (furthest < 0 || sums[i] > sums[furthest]))
+        furthest = i;
+    }
+    next = furthest;
+  }
+}
+
+bool LaesaIndex::save(IndexBlobWriter& out) const
+{
+  out.value(num_features_);
+  out.array(pivots_);
+  out.array(pivot_distances_);
+  return true;
+}
+
+/**
+ * Reads the pivots and their distance table written by save().
+ */
+bool LaesaIndex::restore(IndexBlobReader& in,
+                         const FeatureMatrix& training_set)
+{
+  training_set_ = &training_set;
+  num_features_ = in.value<int>();
+  in.array(pivots_);
+  in.array(pivot_distances_);
+  const int size = training_set.get_num_rows();
+  if (!in.ok() || num_features_ != training_set.get_num_features() ||
+      pivot_distances_.size() != static_cast<size_t>(size) * pivots_.size())
+    return false;
+  is_pivot_.assign(size, false);
+  for (size_t p = 0; p < pivots_.size(); ++p)
+  {
+    if (pivots_[p] < 0 || pivots_[p] >= size || is_pivot_[pivots_[p]])
+      return false;
+    is_pivot_[pivots_[p]] = true;
+  }
+  return true;
+}
+
+/**
+ * Finds the k nearest training rows to the query: the pivots first, then
+ * every other row that the pivot bounds do not rule out.
+ */
+void LaesaIndex::search(const float* query, NeighbourList& neighbours,
+                        SearchStats& stats) const
+{
+  ++stats.queries;
+  const FeatureMatrix& training_set = *training_set_;
+  const int num_pivots = pivots_.size();
+  std::vector<double> query_distances(num_pivots);
+  for (int p = 0; p < num_pivots; ++p)
+  {
+    const int row = pivots_[p];
+    const double ranking_distance = distance_(query, training_set.row(row),
+                                              num_features_);
+    neighbours.push(ranking_distance, row, training_set.label(row));
+    query_distances[p] = metricDistance(ranking_distance);
+  }
+  stats.distance_evaluations += num_pivots;
+
+  const int size = training_set.get_num_rows();
+  double threshold = neighbours.threshold();
+  double radius = metricDistance(threshold);
+  for (int i = 0; i < size; ++i)
+  {
+    if (is_pivot_[i]) continue;
+    ++stats.nodes_visited;
+    const float* distances = &pivot_distances_[static_cast<size_t>(i) *
+                                               num_pivots];
+    bool pruned = false;
+    for (int p = 0; p < num_pivots && !pruned; ++p)
+    {
+      const double gap = std::fabs(query_distances[p] - distances[p]) -
+                         kPruneSlack * (query_distances[p] + distances[p]);
+      pruned = gap > radius;
+    }
+    if (pruned) continue;
+    neighbours.push(distance_(query, training_set.row(i), num_features_), i,
+                    training_set.label(i));
+    ++stats.distance_evaluations;
+    if (neighbours.threshold() != threshold)
+    {
+      threshold = neighbours.threshold();
+      radius = metricDistance(threshold);
+    }
+  }
+}
+
+/**
+ * Converts a ranking distance from the kernel into a true metric distance
+ * (the kernel gives squared distances for the Euclidean metric).
+ */
+double LaesaIndex::metricDistance(const double ranking_distance) const
+{
+  return ::metricDistance(metric_, ranking_distance);
+}
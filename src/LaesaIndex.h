@@ -0,0 +1,57 @@
+/*
+ * File:   LaesaIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef LAESAINDEX_H
+#define	LAESAINDEX_H
+
+#include <vector>
+#include "KnnIndex.h"
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"
+
+/**
+ * Exact k-nearest neighbour search with pivots (LAESA). A few training rows
+ * are chosen as pivots and the distance of every row to every pivot is
+ * computed once. A query is compared with the pivots only, and by the
+ * triangle inequality
+ *   d(q, x) >= max over pivots p of |d(q, p) - d(x, p)|,
+ * so a row whose bound exceeds the distance to the current k-th neighbour
+ * is skipped without computing its distance. Like VpTreeIndex this only
+ * needs a true metric, and with no tree to balance it also holds up on
+ * mid-dimensional data where the KD-tree stops pruning.
+ *
+ * Pivots are picked greedily, each the row with the largest sum of distances
+ * to the pivots so far. The pivot distances are one contiguous float table,
+ * num_pivots per row.
+ */
+class LaesaIndex : public KnnIndex
+{
+ public:
+  LaesaIndex(const int num_pivots, const Metric metric);
+  const char* name() const { return "laesa"; }
+  void build(const FeatureMatrix& training_set);
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  bool save(IndexBlobWriter& out) const;
+  bool restore(IndexBlobReader& in, const FeatureMatrix& training_set);
+  long memory_bytes() const { return 0; }  // The rows are used as they are.
+  int get_num_pivots() const { return pivots_.size(); }
+
+ private:
+  double metricDistance(const double ranking_distance) const;
+  int num_pivots_;  // Requested; fewer if the training set is smaller.
+  int num_features_;
+  Metric metric_;
+  DistanceFunction distance_;  // Ranking distance (squared for Euclidean).
+  const FeatureMatrix* training_set_;
+  std::vector<int> pivots_;  // Training row of each pivot.
+  std::vector<bool> is_pivot_;  // Per training row.
+  // Metric distance from row i to pivot p at i * get_num_pivots() + p.
+  std::vector<float> pivot_distances_;
+};
+
+#endif	/* LAESAINDEX_H */
@@ -1,34 +1,78 @@
-/* 
+/*
  * File:   Layer.cpp
  * Author: Dennis Ideler <di07ty at brocku.ca>
- * 
+ *
  * Created on April 2011
  */
 
 #include "Layer.h"
-#include "Neurode.h"
+#include <cmath>  // For exp(), tanh() and cosh().
+#include <cstdlib>  // For rand(), posix_memalign() and free().
+#include <cstring>  // For strcmp(), memcpy() and memset().
+#include <new>  // bad_alloc
+
+namespace {
+
+const size_t kByteAlignment = Layer::kRowAlignment * sizeof(double);
+
+// Allocates count doubles, 64-byte aligned and set to 0.0.
+double* allocate(const size_t count)
+{
+  void* data = NULL;
+  const size_t bytes = sizeof(double) * count;
+  if (posix_memalign(&data, kByteAlignment, bytes > 0 ? bytes : 1) != 0)
+    throw std::bad_alloc();
+  memset(data, 0, bytes);
+  return static_cast<double*>(data);
+}
 
-Layer::Layer(const int num_neurodes) : size_(num_neurodes) // Constructor initializer list
+double* copy(const double* orig, const size_t count)
 {
-  nodes_ = new Neurode[size_];
+  double* data = allocate(count);
+  if (count > 0) memcpy(data, orig, sizeof(double) * count);
+  return data;
+}
+
+}  // namespace
+
+Layer::Layer(const int num_neurodes)
+    : size_(num_neurodes), num_connections_(0), stride_(0),
+      weights_(NULL), delta_weights_(NULL)
+{
+  outputs_ = allocate(size_);
+  errors_ = allocate(size_);
+  hidden_sums_ = allocate(size_);
 }
 
 Layer::Layer(const Layer& orig)
+    : size_(orig.size_), num_connections_(orig.num_connections_),
+      stride_(orig.stride_)
 {
-  size_ = orig.size_;
-  nodes_ = new Neurode[size_];
-  for (int i = 0; i < size_; ++i)
-    nodes_[i] = orig.nodes_[i];
+  outputs_ = copy(orig.outputs_, size_);
+  errors_ = copy(orig.errors_, size_);
+  hidden_sums_ = allocate(size_);
+  const size_t num_weights = static_cast<size_t>(size_) * stride_;
+  weights_ = orig.weights_ != NULL ? copy(orig.weights_, num_weights) : NULL;
+  delta_weights_ = orig.delta_weights_ != NULL ?
+                   copy(orig.delta_weights_, num_weights) : NULL;
 }
 
-Layer::~Layer() { delete[] nodes_; }
+Layer::~Layer()
+{
+  free(outputs_);
+  free(errors_);
+  free(hidden_sums_);
+  free(weights_);
+  free(delta_weights_);
+}
 
 /**
  * Creates a weight layer by initializing all weighted connections to all nodes
  * in the current layer (within a certain weight range).
  * Example use: calling this function on the first hidden layer will create the
  * weighted connections coming to that layer from the input layer.
- * 
+ * The weights are drawn node by node, each node's connections in order.
+ *
  * @param num_connections   The number of incoming connections to each node
  * @param kLowerRange       The lower weight range
  * @param kUpperRange       The upper weight range
@@ -36,47 +80,103 @@ Layer::~Layer() { delete[] nodes_; }
 void Layer::initWeightLayer(const int num_connections, const double kLowerRange,
                             const double kUpperRange)
 {
-  for (int i = 0; i < size_; ++i)
-    nodes_[i].initConnections(num_connections, kLowerRange, kUpperRange);
+  num_connections_ = num_connections;
+  stride_ = ((num_connections + kRowAlignment - 1) / kRowAlignment) *
+            kRowAlignment;
+  free(weights_);
+  free(delta_weights_);
+  weights_ = allocate(static_cast<size_t>(size_) * stride_);
+  delta_weights_ = allocate(static_cast<size_t>(size_) * stride_);
+
+  const double kRange = kUpperRange - kLowerRange;
+  for (int n = 0; n < size_; ++n)
+  {
+    double* weights = &weights_[n * stride_];
+    for (int i = 0; i < num_connections; ++i)
+      weights[i] = kLowerRange + static_cast<double> (kRange * rand() /
+                   (RAND_MAX + 1.0));
+  }
 }
 
 /**
  * Layer activation is part of the forward propagation phase. Only hidden and
  * output layers should be activated. Every node in the layer is activated by
- * calling its respective activation function. The inputs are the outputs from
- * the previous layer.
+ * summing its weighted inputs (the outputs of the previous layer) and
+ * applying the activation function to that sum.
+ * For example: weighted sum = (x_1 * w_1) + ... + (x_n * w_n)
  *
  * @param previous_layer       The preceding layer in the network's architecture
  * @param activation function  The activation function to use on the nodes
+ *                             (logistic or tanh; anything else is linear)
  */
 void Layer::activateLayer(const Layer& previous_layer,
                           const char* activation_function)
 {
-  for (int i = 0; i < size_; ++i)
-    nodes_[i].activate(previous_layer, activation_function);
+  const bool logistic = strcmp(activation_function, "logistic") == 0;
+  const bool hyperbolic = !logistic && strcmp(activation_function, "tanh") == 0;
+  const double* inputs = previous_layer.outputs_;
+  for (int n = 0; n < size_; ++n)
+  {
+    const double* weights = &weights_[n * stride_];
+    double sum = 0.0;
+    for (int i = 0; i < num_connections_; ++i)
+      sum += inputs[i] * weights[i];
+
+    if (logistic)
+      outputs_[n] = logisticFunction(sum);
+    else if (hyperbolic)
+      outputs_[n] = tanh(sum);
+    else
+      outputs_[n] = sum;
+  }
+}
+
+/**
+ * The logistic activation function (aka sigmoid function): f(x) = 1 / 1 + e^-x
+ * http://en.wikipedia.org/wiki/Logistic_function
+ *
+ * @param x The output of the combination function (summed weights & inputs)
+ * @return  The output of the logistic activation function
+ */
+double Layer::logisticFunction(const double x)
+{
+  // To avoid floating-point overflow, we add a safety measure.
+  // ftp://ftp.sas.com/pub/neural/FAQ2.html#A_overflow
+  if (x < -45) return 0;
+  else if (x > 45) return 1;
+  else return (1 / (1 + exp(-x)));
 }
 
 /**
  * Computes the output errors of all output nodes. Only to be used on the output
  * layer. Assuming there is an output node for each possible classification, we
  * only want the matching node to have value 1, all others will have value 0.
- * 
+ * The error uses the derivative of the logistic function:
+ * error = output (1 - output) (desired - output)
+ *
  * @param target  The desired output for the current input pattern
  */
 void Layer::computeOutputErrors(const int target)
 {
-  for (int i = 0; i < size_; ++i)
+  for (int n = 0; n < size_; ++n)
   {
-    if (target == i+1) nodes_[i].computeOutputError(1);
-    else nodes_[i].computeOutputError(0);
+    const int desired = target == n + 1 ? 1 : 0;
+    errors_[n] = outputs_[n] * (1 - outputs_[n]) * (desired - outputs_[n]);
   }
 }
 
 /**
  * Computes the error for all hidden nodes in the hidden layer.
- * This is a step in the backprop phase.
+ * This is a step in the backprop phase. Each hidden node's error is a
+ * proportionally weighted sum of the errors produced at the output layer.
  * NOTE: Only call this function from the hidden layer!
  *
+ * Formula: error_i = output_i (1 - output_i) sum(w_ij * output_error_j)
+ * error_i is error of current hidden node; output_i is output of current hidden
+ * node; w_ij is weight between output node j and hidden node i; etc...
+ * The sums of all hidden nodes are built one output node (weight row) at a
+ * time, which adds the terms of each sum in order of j.
+ *
  * @param output_layer                The output layer
  * @param hidden_activation_funcion   The activation function for hidden nodes
  */
@@ -84,11 +184,51 @@ void Layer::computeHiddenErrors(const Layer& output_layer,
                                 const char* hidden_activation_function)
 {
   for (int i = 0; i < size_; ++i)
-    nodes_[i].computeHiddenError(output_layer, i, hidden_activation_function);
+    hidden_sums_[i] = 0.0;
+  for (int j = 0; j < output_layer.size_; ++j)
+  {
+    const double* weights = &output_layer.weights_[j * output_layer.stride_];
+    const double error = output_layer.errors_[j];
+    for (int i = 0; i < size_; ++i)
+      hidden_sums_[i] += weights[i] * error;
+  }
+
+  // http://www.codeproject.com/KB/cs/BackPropagationNeuralNet.aspx
+  // That tutorial simply uses 'error = sum'. Results seem to be the same.
+  if (strcmp(hidden_activation_function, "logistic") == 0)
+  {
+    for (int i = 0; i < size_; ++i)
+      errors_[i] = outputs_[i] * (1 - outputs_[i]) * hidden_sums_[i];
+  }
+  else if (strcmp(hidden_activation_function, "tanh") == 0)
+  {
+    for (int i = 0; i < size_; ++i)
+    {
+      const double output = outputs_[i];
+      errors_[i] = ((2 * cosh(output)) / (cosh(2 * output) + 1)) *
+                   ((2 * cosh(output)) / (cosh(2 * output) + 1)) *
+                   hidden_sums_[i];
+    }
+  }
+
+  // TODO: should be using the derivative during backprop?
+  //       logisticDerivative(x) = e^x / (e^x + 1)^2
+  //       tanhDerivative(x) = sech^2(x) = (2 cosh(x)) / (cosh(2 x)+1)^2
+  //       according to wolfram          = (4 cosh^2(x)) / (1+cosh(2 x))^2
 }
 
 /**
  * Adjusts all the weights between the current layer and previous layer.
+ * Note that delta weight is the same thing as weight-change.
+ *
+ * weight_ij = weight_ij + delta weight_ij + (momentum * prev delta weight_ij)
+ * Where delta weight_ij = learning rate * output_i * error_j
+ *
+ * Momentum simply adds a fraction m of the previous weight update to the
+ * current one. The momentum term helps the network get out of local minima.
+ * When the gradient keeps changing direction, momentum will smooth out the
+ * variations. Useful when the network is not well-conditioned.
+ * Also see: http://www.shiffman.net/teaching/nature/nn/
  *
  * @param learning_rate   The learning rate constant
  * @param momentum        The momentum constant
@@ -97,17 +237,29 @@ void Layer::computeHiddenErrors(const Layer& output_layer,
 void Layer::adjustAllWeights(const double learning_rate, const double momentum,
                              const Layer& previous_layer)
 {
-  for (int i = 0; i < size_; ++i)
-    nodes_[i].adjustWeights(learning_rate, momentum, previous_layer);
+  const double* inputs = previous_layer.outputs_;
+  for (int n = 0; n < size_; ++n)
+  {
+    double* weights = &weights_[n * stride_];
+    double* delta_weights = &delta_weights_[n * stride_];
+    const double error = errors_[n];
+    for (int i = 0; i < num_connections_; ++i)
+    {
+      const double delta_weight = learning_rate * inputs[i] * error;
+      weights[i] += delta_weight + (momentum * delta_weights[i]);
+      delta_weights[i] = delta_weight;  // Update previous delta weight.
+    }
+  }
 }
 
 /**
  * Resets all changes in weights for every node in the layer.
+ * Change in weight needs to be reset at every epoch.
  */
 void Layer::resetDeltaWeights()
 {
-  for (int i = 0; i < size_; ++i)
-    nodes_[i].resetDeltaWeights();
+  if (delta_weights_ != NULL)
+    memset(delta_weights_, 0, sizeof(double) * size_ * stride_);
 }
 
 /**
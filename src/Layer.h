@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   Layer.h
  * Author: Dennis Ideler <di07ty at brocku.ca>
  *
@@ -8,15 +8,21 @@
 #ifndef LAYER_H
 #define	LAYER_H
 
-class Neurode;
-
 // Layer class represents a single layer in the ANN. This can be the input,
-// hidden, or output layer. A layer consists of Neurodes.
-// The number of neurodes is determined by the user.
-
+// hidden, or output layer. The number of nodes is determined by the user.
+//
+// The layer is stored as arrays rather than as node objects: the output and
+// error of every node, and the incoming weights of the layer as one
+// row-major matrix (row n holds the weights from the previous layer into
+// node n, padded to get_stride() doubles so that every row is 64-byte
+// aligned). Forward and backward passes are then loops over contiguous
+// memory. Every sum is taken in the same order as node by node, so the
+// results do not depend on the layout.
 class Layer
 {
  public:
+  static const int kRowAlignment = 8;  // Doubles per 64 bytes.
+
   explicit Layer(const int num_neurodes);  // Only takes one arg, thus explicit
   Layer(const Layer& orig);
   virtual ~Layer();
@@ -31,12 +37,27 @@ class Layer
                         const Layer& previous_layer);
   void resetDeltaWeights();
   int get_size() const;  // Returns the size of the layer (number of nodes).
-  Neurode* nodes_;  // All the neurodes in the layer.
+  // Sets the output of a node; for input layer nodes.
+  void set_input(const int node, const double input) { outputs_[node] = input; }
+  double get_output(const int node) const { return outputs_[node]; }
+  double get_error(const int node) const { return errors_[node]; }
+  double get_weight(const int node, const int connection) const
+  {
+    return weights_[node * stride_ + connection];
+  }
+  int get_stride() const { return stride_; }  // Doubles between weight rows.
 
  private:
-  int size_;  // Number of nodes in the layer. -1 means size is not yet known.
-//  DISALLOW_COPY_AND_ASSIGN(Layer);  // Enable if copy constructor not needed
+  static double logisticFunction(const double x);
+  int size_;  // Number of nodes in the layer.
+  int num_connections_;  // Incoming connections per node; 0 until initialized.
+  int stride_;
+  double* outputs_;  // size_ output values.
+  double* errors_;  // size_ errors (hidden and output layers).
+  double* weights_;  // size_ * stride_ connection weights.
+  double* delta_weights_;  // The previous change of every weight.
+  double* hidden_sums_;  // Scratch: weighted output errors per connection.
+  void operator=(const Layer&);
 };
 
 #endif	/* LAYER_H */
-
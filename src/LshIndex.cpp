@@ -0,0 +1,310 @@
+/*
+ * File:   LshIndex.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "LshIndex.h"
+#include "FeatureMatrix.h"
+#include "NeighbourList.h"
+#include "IndexBlob.h"
+#include "Random.h"
+#include <algorithm>  // sort, unique, equal_range, min
+#include <cmath>
+#include <cstdlib>  // abort
+#include <iostream>
+#include <utility>  // pair
+using namespace std;
+
+namespace {
+
+const unsigned long long kHashSeed = 7;
+// Bucket width as a multiple of the typical nearest-neighbour distance.
+// Cauchy projections have heavier tails than Gaussian ones, so manhattan
+// needs wider buckets for near rows to collide as often.
+const double kGaussianWidthScale = 4.0;
+const double kCauchyWidthScale = 8.0;
+// Rows sampled to estimate the typical nearest-neighbour distance.
+const int kWidthSamples = 64;
+
+}  // namespace
+
+/**
+ * @param num_tables Number of hash tables (L).
+ * @param hash_bits Hash functions concatenated per table (K).
+ * @param width Bucket width of the p-stable hashes; 0 estimates it at build.
+ * @param probes Buckets visited per table (1 is plain LSH).
+ */
+LshIndex::LshIndex(const int num_tables, const int hash_bits,
+                   const double width, const int probes, const Metric metric)
+    : num_tables_(num_tables < 1 ? 1 : num_tables),
+      hash_bits_(hash_bits < 1 ? 1 : hash_bits), width_(width),
+      probes_(probes < 1 ? 1 : probes), metric_(metric),
+      distance_(metricKernel(distanceKernels(), metric)), points_(NULL),
+      num_features_(0)
+{
+  if (metric != kEuclidean && metric != kManhattan && metric != kHamming)
+  {
+    cerr << "(!) The lsh engine only supports the euclidean, manhattan and "
+         << "hamming metrics\n";
+    abort();
+  }
+}
+
+/**
+ * Draws the hash functions and files every training row in each table.
+ *
+ * @param training_set The labeled examples to index.
+ */
+void LshIndex::build(const FeatureMatrix& training_set)
+{
+  points_ = &training_set;
+  num_features_ = training_set.get_num_features();
+  const int size = training_set.get_num_rows();
+  const int functions = num_tables_ * hash_bits_;
+
+  Random generator(kHashSeed);
+  directions_.clear();
+  offsets_.clear();
+  sampled_.clear();
+  if (metric_ == kHamming)
+  {
+    for (int f = 0; f < functions; ++f)
+      sampled_.push_back(static_cast<int>(generator.uniform() * num_features_));
+  }
+  else
+  {
+    if (width_ <= 0.0) width_ = estimateWidth(training_set);
+    directions_.resize(static_cast<size_t>(functions) * num_features_);
+    for (size_t i = 0; i < directions_.size(); ++i)
+      directions_[i] = metric_ == kManhattan ? generator.cauchy()
+                                             : generator.gaussian();
+    for (int f = 0; f < functions; ++f)
+      offsets_.push_back(generator.uniform() * width_);
+  }
+
+  buckets_.resize(static_cast<size_t>(num_tables_) * size);
+  rows_.resize(buckets_.size());
+  vector<Projection> projections(hash_bits_);
+  vector<pair<unsigned long long, int> > entries(size);
+  for (int t = 0; t < num_tables_; ++t)
+  {
+    for (int i = 0; i < size; ++i)
+    {
+      project(training_set.row(i), t, &projections[0]);
+      entries[i].first = key(&projections[0], -1, 0);
+      entries[i].second = i;
+    }
+    sort(entries.begin(), entries.end());
+    for (int i = 0; i < size; ++i)
+    {
+      buckets_[t * size + i] = entries[i].first;
+      rows_[t * size + i] = entries[i].second;
+    }
+  }
+}
+
+/**
+ * Writes the hash functions and the tables. The probe count is a setting of
+ * the run and is not saved.
+ */
+bool LshIndex::save(IndexBlobWriter& out) const
+{
+  out.value(num_tables_);
+  out.value(hash_bits_);
+  out.value(width_);
+  out.value(num_features_);
+  out.array(directions_);
+  out.array(offsets_);
+  out.array(sampled_);
+  out.array(buckets_);
+  out.array(rows_);
+  return true;
+}
+
+bool LshIndex::restore(IndexBlobReader& in, const FeatureMatrix& training_set)
+{
+  points_ = &training_set;
+  num_tables_ = in.value<int>();
+  hash_bits_ = in.value<int>();
+  width_ = in.value<double>();
+  num_features_ = in.value<int>();
+  in.array(directions_);
+  in.array(offsets_);
+  in.array(sampled_);
+  in.array(buckets_);
+  in.array(rows_);
+  const size_t size = training_set.get_num_rows();
+  const size_t functions = static_cast<size_t>(num_tables_) * hash_bits_;
+  if (!in.ok() || num_tables_ < 1 || hash_bits_ < 1 ||
+      num_features_ != training_set.get_num_features() ||
+      buckets_.size() != num_tables_ * size || rows_.size() != buckets_.size())
+    return false;
+  if (metric_ == kHamming ? sampled_.size() != functions :
+      directions_.size() != functions * num_features_ ||
+      offsets_.size() != functions)
+    return false;
+  for (size_t i = 0; i < sampled_.size(); ++i)
+  {
+    if (sampled_[i] < 0 || sampled_[i] >= num_features_) return false;
+  }
+  for (size_t i = 0; i < rows_.size(); ++i)
+  {
+    if (rows_[i] < 0 || rows_[i] >= static_cast<int>(size)) return false;
+  }
+  return true;
+}
+
+/**
+ * Gathers the rows sharing a probed bucket with the query and offers them to
+ * the neighbours with their exact distance.
+ */
+void LshIndex::search(const float* query, NeighbourList& neighbours,
+                      SearchStats& stats) const
+{
+  ++stats.queries;
+  if (rows_.empty()) return;
+  vector<int> candidates;
+  vector<Projection> projections(hash_bits_);
+  vector<int> order(hash_bits_);
+  const int extra_probes = min(probes_ - 1, hash_bits_);
+  for (int t = 0; t < num_tables_; ++t)
+  {
+    project(query, t, &projections[0]);
+    collect(t, key(&projections[0], -1, 0), candidates);
+    if (extra_probes == 0) continue;
+
+    // Probe the buckets across the nearest boundaries first.
+    for (int f = 0; f < hash_bits_; ++f)
+      order[f] = f;
+    for (int p = 0; p < extra_probes; ++p)
+    {
+      int best = p;
+      for (int f = p + 1; f < hash_bits_; ++f)
+      {
+        if (projections[order[f]] < projections[order[best]]) best = f;
+      }
+      swap(order[p], order[best]);
+      collect(t, key(&projections[0], order[p], projections[order[p]].step),
+              candidates);
+    }
+  }
+  stats.nodes_visited += num_tables_ * (1 + extra_probes);
+  stats.candidates += candidates.size();
+
+  // A row can turn up in several tables; rank each once.
+  sort(candidates.begin(), candidates.end());
+  candidates.erase(unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+  for (size_t c = 0; c < candidates.size(); ++c)
+  {
+    const int row = candidates[c];
+    neighbours.push(distance_(query, points_->row(row), num_features_), row,
+                    points_->label(row));
+  }
+  stats.distance_evaluations += candidates.size();
+}
+
+/**
+ * The speed/recall knob is the number of buckets visited per table.
+ */
+bool LshIndex::set_search_effort(const int effort)
+{
+  probes_ = effort < 1 ? 1 : effort;
+  return true;
+}
+
+/**
+ * Bucket width for the p-stable hashes: a few times the mean distance from
+ * a sample of rows to their nearest neighbour, so near rows usually share a
+ * bucket while far rows rarely do.
+ */
+double LshIndex::estimateWidth(const FeatureMatrix& training_set) const
+{
+  const int size = training_set.get_num_rows();
+  const int samples = min(size, kWidthSamples);
+  double total = 0.0;
+  for (int s = 0; s < samples; ++s)
+  {
+    const int i = static_cast<int>(static_cast<long>(s) * size / samples);
+    double nearest = -1.0;
+    for (int j = 0; j < size; ++j)
+    {
+      if (j == i) continue;
+      double d = distance_(training_set.row(i), training_set.row(j),
+                           num_features_);
+      if (nearest < 0.0 || d < nearest) nearest = d;
+    }
+    if (nearest > 0.0)
+      total += metric_ == kEuclidean ? sqrt(nearest) : nearest;
+  }
+  const double scale = metric_ == kManhattan ? kCauchyWidthScale
+                                             : kGaussianWidthScale;
+  const double width = samples > 0 ? scale * total / samples : 0.0;
+  return width > 0.0 ? width : 1.0;
+}
+
+/**
+ * Evaluates the hash functions of one table on a row.
+ *
+ * @param projections Receives hash_bits_ entries.
+ */
+void LshIndex::project(const float* row, const int table,
+                       Projection* projections) const
+{
+  DistanceFunction dot = distanceKernels().dot;
+  for (int f = 0; f < hash_bits_; ++f)
+  {
+    const int function = table * hash_bits_ + f;
+    if (metric_ == kHamming)
+    {
+      // A binary attribute: bucket 0 or 1, with the boundary at 0.5.
+      const float value = row[sampled_[function]];
+      projections[f].value = value < 0.5f ? 0 : 1;
+      projections[f].step = value < 0.5f ? 1 : -1;
+      projections[f].margin = fabs(value - 0.5);
+      continue;
+    }
+    const double position =  // In bucket units.
+        (dot(row, &directions_[function * num_features_], num_features_) +
+         offsets_[function]) / width_;
+    const double bucket = floor(position);
+    const double fraction = position - bucket;
+    projections[f].value = static_cast<int>(bucket);
+    projections[f].step = fraction < 0.5 ? -1 : 1;
+    projections[f].margin = fraction < 0.5 ? fraction : 1.0 - fraction;
+  }
+}
+
+/**
+ * Combines the hash values of one table into a bucket key (FNV-1a).
+ * Distinct buckets may share a key; that only adds candidates.
+ *
+ * @param changed Hash function moved by step for a probe, or -1 for none.
+ */
+unsigned long long LshIndex::key(const Projection* projections,
+                                 const int changed, const int step) const
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  for (int f = 0; f < hash_bits_; ++f)
+  {
+    const int value = projections[f].value + (f == changed ? step : 0);
+    hash = (hash ^ static_cast<unsigned int>(value)) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * Appends the rows filed under a bucket of one table to the candidates.
+ */
+void LshIndex::collect(const int table, const unsigned long long bucket,
+                       vector<int>& candidates) const
+{
+  const int size = points_->get_num_rows();
+  const unsigned long long* first = &buckets_[0];
+  pair<const unsigned long long*, const unsigned long long*> range =
+      equal_range(first + table * size, first + (table + 1) * size, bucket);
+  candidates.insert(candidates.end(), rows_.begin() + (range.first - first),
+                    rows_.begin() + (range.second - first));
+}
@@ -0,0 +1,81 @@
+/*
+ * File:   LshIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef LSHINDEX_H
+#define	LSHINDEX_H
+
+#include <vector>
+#include "KnnIndex.h"
+#include "DistanceKernels.h"
+
+/**
+ * Approximate k-nearest neighbour search with multi-table locality
+ * sensitive hashing.
+ *
+ * Each of the L tables hashes a row to a bucket with K functions:
+ *   euclidean  p-stable projections floor((a.x + b) / w), a Gaussian
+ *   manhattan  the same with a Cauchy (1-stable) a
+ *   hamming    bit sampling: the value of a randomly chosen attribute
+ * Rows that share a bucket with the query in any table are candidates; the
+ * candidates are ranked by their exact distance, so the k returned are the
+ * true nearest among them. Multi-probe (Lv et al., 2007) also visits up to
+ * probes - 1 neighbouring buckets per table: those reached by moving one
+ * hash value one step, ordered by how close the query is to that boundary.
+ */
+class LshIndex : public KnnIndex
+{
+ public:
+  LshIndex(const int num_tables, const int hash_bits, const double width,
+           const int probes, const Metric metric);
+  const char* name() const { return "lsh"; }
+  void build(const FeatureMatrix& training_set);
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  bool exact() const { return false; }
+  bool set_search_effort(const int effort);
+  int get_search_effort() const { return probes_; }
+  bool save(IndexBlobWriter& out) const;
+  bool restore(IndexBlobReader& in, const FeatureMatrix& training_set);
+
+ private:
+  // Where one hash function puts the query and how near the next bucket is.
+  struct Projection
+  {
+    int value;
+    int step;  // -1 or +1: towards the nearest neighbouring bucket.
+    double margin;  // Distance (in buckets) to that neighbouring bucket.
+    bool operator<(const Projection& other) const
+    {
+      return margin < other.margin;
+    }
+  };
+  double estimateWidth(const FeatureMatrix& training_set) const;
+  void project(const float* row, const int table,
+               Projection* projections) const;
+  unsigned long long key(const Projection* projections, const int changed,
+                         const int step) const;
+  void collect(const int table, const unsigned long long bucket,
+               std::vector<int>& candidates) const;
+
+  int num_tables_;
+  int hash_bits_;
+  double width_;  // Bucket width of the p-stable hashes; 0 to estimate.
+  int probes_;  // Buckets visited per table.
+  Metric metric_;
+  DistanceFunction distance_;
+  const FeatureMatrix* points_;
+  int num_features_;
+  // Hash function f of table t is entry t * hash_bits_ + f.
+  std::vector<float> directions_;  // p-stable: num_features_ floats each.
+  std::vector<double> offsets_;  // p-stable: b, uniform in [0, w).
+  std::vector<int> sampled_;  // hamming: the attribute each function reads.
+  // Table t holds entries [t * rows, (t + 1) * rows), sorted by bucket.
+  std::vector<unsigned long long> buckets_;
+  std::vector<int> rows_;
+};
+
+#endif	/* LSHINDEX_H */
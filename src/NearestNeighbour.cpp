@@ -7,22 +7,427 @@
  */
 
 #include "NearestNeighbour.h"
-#include <cassert>
+#include "FeatureMatrix.h"
+#include "NeighbourList.h"
+#include "DistanceKernels.h"
+#include "KnnIndex.h"
+#include "BitPackedMatrix.h"
+#include "BatchedScan.h"
+#include "ShardedScan.h"
+#include "EngineCalibration.h"
+#include "CompressedMatrix.h"
+#include "KdTreeIndex.h"
+#include "VpTreeIndex.h"
+#include "LaesaIndex.h"
+#include "CascadeIndex.h"
+#include "HnswIndex.h"
+#include "IvfPqIndex.h"
+#include "LshIndex.h"
+#include "KMeans.h"
+#include "IndexBlob.h"
+#include "Stopwatch.h"
 #include <cmath>
+#include <cstdlib>  // abort
+#include <cstring>  // strcmp
 #include <vector>
-#include <algorithm>
-#include <map>
-#include <set>
+#include <algorithm>  // sort, unique, min
+#include <utility>  // pair
 #include <iostream> // TODO remove
 using namespace std;
 
-NearestNeighbour::NearestNeighbour(const int k, const int num_attributes)
-    : k_(k), num_attributes_(num_attributes) {}
+namespace {
+
+// Added to the distances of a weighted vote (see voteWeight()).
+const double kZeroDistanceSlack = 1e-9;
+// k-means run that groups the rows for the cluster-ordered anytime scan.
+const int kAnytimeIterations = 10;
+const unsigned long kAnytimeSeed = 1;
+
+}  // namespace
+
+NearestNeighbour::NearestNeighbour(const int k, const int num_attributes,
+                                   const int num_classes,
+                                   const KnnParameters& parameters)
+    : k_(k), num_attributes_(num_attributes), num_classes_(num_classes),
+      parameters_(parameters),
+      distance_(metricKernel(distanceKernels(), parameters.metric)),
+      bit_distance_(distanceKernels().bit_hamming), training_set_(NULL),
+      index_(NULL), packed_(NULL), batched_(NULL), sharded_(NULL),
+      compressed_(NULL),
+      bounded_distance_(NULL), ordered_(NULL),
+      rerank_(parameters.rerank), report_(true), owned_rows_(NULL),
+      delta_(num_attributes), num_removed_(0), base_removed_(0),
+      compacting_(false), compaction_started_(false)
+{
+  pthread_rwlock_init(&lock_, NULL);
+}
 
 NearestNeighbour::~NearestNeighbour()
 {
-  // check if any heap allocated memory is not null
-  // then delete it
+  joinCompaction();
+  delete index_;
+  delete packed_;
+  delete batched_;
+  delete sharded_;
+  delete compressed_;
+  delete ordered_;
+  delete owned_rows_;
+  pthread_rwlock_destroy(&lock_);
+}
+
+/**
+ * Prepares the search engine chosen in the parameters for the training set.
+ * Index engines are built once here and then answer every query.
+ *
+ * @param training_set The set of labeled examples to compare against.
+ *                     Must stay alive while the model is used.
+ */
+void NearestNeighbour::buildIndex(const FeatureMatrix& training_set)
+{
+  joinCompaction();
+  prepare(training_set, NULL);
+  delete owned_rows_;
+  owned_rows_ = NULL;
+}
+
+/**
+ * Like buildIndex(), but an index engine reads the structure saved by
+ * saveIndex() (for the same training set) instead of building it.
+ *
+ * @param structure The saved structure, e.g. from a KnnIndexFile.
+ * @param structure_bytes Its size.
+ */
+void NearestNeighbour::restoreIndex(const FeatureMatrix& training_set,
+                                    const char* structure,
+                                    const long structure_bytes)
+{
+  joinCompaction();
+  IndexBlobReader saved(structure, structure_bytes);
+  prepare(training_set, &saved);
+  delete owned_rows_;
+  owned_rows_ = NULL;
+}
+
+/**
+ * Writes the built index engine for restoreIndex(). The brute engine has no
+ * structure (its packed or compressed rows are quick to recreate).
+ *
+ * @return False if the engine cannot be saved.
+ */
+bool NearestNeighbour::saveIndex(vector<char>& structure) const
+{
+  structure.clear();
+  if (sharded_ != NULL) return false;  // The engines are in the workers.
+  if (index_ == NULL) return true;
+  IndexBlobWriter out(structure);
+  return index_->save(out);
+}
+
+void NearestNeighbour::findNeighbours(const FeatureMatrix& queries,
+                                      const int begin, const int end,
+                                      vector<NeighbourList>& lists,
+                                      SearchStats& stats) const
+{
+  pthread_rwlock_rdlock(&lock_);
+  if (batched_ != NULL && !updated())
+  {
+    batched_->search(queries, begin, end, lists, stats);
+  }
+  else
+  {
+    for (int i = begin; i < end; ++i)
+    {
+      NeighbourList& neighbours = lists[i - begin];
+      neighbours.reset();
+      if (updated())
+        searchUpdated(queries.row(i), neighbours, stats);
+      else
+        searchEngine(queries.row(i), neighbours, stats);
+    }
+  }
+  pthread_rwlock_unlock(&lock_);
+}
+
+/**
+ * Sets up the engine for buildIndex() and restoreIndex(); saved is NULL to
+ * build.
+ */
+void NearestNeighbour::prepare(const FeatureMatrix& training_set,
+                               IndexBlobReader* saved)
+{
+  training_set_ = &training_set;
+  const int size = training_set.get_num_rows();
+  delta_ = FeatureMatrix(num_attributes_);
+  row_ids_.resize(size);
+  for (int i = 0; i < size; ++i)
+    row_ids_[i] = i;
+  id_rows_ = row_ids_;
+  removed_.assign(size, false);
+  num_removed_ = 0;
+  base_removed_ = 0;
+  delete index_;
+  index_ = NULL;
+  delete packed_;
+  packed_ = NULL;
+  delete batched_;
+  batched_ = NULL;
+  delete sharded_;
+  sharded_ = NULL;
+  delete compressed_;
+  compressed_ = NULL;
+  delete ordered_;
+  ordered_ = NULL;
+  bounded_distance_ = NULL;
+  feature_order_.clear();
+  anytime_order_.clear();
+
+  if (parameters_.engine == "auto")
+  {
+    // The choice stays in parameters_, so compactions do not calibrate.
+    EngineCalibration calibration(k_, num_attributes_, num_classes_,
+                                  parameters_);
+    parameters_ = calibration.select(training_set);
+    if (report_) calibration.print();
+  }
+  if (parameters_.anytime_budget > 0 || parameters_.anytime_deadline > 0)
+  {
+    prepareAnytime(training_set);
+    return;
+  }
+  if (parameters_.num_shards > 1 && saved == NULL)
+  {
+    prepareShards(training_set);
+    return;
+  }
+  if (parameters_.engine == "brute")
+  {
+    CompressedMatrix::Precision precision;
+    if (CompressedMatrix::parsePrecision(parameters_.storage.c_str(),
+                                         &precision))
+    {
+      if (parameters_.batch_size > 0)
+      {
+        cerr << "(!) Batched kNN needs float storage\n";
+        abort();
+      }
+      compressed_ = new CompressedMatrix(precision, parameters_.metric);
+      compressed_->build(training_set);
+      if (report_)
+        cout << "Stored the training set as " << parameters_.storage << ": "
+             << compressed_->bytes_per_row()
+             << " bytes per training example (the rows take "
+             << sizeof(float) * training_set.get_stride() << ")\n";
+      return;
+    }
+    if (parameters_.batch_size > 0)
+    {
+      if (parameters_.metric != kEuclidean)
+      {
+        cerr << "(!) Batched kNN only supports the euclidean metric\n";
+        abort();
+      }
+      batched_ = new BatchedScan;
+      batched_->build(training_set);
+      return;
+    }
+    if (parameters_.early_abandon) prepareEarlyAbandon(training_set);
+    // The packed distance is a sum over the attributes, like these metrics.
+    if (parameters_.bit_pack && parameters_.metric != kChebyshev &&
+        parameters_.metric != kCosine &&
+        count(parameters_.binary_columns.begin(),
+              parameters_.binary_columns.end(), true) > 0)
+    {
+      // Only worth it if the packed rows are smaller (a few binary
+      // attributes among many continuous ones may not fill out a word).
+      packed_ = new BitPackedMatrix(parameters_.binary_columns);
+      if (packed_->bytes_per_row() >=
+          static_cast<long>(sizeof(float) * training_set.get_stride()))
+      {
+        delete packed_;
+        packed_ = NULL;
+      }
+      else
+      {
+        if (!feature_order_.empty()) packed_->orderContinuous(feature_order_);
+        packed_->build(training_set);
+        if (report_)
+          cout << "Bit-packed " << packed_->get_num_binary()
+               << " binary attributes: " << packed_->bytes_per_row()
+               << " bytes per training example (the rows take "
+               << sizeof(float) * training_set.get_stride() << ")\n";
+      }
+    }
+    if (packed_ == NULL && !feature_order_.empty())
+    {
+      ordered_ = new FeatureMatrix(num_attributes_);
+      ordered_->reserve(size);
+      vector<float> row(num_attributes_ + 1);
+      for (int i = 0; i < size; ++i)
+      {
+        orderFeatures(training_set.row(i), &row[0]);
+        ordered_->appendRow(&row[0], training_set.label(i));
+      }
+    }
+    return;
+  }
+  else if (parameters_.engine == "kdtree")
+    index_ = new KdTreeIndex(parameters_.leaf_size, parameters_.metric);
+  else if (parameters_.engine == "vptree")
+    index_ = new VpTreeIndex(parameters_.leaf_size, parameters_.metric);
+  else if (parameters_.engine == "laesa")
+    index_ = new LaesaIndex(parameters_.num_pivots, parameters_.metric);
+  else if (parameters_.engine == "hnsw")
+    index_ = new HnswIndex(parameters_.hnsw_m, parameters_.ef_construction,
+                           parameters_.ef_search, parameters_.metric,
+                           parameters_.num_threads);
+  else if (parameters_.engine == "ivfpq")
+    index_ = new IvfPqIndex(parameters_.nlist, parameters_.nprobe,
+                            parameters_.pq_subquantizers, parameters_.rerank,
+                            parameters_.metric);
+  else if (parameters_.engine == "lsh")
+    index_ = new LshIndex(parameters_.lsh_tables, parameters_.lsh_bits,
+                          parameters_.lsh_width, parameters_.lsh_probes,
+                          parameters_.metric);
+  else if (parameters_.engine == "cascade")
+    index_ = new CascadeIndex(parameters_.cascade_columns,
+                              parameters_.cascade_factor, parameters_.metric);
+  else
+  {
+    cerr << "(!) Unknown kNN engine: " << parameters_.engine << "\n";
+    abort();
+  }
+
+  Stopwatch stopwatch;
+  if (saved != NULL)
+  {
+    if (!index_->restore(*saved, training_set) || !saved->at_end())
+    {
+      cerr << "(!) The saved " << index_->name()
+           << " index does not match its training set\n";
+      abort();
+    }
+    if (report_)
+      cout << "Restored " << index_->name() << " index in "
+           << stopwatch.seconds() << " s\n";
+  }
+  else
+  {
+    index_->build(training_set);
+    if (report_)
+      cout << "Built " << index_->name() << " index in " << stopwatch.seconds()
+           << " s\n";
+  }
+  const long bytes = index_->memory_bytes();
+  if (report_ && bytes > 0 && training_set.get_num_rows() > 0)
+  {
+    cout << "Index holds " << static_cast<double>(bytes) /
+                              training_set.get_num_rows()
+         << " bytes per training example (the rows take "
+         << sizeof(float) * training_set.get_num_features() << ")\n";
+  }
+}
+
+/**
+ * Hands the training set to worker processes, one shard each (see
+ * ShardedScan). Only setups whose distances do not depend on the rest of
+ * the training set can be split, so that the merged neighbours are exactly
+ * those of one process: an exact engine, float storage and the attributes
+ * in their own order.
+ */
+void NearestNeighbour::prepareShards(const FeatureMatrix& training_set)
+{
+  const string& engine = parameters_.engine;
+  if (engine != "brute" && engine != "kdtree" && engine != "vptree" &&
+      engine != "laesa")
+  {
+    cerr << "(!) Sharded kNN needs an exact engine (brute, kdtree, vptree or "
+         << "laesa)\n";
+    abort();
+  }
+  if (parameters_.storage != "float" || parameters_.variance_order)
+  {
+    cerr << "(!) Sharded kNN needs float storage in attribute order\n";
+    abort();
+  }
+  Stopwatch stopwatch;
+  sharded_ = new ShardedScan(parameters_.num_shards, k_, num_attributes_,
+                             num_classes_, parameters_);
+  sharded_->build(training_set);
+  if (report_)
+    cout << "Started " << sharded_->get_num_shards() << " " << engine
+         << " workers of about "
+         << training_set.get_num_rows() / sharded_->get_num_shards()
+         << " training examples each in " << stopwatch.seconds() << " s\n";
+}
+
+/**
+ * Orders the rows for anytime queries so that every prefix of the order is
+ * a fair sample of the training set: the rows of each group (class, or
+ * k-means cluster) are spread evenly over the order. A query cut short by
+ * its budget has then seen about the same share of every group.
+ */
+void NearestNeighbour::prepareAnytime(const FeatureMatrix& training_set)
+{
+  if (parameters_.engine != "brute" || parameters_.storage != "float" ||
+      parameters_.batch_size > 0 || parameters_.num_shards > 1 ||
+      parameters_.early_abandon)
+  {
+    cerr << "(!) Anytime kNN queries need the brute engine with float "
+         << "storage (no --batch, --shards or --early-abandon)\n";
+    abort();
+  }
+  const int size = training_set.get_num_rows();
+  const bool by_cluster = parameters_.anytime_order == "cluster";
+  vector<int> groups(size);
+  int num_groups;
+  if (by_cluster)
+  {
+    num_groups = max(1, static_cast<int>(sqrt(static_cast<double>(size))));
+    vector<float> centroids;
+    if (size > 0)
+      kmeans(training_set.row(0), size, num_attributes_,
+             training_set.get_stride(), num_groups, kAnytimeIterations,
+             kAnytimeSeed, centroids, groups);
+  }
+  else
+  {
+    num_groups = num_classes_ + 1;
+    for (int i = 0; i < size; ++i)
+      groups[i] = training_set.label(i);
+  }
+
+  // The j-th of the n rows of a group goes (j + 1/2) / n of the way
+  // through the order; ties go to the lower row.
+  vector<int> group_sizes(num_groups, 0), placed(num_groups, 0);
+  for (int i = 0; i < size; ++i)
+    ++group_sizes[groups[i]];
+  vector<pair<double, int> > positions(size);
+  for (int i = 0; i < size; ++i)
+  {
+    const int g = groups[i];
+    positions[i] = make_pair((placed[g]++ + 0.5) / group_sizes[g], i);
+  }
+  sort(positions.begin(), positions.end());
+  anytime_order_.resize(size);
+  for (int i = 0; i < size; ++i)
+    anytime_order_[i] = positions[i].second;
+
+  if (report_)
+  {
+    cout << "Anytime queries scan the training set stratified by ";
+    if (by_cluster)
+      cout << num_groups << " k-means clusters";
+    else
+      cout << "class";
+    cout << ", within";
+    if (parameters_.anytime_budget > 0)
+      cout << " " << parameters_.anytime_budget << " distance evaluations";
+    if (parameters_.anytime_budget > 0 && parameters_.anytime_deadline > 0)
+      cout << " and";
+    if (parameters_.anytime_deadline > 0)
+      cout << " " << parameters_.anytime_deadline << " microseconds";
+    cout << " per query\n";
+  }
 }
 
 /**
@@ -35,27 +440,106 @@ NearestNeighbour::~NearestNeighbour()
  * @param verbose Boolean for outputting extra classification information.
  * @return The classification accuracy.
  */
-double NearestNeighbour::learn(const vector< vector<float> > training_set,
-                             const vector< vector<float> > testing_set,
-                             const bool verbose) const
+double NearestNeighbour::learn(const FeatureMatrix& training_set,
+                               const FeatureMatrix& testing_set,
+                               const bool verbose)
+{
+  buildIndex(training_set);
+  double accuracy = test(testing_set, verbose);
+  if (parameters_.recall_report && (index_ != NULL || compressed_ != NULL))
+    reportRecall(testing_set);
+  if (!anytime_order_.empty()) reportAnytime(testing_set);
+  return accuracy;
+}
+
+/**
+ * Classifies every example of the testing set with the current model.
+ *
+ * @param testing_set The set of "unlabeled" examples to test accuracy.
+ * @param verbose Boolean for outputting extra classification information.
+ * @return The classification accuracy.
+ */
+double NearestNeighbour::test(const FeatureMatrix& testing_set,
+                              const bool verbose) const
 {
   // For each unclassified example (ie instance in testing set),                     
-  int total_hits = 0;
-  int total_cases = testing_set.size();
-  for (int i = 0; i < total_cases; ++i)
-  {
-    int classification = computeNearestNeighbours(testing_set[i], training_set);
-    int target = testing_set[i][num_attributes_];
+  int total_cases = testing_set.get_num_rows();
+  vector<int> classifications(total_cases);
 
-    if (classification == target) ++total_hits;
+  // The queries are handed out in chunks to num_threads threads (the calling
+  // thread is one of them). Each thread counts its own hits and search
+  // statistics, which are added up when it runs out of work.
+  TestWork work;
+  work.knn = this;
+  work.testing_set = &testing_set;
+  work.classifications = &classifications;
+  work.chunk = batched_ != NULL ? parameters_.batch_size :
+               sharded_ == NULL ? kQueryChunk :
+               parameters_.batch_size > 0 ? parameters_.batch_size :
+               kShardChunk;
+  work.next = 0;
+  work.hits = 0;
+  pthread_mutex_init(&work.lock, NULL);
+  const int num_threads = max(1, min(parameters_.num_threads,
+                                     (total_cases + work.chunk - 1) /
+                                     work.chunk));
+  vector<pthread_t> threads(num_threads - 1);
+  for (size_t i = 0; i < threads.size(); ++i)
+    pthread_create(&threads[i], NULL, testThread, &work);
+  testThread(&work);
+  for (size_t i = 0; i < threads.size(); ++i)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&work.lock);
+  const int total_hits = work.hits;
+  const SearchStats& stats = work.stats;
 
-    if (verbose)
+  // Reported in query order, however the work was split.
+  if (verbose)
+  {
+    for (int i = 0; i < total_cases; ++i)
     {
-      cout << "Expected outcome: " << target
-           << "\nActual outcome: " << classification << "\n\n";
+      cout << "Expected outcome: " << testing_set.label(i)
+           << "\nActual outcome: " << classifications[i] << "\n\n";
     }
   }
   
+  const int scanned = packed_ != NULL ? packed_->get_num_continuous()
+                                      : num_attributes_;
+  // Inserted examples are searched too, and removed ones are not.
+  const double searched = static_cast<double>(stats.queries) *
+                          get_num_examples();
+  if (bounded_distance_ != NULL && stats.distance_evaluations > 0 &&
+      scanned > 0)
+  {
+    const double per_row = static_cast<double>(stats.features_examined) /
+                           stats.distance_evaluations;
+    cout << "Early abandoning: " << per_row << " of " << scanned
+         << (packed_ != NULL ? " continuous" : "")
+         << " attributes summed per training example ("
+         << 100.0 * per_row / scanned << "%)\n";
+  }
+  if (!anytime_order_.empty() && stats.queries > 0)
+  {
+    cout << "Anytime: " << stats.early_stops << " of " << stats.queries
+         << " queries stopped early ("
+         << 100.0 * stats.early_stops / stats.queries << "%), "
+         << stats.distance_evaluations / stats.queries
+         << " distance evaluations per query ("
+         << 100.0 * stats.distance_evaluations / searched
+         << "% of the training set)\n";
+  }
+  if (index_ != NULL && stats.queries > 0)
+  {
+    cout << "Per query: " << stats.distance_evaluations / stats.queries
+         << " distance evaluations ("
+         << 100.0 * stats.distance_evaluations / searched
+         << "% of the training set), "
+         << stats.nodes_visited / stats.queries << " nodes visited";
+    if (stats.candidates > 0)
+      cout << ", " << stats.candidates / stats.queries << " candidates";
+    cout << "\n";
+  }
+
   double accuracy = (static_cast<float>(total_hits) / total_cases) * 100;
   cout << "Correctly classified " << total_hits << " out of " << total_cases
        << " = " << accuracy << "%\n\n";
@@ -63,101 +547,940 @@ double NearestNeighbour::learn(const vector< vector<float> > training_set,
 }
 
 /**
- * Computes the distance to each classified example.
- * Sorts the distances and chooses the k nearest.
+ * Worker loop of test(): classifies chunks of queries until none are left.
+ */
+void* NearestNeighbour::testThread(void* test_work)
+{
+  TestWork& work = *static_cast<TestWork*>(test_work);
+  const NearestNeighbour& knn = *work.knn;
+  const FeatureMatrix& testing_set = *work.testing_set;
+  const int total_cases = testing_set.get_num_rows();
+
+  // Scratch space shared by the queries of this thread.
+  NeighbourList neighbours(knn.k_);
+  vector<double> votes(knn.num_classes_ + 1);
+  // In batched mode the neighbours of a whole chunk of queries are found
+  // together; the votes are then taken one query at a time as usual.
+  const bool blocks = knn.batched_ != NULL || knn.sharded_ != NULL;
+  vector<NeighbourList> lists(blocks ? work.chunk : 0, NeighbourList(knn.k_));
+  SearchStats stats;
+  int hits = 0;
+  for (;;)
+  {
+    pthread_mutex_lock(&work.lock);
+    const int begin = work.next;
+    work.next += work.chunk;
+    pthread_mutex_unlock(&work.lock);
+    if (begin >= total_cases) break;
+
+    const int end = min(begin + work.chunk, total_cases);
+    pthread_rwlock_rdlock(&knn.lock_);
+    // Pending updates are not in the batched scan's panels (or the shards).
+    const bool batched = blocks && !knn.updated();
+    if (batched && knn.batched_ != NULL)
+      knn.batched_->search(testing_set, begin, end, lists, stats);
+    else if (batched)
+      knn.sharded_->search(testing_set, begin, end, lists, stats);
+    for (int i = begin; i < end; ++i)
+    {
+      int classification = batched ?
+          knn.vote(lists[i - begin], votes) :
+          knn.computeNearestNeighbours(testing_set.row(i), neighbours, votes,
+                                       stats);
+      (*work.classifications)[i] = classification;
+      if (classification == testing_set.label(i)) ++hits;
+    }
+    pthread_rwlock_unlock(&knn.lock_);
+  }
+
+  pthread_mutex_lock(&work.lock);
+  work.hits += hits;
+  work.stats.add(stats);
+  pthread_mutex_unlock(&work.lock);
+  return NULL;
+}
+
+/**
+ * Finds the k nearest classified examples, either through the index or by
+ * computing the distance to each of them while keeping only the k nearest
+ * (O(N log k), no allocations unless updates are pending).
  * Returns the majority vote of the k nearest neighbours.
  *
  * @param query The unclassified example.
- * @param training_set The dataset to compare against.
+ * @param neighbours Scratch list that receives the k nearest neighbours.
+ * @param votes Scratch tally with room for num_classes_ + 1 entries.
+ * @param stats Search counters to update.
  * @return The predicted classification of the query.
  */
 int NearestNeighbour::computeNearestNeighbours(
-    const vector<float> query,
-    const vector< vector<float> > training_set) const
+    const float* query,
+    NeighbourList& neighbours,
+    vector<double>& votes,
+    SearchStats& stats) const
+{
+  neighbours.reset();
+  if (!anytime_order_.empty())
+    scanAnytime(query, neighbours, stats);
+  else if (updated())
+    searchUpdated(query, neighbours, stats);
+  else
+    searchEngine(query, neighbours, stats);
+  return vote(neighbours, votes);
+}
+
+/**
+ * Searches the rows the engine was built on (tombstones included).
+ *
+ * @param neighbours Receives the nearest rows (already reset).
+ */
+void NearestNeighbour::searchEngine(const float* query,
+                                    NeighbourList& neighbours,
+                                    SearchStats& stats) const
+{
+  if (index_ != NULL)
+    index_->search(query, neighbours, stats);
+  else if (sharded_ != NULL)
+    sharded_->search(query, neighbours, stats);
+  else if (compressed_ != NULL)
+    scanCompressed(query, neighbours, stats);
+  else
+    scan(query, neighbours, stats);
+}
+
+/**
+ * Search with pending updates. The engine is asked for k neighbours more
+ * than it has tombstones, so its k nearest live rows are among them, and
+ * the inserted rows are scanned. Exact engines stay exact.
+ *
+ * @param neighbours Receives the nearest live rows (already reset).
+ */
+void NearestNeighbour::searchUpdated(const float* query,
+                                     NeighbourList& neighbours,
+                                     SearchStats& stats) const
+{
+  const int indexed = training_set_->get_num_rows();
+  NeighbourList found(neighbours.capacity() + base_removed_);
+  searchEngine(query, found, stats);
+  for (int i = 0; i < found.size(); ++i)
+  {
+    if (!removed_[found[i].index])
+      neighbours.push(found[i].distance, found[i].index,
+                      found[i].classification);
+  }
+  const int inserted = delta_.get_num_rows();
+  for (int j = 0; j < inserted; ++j)
+  {
+    if (!removed_[indexed + j])
+      neighbours.push(distance_(query, delta_.row(j), num_attributes_),
+                      indexed + j, delta_.label(j));
+  }
+  stats.distance_evaluations += inserted;
+}
+
+/**
+ * Classifies one example with the current model; safe to call while other
+ * threads query or update it.
+ *
+ * @param query The unclassified example.
+ * @param exact If not NULL, receives whether the vote was taken by the true
+ *              k nearest neighbours.
+ * @return The predicted classification.
+ */
+int NearestNeighbour::classify(const float* query, bool* exact) const
 {
-  int size = training_set.size();
-  vector<neighbour> neighbours;
+  NeighbourList neighbours(k_);
+  vector<double> votes(num_classes_ + 1);
+  SearchStats stats;
+  pthread_rwlock_rdlock(&lock_);
+  const int classification = computeNearestNeighbours(query, neighbours, votes,
+                                                      stats);
+  if (exact != NULL)
+    *exact = stats.early_stops == 0 && compressed_ == NULL &&
+             (index_ == NULL || index_->exact());
+  pthread_rwlock_unlock(&lock_);
+  return classification;
+}
+
+/**
+ * Adds a labeled example to the model. It is scanned linearly until the
+ * next compaction puts it in the engine.
+ *
+ * @param example The num_attributes_ attribute values (copied).
+ * @param label Its classification.
+ * @return The id of the example, for remove().
+ */
+int NearestNeighbour::insert(const float* example, const int label)
+{
+  pthread_rwlock_wrlock(&lock_);
+  const int id = id_rows_.size();
+  id_rows_.push_back(row_ids_.size());
+  row_ids_.push_back(id);
+  removed_.push_back(false);
+  delta_.appendRow(example, label);
+  scheduleCompaction();
+  pthread_rwlock_unlock(&lock_);
+  return id;
+}
+
+/**
+ * Takes an example out of the model. It stays in the engine, marked as
+ * removed, until the next compaction.
+ *
+ * @param id The id of the example (see insert()).
+ * @return False if there is no such example (any more).
+ */
+bool NearestNeighbour::remove(const int id)
+{
+  pthread_rwlock_wrlock(&lock_);
+  const bool found = id >= 0 && id < static_cast<int>(id_rows_.size()) &&
+                     id_rows_[id] >= 0;
+  if (found)
+  {
+    const int row = id_rows_[id];
+    id_rows_[id] = -1;
+    removed_[row] = true;
+    ++num_removed_;
+    if (row < training_set_->get_num_rows()) ++base_removed_;
+    scheduleCompaction();
+  }
+  pthread_rwlock_unlock(&lock_);
+  return found;
+}
+
+int NearestNeighbour::get_num_examples() const
+{
+  pthread_rwlock_rdlock(&lock_);
+  const int examples = training_set_->get_num_rows() +
+                       delta_.get_num_rows() - num_removed_;
+  pthread_rwlock_unlock(&lock_);
+  return examples;
+}
+
+/**
+ * Rebuilds the engine over the live examples now, after waiting for any
+ * background compaction. Not to be called while other threads update the
+ * model (queries are fine).
+ */
+void NearestNeighbour::compact()
+{
+  joinCompaction();
+  if (!updated()) return;
+  compacting_ = true;
+  rebuild();
+}
+
+/**
+ * Starts a background compaction if enough updates are pending and none is
+ * running. Called with the write lock held.
+ */
+void NearestNeighbour::scheduleCompaction()
+{
+  int limit = (training_set_->get_num_rows() - base_removed_) / kPendingShare;
+  if (limit < kMinPendingRows) limit = kMinPendingRows;
+  if (compacting_ || delta_.get_num_rows() + num_removed_ <= limit) return;
+  // The last compaction has swapped its engine in; it only has cleaning up
+  // left (without the lock), so this join is short.
+  if (compaction_started_) pthread_join(compaction_, NULL);
+  compacting_ = true;
+  compaction_started_ = true;
+  pthread_create(&compaction_, NULL, compactionThread, this);
+}
+
+void* NearestNeighbour::compactionThread(void* knn)
+{
+  static_cast<NearestNeighbour*>(knn)->rebuild();
+  return NULL;
+}
+
+void NearestNeighbour::joinCompaction()
+{
+  if (!compaction_started_) return;
+  pthread_join(compaction_, NULL);
+  compaction_started_ = false;
+}
+
+/**
+ * The compaction: copies the live rows, builds a new engine over them and
+ * swaps it in. Queries go on throughout; updates only wait while the rows
+ * are copied. Updates made while the engine was built are carried over.
+ */
+void NearestNeighbour::rebuild()
+{
+  pthread_rwlock_rdlock(&lock_);
+  const int indexed = training_set_->get_num_rows();
+  const int copied = indexed + delta_.get_num_rows();
+  FeatureMatrix* rows = new FeatureMatrix(num_attributes_);
+  rows->reserve(copied - num_removed_);
+  vector<int> row_ids;
+  for (int r = 0; r < copied; ++r)
+  {
+    if (removed_[r]) continue;
+    if (r < indexed)
+      rows->appendRow(*training_set_, r);
+    else
+      rows->appendRow(delta_, r - indexed);
+    row_ids.push_back(row_ids_[r]);
+  }
+  pthread_rwlock_unlock(&lock_);
+
+  NearestNeighbour* fresh = new NearestNeighbour(k_, num_attributes_,
+                                                 num_classes_, parameters_);
+  fresh->report_ = false;
+  fresh->buildIndex(*rows);
+
+  pthread_rwlock_wrlock(&lock_);
+  // Examples inserted since the copy stay in the delta.
+  FeatureMatrix delta(num_attributes_);
+  for (int r = copied; r < static_cast<int>(row_ids_.size()); ++r)
+  {
+    if (removed_[r]) continue;
+    delta.appendRow(delta_, r - indexed);
+    row_ids.push_back(row_ids_[r]);
+  }
+  delta_.swap(delta);
+  row_ids_.swap(row_ids);
+  // Examples removed since the copy become tombstones of the new engine.
+  removed_.assign(row_ids_.size(), false);
+  num_removed_ = 0;
+  base_removed_ = 0;
+  for (int r = 0; r < static_cast<int>(row_ids_.size()); ++r)
+  {
+    int& row = id_rows_[row_ids_[r]];
+    if (row >= 0)
+    {
+      row = r;
+      continue;
+    }
+    removed_[r] = true;
+    ++num_removed_;
+    ++base_removed_;
+  }
+  // The old engine and rows go with fresh.
+  swap(index_, fresh->index_);
+  swap(packed_, fresh->packed_);
+  swap(batched_, fresh->batched_);
+  swap(sharded_, fresh->sharded_);
+  swap(compressed_, fresh->compressed_);
+  swap(ordered_, fresh->ordered_);
+  feature_order_.swap(fresh->feature_order_);
+  anytime_order_.swap(fresh->anytime_order_);
+  bounded_distance_ = fresh->bounded_distance_;
+  fresh->owned_rows_ = owned_rows_;
+  owned_rows_ = rows;
+  training_set_ = rows;
+  compacting_ = false;
+  pthread_rwlock_unlock(&lock_);
+  delete fresh;
+}
+
+/**
+ * The brute-force search: computes the distance to every classified example.
+ *
+ * @param query The unclassified example.
+ * @param neighbours Receives the k nearest neighbours (already reset).
+ * @param stats Search counters to update.
+ */
+void NearestNeighbour::scan(const float* query, NeighbourList& neighbours,
+                            SearchStats& stats) const
+{
+  if (packed_ != NULL)
+  {
+    scanPacked(query, neighbours, stats);
+    return;
+  }
+  if (bounded_distance_ != NULL)
+  {
+    scanBounded(query, neighbours, stats);
+    return;
+  }
+  const FeatureMatrix& training_set = *training_set_;
+  int size = training_set.get_num_rows();
+  for (int i = 0; i < size; ++i)
+  {
+    neighbours.push(distance_(query, training_set.row(i), num_attributes_), i,
+                    training_set.label(i));
+  }
+  ++stats.queries;
+  stats.distance_evaluations += size;
+}
+
+/**
+ * The brute-force loop with early abandoning: a row is given up as soon as
+ * its partial distance exceeds the current k-th nearest (see
+ * BoundedDistanceFunction). Abandoned rows could not have entered the list
+ * (rows are scanned in order, so a tie loses too), and the rest get their
+ * exact distance, so the neighbours found are those of scan().
+ */
+void NearestNeighbour::scanBounded(const float* query,
+                                   NeighbourList& neighbours,
+                                   SearchStats& stats) const
+{
+  const FeatureMatrix& rows = ordered_ != NULL ? *ordered_ : *training_set_;
+  vector<float> ordered_query;
+  if (ordered_ != NULL)
+  {
+    ordered_query.resize(num_attributes_ + 1);
+    orderFeatures(query, &ordered_query[0]);
+    query = &ordered_query[0];
+  }
+  const int size = rows.get_num_rows();
+  long examined = 0;
   for (int i = 0; i < size; ++i)
   {
-    neighbour n;
-    n.distance = distR(query, training_set[i]); // dist() not being used atm.
-    n.classification = training_set[i][num_attributes_];
-    neighbours.push_back(n);
+    int features;
+    const double distance = bounded_distance_(query, rows.row(i),
+                                              num_attributes_,
+                                              neighbours.threshold(),
+                                              &features);
+    neighbours.push(distance, i, rows.label(i));
+    examined += features;
   }
+  ++stats.queries;
+  stats.distance_evaluations += size;
+  stats.features_examined += examined;
+}
 
-  sort(neighbours.begin(), neighbours.end());
- 
-  // Tally up the votes from the k nearest neighbours.
-  map<int, int> votes;
-  set<int> classes;
-  for (int i = 0; i < k_; ++i)
+/**
+ * The brute-force loop over the bit-packed training set: one popcount per
+ * 64 binary attributes plus the metric kernel over the continuous ones.
+ * Gives the same distances as scan() on the float rows.
+ */
+void NearestNeighbour::scanPacked(const float* query,
+                                  NeighbourList& neighbours,
+                                  SearchStats& stats) const
+{
+  const int words = packed_->get_num_words();
+  const int continuous = packed_->get_num_continuous();
+  vector<BitPackedMatrix::Word> query_bits(words + 1);
+  vector<float> query_continuous(continuous + 1);
+  packed_->packRow(query, &query_bits[0], &query_continuous[0]);
+
+  int size = packed_->get_num_rows();
+  if (bounded_distance_ != NULL && continuous > 0)
+  {
+    // The continuous part is abandoned once the bits and it together exceed
+    // the k-th nearest. The bound is rounded, so an abandoned sum that does
+    // not come out above the k-th nearest is finished instead.
+    long examined = 0;
+    for (int i = 0; i < size; ++i)
+    {
+      double distance = bit_distance_(&query_bits[0], packed_->bits(i), words);
+      const double threshold = neighbours.threshold();
+      int features;
+      double rest = bounded_distance_(&query_continuous[0],
+                                      packed_->continuous(i), continuous,
+                                      threshold - distance, &features);
+      if (features < continuous && distance + rest < threshold)
+      {
+        rest = distance_(&query_continuous[0], packed_->continuous(i),
+                         continuous);
+        features = continuous;
+      }
+      neighbours.push(distance + rest, i, packed_->label(i));
+      examined += features;
+    }
+    stats.features_examined += examined;
+  }
+  else
   {
-//    cout << "neighbour " << i+1 << ":  " << neighbours[i].classification
-//         << " " << neighbours[i].distance << "\n";
-    votes[neighbours[i].classification]++;
-    classes.insert(neighbours[i].classification);
+    for (int i = 0; i < size; ++i)
+    {
+      double distance = bit_distance_(&query_bits[0], packed_->bits(i), words);
+      if (continuous > 0)
+        distance += distance_(&query_continuous[0], packed_->continuous(i),
+                              continuous);
+      neighbours.push(distance, i, packed_->label(i));
+    }
   }
+  ++stats.queries;
+  stats.distance_evaluations += size;
+}
 
-  // Determine which class has the highest vote.
-  set<int>::iterator it;
-  int majority_vote = -99999999;
-  int majority_class = -1;
-  for (it = classes.begin(); it != classes.end(); ++it)
+/**
+ * Sets up early abandoning for the brute-force scan: picks the bounded
+ * kernel of the metric and, with variance ordering, puts the attributes
+ * with the largest variance on the training set first, so the partial sums
+ * grow fastest and rows are abandoned sooner.
+ */
+void NearestNeighbour::prepareEarlyAbandon(const FeatureMatrix& training_set)
+{
+  bounded_distance_ = boundedMetricKernel(distanceKernels(),
+                                          parameters_.metric);
+  if (bounded_distance_ == NULL)
   {
-    int classification = *it;
-    if (votes[classification] > majority_vote)
+    cerr << "(!) Early abandoning only supports the euclidean and manhattan "
+         << "metrics\n";
+    abort();
+  }
+  if (!parameters_.variance_order) return;
+
+  const int size = training_set.get_num_rows();
+  vector<double> sums(num_attributes_, 0.0), squares(num_attributes_, 0.0);
+  for (int i = 0; i < size; ++i)
+  {
+    const float* row = training_set.row(i);
+    for (int j = 0; j < num_attributes_; ++j)
     {
-      majority_vote = votes[classification];
-      majority_class = classification;
+      sums[j] += row[j];
+      squares[j] += static_cast<double>(row[j]) * row[j];
     }
   }
-  return majority_class;
+  vector<pair<double, int> > variances(num_attributes_);
+  for (int j = 0; j < num_attributes_; ++j)
+  {
+    const double mean = size > 0 ? sums[j] / size : 0.0;
+    const double variance = size > 0 ? squares[j] / size - mean * mean : 0.0;
+    variances[j] = make_pair(-variance, j);  // Largest first, then by index.
+  }
+  sort(variances.begin(), variances.end());
+  feature_order_.resize(num_attributes_);
+  for (int j = 0; j < num_attributes_; ++j)
+    feature_order_[j] = variances[j].second;
 }
 
+/**
+ * Copies a row with its attributes in feature_order_.
+ */
+void NearestNeighbour::orderFeatures(const float* row, float* ordered) const
+{
+  for (int j = 0; j < num_attributes_; ++j)
+    ordered[j] = row[feature_order_[j]];
+}
+
+/**
+ * The brute-force loop of anytime queries: rows are scanned in
+ * anytime_order_, then the inserted rows in the order they came, until the
+ * budget of distance evaluations or time runs out. Removed rows are
+ * skipped and cost nothing. The neighbours are the k nearest of the live
+ * rows scanned, so a query that scans them all gets those of the full
+ * search.
+ */
+void NearestNeighbour::scanAnytime(const float* query,
+                                   NeighbourList& neighbours,
+                                   SearchStats& stats) const
+{
+  const FeatureMatrix& training_set = *training_set_;
+  const int indexed = anytime_order_.size();
+  const int size = indexed + delta_.get_num_rows();
+  const long budget = parameters_.anytime_budget > 0 ?
+                      parameters_.anytime_budget : size;
+  const double deadline = parameters_.anytime_deadline / 1e6;
+  Stopwatch stopwatch;
+  int next = 0;  // Position in the scan order.
+  long evaluations = 0;
+  for (; next < size && evaluations < budget; ++next)
+  {
+    const int row = next < indexed ? anytime_order_[next] : next;
+    if (removed_[row]) continue;
+    if (deadline > 0 && evaluations > 0 &&
+        evaluations % kDeadlineStride == 0 && stopwatch.seconds() >= deadline)
+      break;
+    if (row < indexed)
+      neighbours.push(distance_(query, training_set.row(row), num_attributes_),
+                      row, training_set.label(row));
+    else
+      neighbours.push(distance_(query, delta_.row(row - indexed),
+                                num_attributes_),
+                      row, delta_.label(row - indexed));
+    ++evaluations;
+  }
+  // Tombstones left at the end of the order do not make the query partial.
+  while (next < size && removed_[next < indexed ? anytime_order_[next] : next])
+    ++next;
+  ++stats.queries;
+  stats.distance_evaluations += evaluations;
+  if (next < size) ++stats.early_stops;
+}
 
 /**
- * Euclidean distance metric.
+ * The brute-force loop over the reduced-precision training set. With
+ * reranking, the best rerank_ rows by the compressed distance are re-scored
+ * against the full-precision rows.
+ */
+void NearestNeighbour::scanCompressed(const float* query,
+                                      NeighbourList& neighbours,
+                                      SearchStats& stats) const
+{
+  vector<float> prepared(compressed_->get_stride() + 1);
+  compressed_->prepareQuery(query, &prepared[0]);
+  const int size = compressed_->get_num_rows();
+  ++stats.queries;
+  stats.distance_evaluations += size;
+  if (rerank_ <= 0)
+  {
+    for (int i = 0; i < size; ++i)
+      neighbours.push(compressed_->distance(&prepared[0], i), i,
+                      compressed_->label(i));
+    return;
+  }
+
+  NeighbourList candidates(max(rerank_, neighbours.capacity()));
+  for (int i = 0; i < size; ++i)
+    candidates.push(compressed_->distance(&prepared[0], i), i,
+                    compressed_->label(i));
+  for (int c = 0; c < candidates.size(); ++c)
+  {
+    const int row = candidates[c].index;
+    neighbours.push(distance_(query, training_set_->row(row), num_attributes_),
+                    row, candidates[c].classification);
+  }
+  stats.distance_evaluations += candidates.size();
+}
+
+/**
+ * Measures how the index (or the reduced-precision scan) compares with the
+ * brute-force search on the testing set (held out from the index): the
+ * fraction of the true k nearest neighbours it finds (recall), how often a
+ * query misses at least one of them, the accuracy of the vote, and the time
+ * per query. Approximate engines are measured at
+ * several search efforts, reduced-precision storage at several rerank counts.
  *
- * @param query The unclassified example.
- * @param record The classified example.
- * @return The distance between the two examples.
+ * @param testing_set The examples used as queries.
  */
-double NearestNeighbour::dist(const vector<float> query,
-                              const vector<float> record) const
+void NearestNeighbour::reportRecall(const FeatureMatrix& testing_set)
 {
-  assert(query.size() == record.size());
-  double temp = 0;
-  for (int i = 0; i < static_cast<int>(query.size()); ++i)
+  const int total_cases = testing_set.get_num_rows();
+  if (total_cases == 0) return;
+  NeighbourList neighbours(k_);
+  vector<double> votes(num_classes_ + 1);
+  SearchStats stats;
+
+  // Distance to the true k-th neighbour of each query. A neighbour found by
+  // the index counts towards recall if it is no further than that, so ties
+  // at the k-th place are not held against it.
+  vector<double> kth_distance(total_cases);
+  int exact_hits = 0;
+  Stopwatch stopwatch;
+  for (int i = 0; i < total_cases; ++i)
+  {
+    neighbours.reset();
+    scan(testing_set.row(i), neighbours, stats);
+    if (vote(neighbours, votes) == testing_set.label(i)) ++exact_hits;
+    kth_distance[i] = neighbours.size() > 0 ?
+                      neighbours[neighbours.size() - 1].distance : 0.0;
+  }
+  const double exact_time = stopwatch.seconds() / total_cases;
+
+  // The knob of reduced-precision storage is the number of rows reranked.
+  const char* name = index_ != NULL ? index_->name() :
+                     parameters_.storage.c_str();
+  cout << "=== Recall vs latency of " << name
+       << " against brute force (" << total_cases << " queries, k = " << k_
+       << ")\neffort\trecall\tmissed\taccuracy\tdelta\tms/query\tspeedup\n"
+       << "brute\t1\t0%\t" << 100.0 * exact_hits / total_cases << "%\t0\t"
+       << 1000 * exact_time << "\t1\n";
+
+  vector<int> efforts;
+  const int configured = index_ != NULL ? index_->get_search_effort() :
+                         rerank_;
+  if (index_ == NULL)
   {
-    temp += sqr(query[i] - record[i]);
+    for (int effort = 0; effort <= 8 * k_; effort = max(k_, 2 * effort))
+      efforts.push_back(effort);
+    efforts.push_back(configured);
+    sort(efforts.begin(), efforts.end());
+    efforts.erase(unique(efforts.begin(), efforts.end()), efforts.end());
   }
-  return sqrt(temp);
+  else if (index_->set_search_effort(configured))
+  {
+    // Doubling steps from an eighth to eight times the configured effort.
+    for (int effort = max(1, configured / 8); effort <= 8 * configured;
+         effort *= 2)
+      efforts.push_back(effort);
+    efforts.push_back(configured);
+    sort(efforts.begin(), efforts.end());
+    efforts.erase(unique(efforts.begin(), efforts.end()), efforts.end());
+  }
+  else
+  {
+    efforts.push_back(configured);
+  }
+
+  for (size_t e = 0; e < efforts.size(); ++e)
+  {
+    if (index_ != NULL)
+      index_->set_search_effort(efforts[e]);
+    else
+      rerank_ = efforts[e];
+    int found = 0, expected = 0, hits = 0, missed = 0;
+    double time = 0.0;
+    for (int i = 0; i < total_cases; ++i)
+    {
+      const float* query = testing_set.row(i);
+      stopwatch.restart();
+      if (computeNearestNeighbours(query, neighbours, votes, stats) ==
+          testing_set.label(i))
+        ++hits;
+      time += stopwatch.seconds();
+      // Engines may rank by an estimate (e.g. ivfpq codes), so recall is
+      // judged on the true distance of every neighbour found.
+      int query_found = 0;
+      for (int j = 0; j < neighbours.size(); ++j)
+      {
+        if (distance_(query, training_set_->row(neighbours[j].index),
+                      num_attributes_) <= kth_distance[i])
+          ++query_found;
+      }
+      const int query_expected = min(k_, training_set_->get_num_rows());
+      found += query_found;
+      expected += query_expected;
+      if (query_found < query_expected) ++missed;
+    }
+    time /= total_cases;
+    cout << efforts[e] << "\t" << static_cast<double>(found) / expected << "\t"
+         << 100.0 * missed / total_cases << "%\t"
+         << 100.0 * hits / total_cases << "%\t"
+         << 100.0 * (hits - exact_hits) / total_cases << "\t" << 1000 * time
+         << "\t" << (time > 0 ? exact_time / time : 0) << "\n";
+  }
+  cout << "\n";
+  if (index_ != NULL)
+    index_->set_search_effort(configured);
+  else
+    rerank_ = configured;
 }
 
 /**
- * Euclidean squared distance metric. More efficient than the actual distance.
- * Use when you need distance for comparisons, not the actual distance.
+ * What the anytime budget costs: every query of the testing set is answered
+ * within the budget and by the full scan, and the votes are compared.
  *
- * @param query The unclassified example.
- * @param record The classified example.
- * @return The squared "distance" between the two examples.
+ * @param testing_set The examples used as queries.
  */
-double NearestNeighbour::distR(const vector<float> query,
-                               const vector<float> record) const
+void NearestNeighbour::reportAnytime(const FeatureMatrix& testing_set) const
 {
-  assert(query.size() == record.size());
-  double temp = 0;
-  for (int i = 0; i < static_cast<int>(query.size()); ++i)
+  const int total_cases = testing_set.get_num_rows();
+  if (total_cases == 0) return;
+  NeighbourList neighbours(k_);
+  vector<double> votes(num_classes_ + 1);
+  SearchStats stats, full_stats;
+  int hits = 0, full_hits = 0, changed = 0;
+  for (int i = 0; i < total_cases; ++i)
   {
-    temp += sqr(query[i] - record[i]);
+    const float* query = testing_set.row(i);
+    const long stops = stats.early_stops;
+    const int classification = computeNearestNeighbours(query, neighbours,
+                                                        votes, stats);
+    neighbours.reset();
+    scan(query, neighbours, full_stats);
+    const int full_classification = vote(neighbours, votes);
+    if (classification == testing_set.label(i)) ++hits;
+    if (full_classification == testing_set.label(i)) ++full_hits;
+    if (stats.early_stops > stops && classification != full_classification)
+      ++changed;
   }
-  return temp;
+  cout << "=== Cost of the anytime budget (" << total_cases << " queries)\n"
+       << "Stopped early: " << stats.early_stops << " ("
+       << 100.0 * stats.early_stops / total_cases << "%), of which "
+       << changed << " changed their vote\n"
+       << "Accuracy: " << 100.0 * hits / total_cases
+       << "% within the budget, " << 100.0 * full_hits / total_cases
+       << "% with full scans (" << 100.0 * (hits - full_hits) / total_cases
+       << ")\n\n";
 }
 
 /**
- * A generic function to square a value.
+ * Accuracy on the testing set of every k from 1 to k_max, from one search
+ * for the k_max nearest neighbours per query: the k nearest are the first k
+ * of them, so each k is scored from a prefix of the same sorted list.
+ *
+ * @param testing_set The examples used as queries.
+ * @param k_max The largest k scored.
  */
-template<class T> inline T NearestNeighbour::sqr(const T &x) const
+void NearestNeighbour::reportKSweep(const FeatureMatrix& testing_set,
+                                    const int k_max) const
+{
+  const int total_cases = testing_set.get_num_rows();
+  if (total_cases == 0 || k_max < 1) return;
+  NeighbourList neighbours(k_max);
+  vector<double> votes(num_classes_ + 1);
+  vector<int> first_seen(num_classes_ + 1);
+  vector<int> hits(k_max, 0);
+  SearchStats stats;
+  Stopwatch stopwatch;
+  pthread_rwlock_rdlock(&lock_);
+  for (int i = 0; i < total_cases; ++i)
+  {
+    neighbours.reset();
+    if (updated())
+      searchUpdated(testing_set.row(i), neighbours, stats);
+    else
+      searchEngine(testing_set.row(i), neighbours, stats);
+    tallyPrefixVotes(neighbours, -1, testing_set.label(i), votes, first_seen,
+                     hits);
+  }
+  pthread_rwlock_unlock(&lock_);
+  cout << "=== Accuracy by k on the testing set (" << total_cases
+       << " queries, one search each)\n";
+  printKSweep(hits, total_cases, stopwatch.seconds(),
+              stats.distance_evaluations);
+}
+
+/**
+ * Leave-one-out accuracy of every k from 1 to k_max over the rows the model
+ * was built on: each row is classified by the others. The brute engine
+ * (with float storage) makes a single pass over the pairs, offering each
+ * distance to the lists of both rows, so N (N - 1) / 2 distances are
+ * computed in all. Other engines search for k_max + 1 neighbours per row
+ * and drop the row itself.
+ *
+ * @param k_max The largest k scored.
+ */
+void NearestNeighbour::reportLeaveOneOut(const int k_max) const
+{
+  const FeatureMatrix& rows = *training_set_;
+  const int size = rows.get_num_rows();
+  if (size < 2 || k_max < 1) return;
+  vector<double> votes(num_classes_ + 1);
+  vector<int> first_seen(num_classes_ + 1);
+  vector<int> hits(k_max, 0);
+  SearchStats stats;
+  Stopwatch stopwatch;
+  pthread_rwlock_rdlock(&lock_);
+  if (index_ == NULL && compressed_ == NULL && !updated())
+  {
+    // Distances are symmetric (the kernels sum the same terms either way
+    // round), so both lists get the same value a scan would give them.
+    vector<NeighbourList> lists(size, NeighbourList(k_max));
+    for (int i = 0; i < size; ++i)
+    {
+      const float* row = rows.row(i);
+      for (int j = i + 1; j < size; ++j)
+      {
+        const double distance = distance_(row, rows.row(j), num_attributes_);
+        lists[i].push(distance, j, rows.label(j));
+        lists[j].push(distance, i, rows.label(i));
+      }
+    }
+    stats.distance_evaluations = static_cast<long>(size) * (size - 1) / 2;
+    for (int i = 0; i < size; ++i)
+      tallyPrefixVotes(lists[i], -1, rows.label(i), votes, first_seen, hits);
+  }
+  else
+  {
+    NeighbourList neighbours(k_max + 1);
+    for (int i = 0; i < size; ++i)
+    {
+      neighbours.reset();
+      if (updated())
+        searchUpdated(rows.row(i), neighbours, stats);
+      else
+        searchEngine(rows.row(i), neighbours, stats);
+      tallyPrefixVotes(neighbours, i, rows.label(i), votes, first_seen, hits);
+    }
+  }
+  pthread_rwlock_unlock(&lock_);
+  cout << "=== Leave-one-out accuracy by k (" << size << " examples)\n";
+  printKSweep(hits, size, stopwatch.seconds(), stats.distance_evaluations);
+}
+
+/**
+ * Scores every prefix of a neighbour list: counts a hit for k when the
+ * vote of the k nearest (as vote() takes it) is the label.
+ * Votes are kept as the prefix grows; the leader only changes when the
+ * class just counted overtakes it, or ties it with a nearer first member.
+ *
+ * @param neighbours The neighbours (sorted by this call).
+ * @param skip Row left out of the vote (the query itself); -1 for none.
+ * @param label The true classification.
+ * @param votes Scratch tally with room for num_classes_ + 1 entries.
+ * @param first_seen Scratch with room for num_classes_ + 1 entries.
+ * @param hits Hits per k (k - 1 is the index), added to.
+ */
+void NearestNeighbour::tallyPrefixVotes(NeighbourList& neighbours,
+                                        const int skip, const int label,
+                                        vector<double>& votes,
+                                        vector<int>& first_seen,
+                                        vector<int>& hits) const
+{
+  neighbours.sort();
+  fill(votes.begin(), votes.end(), 0.0);
+  const int k_max = hits.size();
+  int leader = -1;
+  int k = 0;
+  for (int i = 0; i < neighbours.size() && k < k_max; ++i)
+  {
+    if (neighbours[i].index == skip) continue;
+    const int classification = neighbours[i].classification;
+    if (votes[classification] == 0.0) first_seen[classification] = k;
+    votes[classification] += voteWeight(neighbours[i].distance);
+    if (leader < 0 || votes[classification] > votes[leader] ||
+        (votes[classification] == votes[leader] &&
+         first_seen[classification] < first_seen[leader]))
+      leader = classification;
+    if (leader == label) ++hits[k];
+    ++k;
+  }
+  // Fewer than k_max neighbours: larger k vote like the whole list.
+  for (; k < k_max && leader == label && k > 0; ++k)
+    ++hits[k];
+}
+
+/**
+ * Prints the accuracy of every k and marks the best.
+ */
+void NearestNeighbour::printKSweep(const vector<int>& hits,
+                                   const int total_cases, const double seconds,
+                                   const long evaluations) const
+{
+  const int best = max_element(hits.begin(), hits.end()) - hits.begin();
+  cout << "k\taccuracy\n";
+  for (size_t k = 0; k < hits.size(); ++k)
+  {
+    cout << k + 1 << "\t" << 100.0 * hits[k] / total_cases << "%"
+         << (static_cast<int>(k) == best ? "\tbest" : "") << "\n";
+  }
+  cout << "Searched in " << seconds << " s with " << evaluations
+       << " distance evaluations\n\n";
+}
+
+/**
+ * Tallies up the votes from the nearest neighbours in a flat per-class array,
+ * each weighted by voteWeight(). A tie is won by the class whose member is
+ * nearest to the query.
+ *
+ * @param neighbours The nearest neighbours (sorted by this call).
+ * @param votes Scratch tally with room for num_classes_ + 1 entries.
+ * @return The class with the most votes.
+ */
+int NearestNeighbour::vote(NeighbourList& neighbours,
+                           vector<double>& votes) const
+{
+  neighbours.sort();
+  fill(votes.begin(), votes.end(), 0.0);
+
+  for (int i = 0; i < neighbours.size(); ++i)
+    votes[neighbours[i].classification] += voteWeight(neighbours[i].distance);
+  double majority_vote = 0.0;
+  int majority_class = -1;
+  for (int i = 0; i < neighbours.size(); ++i)
+  {
+    int classification = neighbours[i].classification;
+    if (votes[classification] > majority_vote)
+    {
+      majority_vote = votes[classification];
+      majority_class = classification;
+    }
+  }
+  return majority_class;
+}
+
+/**
+ * The vote of a neighbour at the given ranking distance: 1 for the majority
+ * vote, the inverse of the metric distance for the weighted one. A small
+ * constant keeps a neighbour at distance 0 finite (it still outweighs any
+ * other), so several of them still add up.
+ */
+double NearestNeighbour::voteWeight(const double distance) const
+{
+  if (parameters_.vote == kMajority) return 1.0;
+  return 1.0 / (metricDistance(parameters_.metric, distance) +
+                kZeroDistanceSlack);
+}
+
+bool NearestNeighbour::parseVote(const char* name, Vote* vote)
 {
-  return x * x;
+  if (strcmp(name, "majority") == 0) *vote = kMajority;
+  else if (strcmp(name, "distance") == 0) *vote = kInverseDistance;
+  else return false;
+  return true;
 }
@@ -15,37 +15,158 @@
   TypeName(const TypeName&);               \
   void operator=(const TypeName&)
 
-#include <vector>                                                                    
+#include <vector>
 using std::vector;
+#include <pthread.h>
+#include "KnnIndex.h"  // SearchStats
+#include "DistanceKernels.h"
+#include "FeatureMatrix.h"
+#include "knn_parameters.h"
 
-struct neighbour;
+class NeighbourList;
+class BitPackedMatrix;
+class BatchedScan;
+class ShardedScan;
+class CompressedMatrix;
+class IndexBlobReader;
 
 class NearestNeighbour
 {
  public:
-  NearestNeighbour(const int k, const int num_attributes);
+  NearestNeighbour(const int k, const int num_attributes,
+                   const int num_classes, const KnnParameters& parameters);
   ~NearestNeighbour();
-  double learn(const vector< vector<float> > training_set,
-               const vector< vector<float> > testing_set,
-               const bool verbose) const;
+  double learn(const FeatureMatrix& training_set,
+               const FeatureMatrix& testing_set,
+               const bool verbose);
+  void buildIndex(const FeatureMatrix& training_set);
+  void restoreIndex(const FeatureMatrix& training_set, const char* structure,
+                    const long structure_bytes);
+  bool saveIndex(vector<char>& structure) const;
+  // Fills lists[0, end - begin) (reset here) with the nearest neighbours of
+  // queries begin to end - 1; a list may be longer than k.
+  void findNeighbours(const FeatureMatrix& queries, const int begin,
+                      const int end, vector<NeighbourList>& lists,
+                      SearchStats& stats) const;
+  // The engine answering the queries; -n auto is resolved by buildIndex().
+  const std::string& get_engine() const { return parameters_.engine; }
+  // Whether buildIndex() prints what it built (on by default).
+  void set_report(const bool report) { report_ = report; }
+  double test(const FeatureMatrix& testing_set, const bool verbose) const;
+  void reportRecall(const FeatureMatrix& testing_set);
+  void reportKSweep(const FeatureMatrix& testing_set, const int k_max) const;
+  void reportLeaveOneOut(const int k_max) const;
+  void reportAnytime(const FeatureMatrix& testing_set) const;
+
+  // Incremental updates, after buildIndex() or restoreIndex(). The examples
+  // of the training set have ids 0 to N - 1 (their row); insert() hands out
+  // the following ids. Inserted examples are scanned linearly and removed
+  // ones are only marked (tombstones) until a compaction rebuilds the
+  // engine over the live examples. Compactions start in the background once
+  // enough updates are pending. Updates may run while other threads query.
+  int insert(const float* example, const int label);
+  bool remove(const int id);
+  void compact();
+  // exact, if not NULL, is set to whether the neighbours voting are the true
+  // k nearest; not so for approximate engines, reduced-precision storage or
+  // anytime queries that ran out of budget (see
+  // KnnParameters::anytime_budget).
+  int classify(const float* query, bool* exact = NULL) const;
+  int get_num_examples() const;  // Live examples.
+  // The rows the engine was built on (the training set, or a compaction).
+  const FeatureMatrix& get_training_set() const { return *training_set_; }
+
+  // Reads a vote name ("majority" or "distance"); false if unknown.
+  static bool parseVote(const char* name, Vote* vote);
  private:
-  struct neighbour
+  static const int kQueryChunk = 16;  // Queries a test thread takes at once.
+  static const int kShardChunk = 64;  // Queries sent to the shards at once.
+  // A compaction starts once the inserted plus removed examples exceed the
+  // larger of kMinPendingRows and 1 / kPendingShare of the indexed ones.
+  static const int kMinPendingRows = 64;
+  static const int kPendingShare = 4;
+  // An anytime scan reads the clock once every kDeadlineStride rows.
+  static const int kDeadlineStride = 32;
+  // Shared state of the threads of one test() call.
+  struct TestWork
   {
-    double distance;
-    int classification;
-    // Overload the < operator for sorting neighbour structures.
-    bool operator<(const neighbour& other) const
-    {
-      return distance < other.distance;
-    }
+    const NearestNeighbour* knn;
+    const FeatureMatrix* testing_set;
+    vector<int>* classifications;  // One slot per query, filled by thread.
+    int chunk;
+    pthread_mutex_t lock;  // Guards next, hits and stats.
+    int next;  // First query not yet handed out.
+    int hits;
+    SearchStats stats;
   };
+  static void* testThread(void* test_work);
+  void prepare(const FeatureMatrix& training_set, IndexBlobReader* saved);
+  void prepareShards(const FeatureMatrix& training_set);
+  void prepareAnytime(const FeatureMatrix& training_set);
+  static void* compactionThread(void* knn);
+  void rebuild();
+  void scheduleCompaction();
+  void joinCompaction();
+  bool updated() const { return delta_.get_num_rows() > 0 || num_removed_ > 0; }
+
   int k_;
   int num_attributes_;
-  int computeNearestNeighbours(const vector<float> query,
-                               const vector< vector<float> > training_set) const;
-  double dist(const vector<float> query, const vector<float> record) const;
-  double distR(const vector<float> query, const vector<float> record) const;
-  template<class T> T sqr(const T &x) const;
+  int num_classes_;  // Classifications are numbered 1 to num_classes_.
+  KnnParameters parameters_;
+  DistanceFunction distance_;  // Kernel of the metric chosen in parameters_.
+  BitDistanceFunction bit_distance_;  // Kernel for the packed attributes.
+  const FeatureMatrix* training_set_;  // Set by buildIndex().
+  KnnIndex* index_;  // NULL when scanning the whole training set.
+  BitPackedMatrix* packed_;  // Training set for scanning, if bit-packed.
+  BatchedScan* batched_;  // Set when queries are scanned in blocks.
+  ShardedScan* sharded_;  // Set when worker processes own the rows.
+  CompressedMatrix* compressed_;  // Set for reduced-precision storage.
+  BoundedDistanceFunction bounded_distance_;  // Set for early abandoning.
+  vector<int> feature_order_;  // Attributes by decreasing variance, if used.
+  FeatureMatrix* ordered_;  // Training rows in feature_order_ (float scan).
+  vector<int> anytime_order_;  // Rows in anytime scan order, if budgeted.
+  int rerank_;  // Compressed-scan candidates re-scored in full precision.
+  bool report_;  // Print what prepare() built (not for compactions).
+  // Update state. Rows are numbered over the indexed training set followed
+  // by delta_; neighbours carry these row numbers.
+  FeatureMatrix* owned_rows_;  // The training set after a compaction.
+  FeatureMatrix delta_;  // Inserted examples not yet in the engine.
+  vector<int> row_ids_;  // Id of every row.
+  vector<int> id_rows_;  // Row of every id; -1 once removed.
+  vector<bool> removed_;  // Tombstone of every row.
+  int num_removed_;
+  int base_removed_;  // Tombstones among the indexed rows.
+  mutable pthread_rwlock_t lock_;  // Read: queries. Write: updates.
+  pthread_t compaction_;
+  bool compacting_;  // compaction_ has not finished its work yet.
+  bool compaction_started_;  // compaction_ has not been joined yet.
+  int computeNearestNeighbours(const float* query,
+                               NeighbourList& neighbours,
+                               vector<double>& votes,
+                               SearchStats& stats) const;
+  void searchEngine(const float* query, NeighbourList& neighbours,
+                    SearchStats& stats) const;
+  void searchUpdated(const float* query, NeighbourList& neighbours,
+                     SearchStats& stats) const;
+  void scan(const float* query, NeighbourList& neighbours,
+            SearchStats& stats) const;
+  void scanPacked(const float* query, NeighbourList& neighbours,
+                  SearchStats& stats) const;
+  void scanBounded(const float* query, NeighbourList& neighbours,
+                   SearchStats& stats) const;
+  void prepareEarlyAbandon(const FeatureMatrix& training_set);
+  void orderFeatures(const float* row, float* ordered) const;
+  void scanAnytime(const float* query, NeighbourList& neighbours,
+                   SearchStats& stats) const;
+  void scanCompressed(const float* query, NeighbourList& neighbours,
+                      SearchStats& stats) const;
+  int vote(NeighbourList& neighbours, vector<double>& votes) const;
+  double voteWeight(const double distance) const;
+  void tallyPrefixVotes(NeighbourList& neighbours, const int skip,
+                        const int label, vector<double>& votes,
+                        vector<int>& first_seen, vector<int>& hits) const;
+  void printKSweep(const vector<int>& hits, const int total_cases,
+                   const double seconds, const long evaluations) const;
   DISALLOW_COPY_AND_ASSIGN(NearestNeighbour);
 };
 
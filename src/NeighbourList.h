@@ -0,0 +1,96 @@
+/*
+ * File:   NeighbourList.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef NEIGHBOURLIST_H
+#define	NEIGHBOURLIST_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+/**
+ * A classified example found while searching for the nearest neighbours.
+ * Neighbours are ordered by distance; equal distances are ordered by their
+ * row in the training set so that every search gives the same answer.
+ */
+struct neighbour
+{
+  double distance;
+  int index;  // Row in the training set.
+  int classification;
+
+  // Overload the < operator for sorting neighbour structures.
+  bool operator<(const neighbour& other) const
+  {
+    if (distance != other.distance) return distance < other.distance;
+    return index < other.index;
+  }
+};
+
+/**
+ * Keeps the k best neighbours seen so far in a fixed-size max-heap, so the
+ * worst of the k is always on top and can be replaced in O(log k).
+ * The storage is allocated once; reset() readies the list for the next query.
+ */
+class NeighbourList
+{
+ public:
+  explicit NeighbourList(const int k) : k_(k), size_(0), heap_(k) {}
+
+  void reset() { size_ = 0; }
+
+  /**
+   * Offers a candidate to the list. It is kept only if it beats the current
+   * k-th best neighbour (or the list is not yet full).
+   */
+  void push(const double distance, const int index, const int classification)
+  {
+    neighbour n;
+    n.distance = distance;
+    n.index = index;
+    n.classification = classification;
+    if (size_ < k_)
+    {
+      heap_[size_++] = n;
+      std::push_heap(heap_.begin(), heap_.begin() + size_);
+    }
+    else if (k_ > 0 && n < heap_[0])
+    {
+      std::pop_heap(heap_.begin(), heap_.begin() + size_);
+      heap_[size_ - 1] = n;
+      std::push_heap(heap_.begin(), heap_.begin() + size_);
+    }
+  }
+
+  /**
+   * The distance a candidate has to beat to get into the list.
+   * Infinite until k neighbours have been found.
+   */
+  double threshold() const
+  {
+    if (size_ < k_) return std::numeric_limits<double>::infinity();
+    return heap_[0].distance;
+  }
+
+  /**
+   * Orders the neighbours from nearest to furthest. The list is no longer a
+   * heap afterwards, so call reset() before pushing again.
+   */
+  void sort() { std::sort_heap(heap_.begin(), heap_.begin() + size_); }
+
+  bool full() const { return size_ == k_; }
+  int size() const { return size_; }
+  int capacity() const { return k_; }
+  const neighbour& operator[](const int i) const { return heap_[i]; }
+
+ private:
+  int k_;
+  int size_;
+  std::vector<neighbour> heap_;
+};
+
+#endif	/* NEIGHBOURLIST_H */
@@ -7,7 +7,7 @@
 
 #include "NeuralNet.h"
 #include "Layer.h"
-#include "Neurode.h"
+#include "FeatureMatrix.h"
 #include <string>
 #include <vector>
 #include <algorithm> // For random_shuffle.
@@ -44,9 +44,9 @@ NeuralNet::~NeuralNet()
 /**
  * Initializes the weighted connections between the network layers. Only the
  * hidden and output layers have incoming connections, so they are initiated
- * from those layers. For each node in the given layer, a vector of connections
- * is created (ultimately in the Neurode class). So each node in a layer has an
- * incoming weighted connection from _each_ node in the preceding layer.
+ * from those layers. For each node in the given layer, a row of connection
+ * weights is created (in the layer's weight matrix). So each node in a layer
+ * has an incoming weighted connection from _each_ node in the preceding layer.
  *
  * @param num_connections_input_hidden  Number of connections from input to hidden layer
  * @param num_connections_hidden_output Number of connections from hidden to output layer
@@ -119,9 +119,11 @@ void NeuralNet::resetDeltaWeights()
  * This function is used for training and testing the ANN.
  *
  * @param sample_set  The dataset used for training or testing.
+ * @param order  The order in which to present the examples (row indices).
  * @param train  Performs backprop and calculates network accuracy if true.
  */
-void NeuralNet::loadPatterns(const vector< vector<float> > sample_set,
+void NeuralNet::loadPatterns(const FeatureMatrix& sample_set,
+                             const vector<int>& order,
                              const char* hidden_activation_function,
                              const char* output_activation_function,
                              const double learning_rate,
@@ -133,23 +135,25 @@ void NeuralNet::loadPatterns(const vector< vector<float> > sample_set,
 {
   // Load each pattern into neural net, one at a time.
   int total_hits = 0;
-  int total_cases = sample_set.size();
+  int total_cases = sample_set.get_num_rows();
   double network_error = 0.0;
-  for (int example = 0; example < total_cases; ++example)
+  for (int i = 0; i < total_cases; ++i)
   {
     // Present the inputs to the input layer nodes.
+    const int example = order[i];
+    const float* pattern = sample_set.row(example);
     int size = input_layer_->get_size();
     for (int attribute = 0; attribute < size; ++attribute)
     {
-      double input = sample_set[example][attribute];
-      input_layer_->nodes_[attribute].set_input(input);
+      double input = pattern[attribute];
+      input_layer_->set_input(attribute, input);
     }
 
     // Forwardpropagate the input pattern.
     forwardprop(hidden_activation_function, output_activation_function);
 
     // Get the classification target.
-    int target = sample_set[example][size];
+    int target = sample_set.label(example);
 #if 0
     for (int i = 0; i < output_layer_->get_size(); ++i) 
     {
@@ -208,7 +212,7 @@ void NeuralNet::loadPatterns(const vector< vector<float> > sample_set,
  * @param training_set  The set of data that the Neural Net will train on
  * @param num_epochs    Number of epochs (i.e. learning cycles)
  */
-void NeuralNet::train(vector< vector<float> > training_set,
+void NeuralNet::train(const FeatureMatrix& training_set,
                       const int num_epochs,
                       const char* hidden_activation_function,
                       const char* output_activation_function,
@@ -221,15 +225,20 @@ void NeuralNet::train(vector< vector<float> > training_set,
   all_hit_percentage_ = new double[num_epochs];
   all_network_error_ = new double[num_epochs];
 
+  // The examples are shuffled through an index rather than moving the rows.
+  vector<int> order(training_set.get_num_rows());
+  for (int i = 0; i < static_cast<int>(order.size()); ++i)
+    order[i] = i;
+
   // Reminder: one epoch is equal to training the NN on the entire training set.
   // Train the network for every epoch.
   for (int epoch = 0; epoch < num_epochs; ++epoch)
   {
     // Shuffle all training cases.
-    std::random_shuffle(training_set.begin(), training_set.end());
+    std::random_shuffle(order.begin(), order.end());
 
     // Load patterns, propagate them, then back-propagate them.
-    loadPatterns(training_set, hidden_activation_function,
+    loadPatterns(training_set, order, hidden_activation_function,
                  output_activation_function, learning_rate, momentum, true,
                  verbose, output, epoch);
 
@@ -246,12 +255,15 @@ void NeuralNet::train(vector< vector<float> > training_set,
  *
  * @param testing_set   The set of data that the network will be tested on
  */
-void NeuralNet::test(vector< vector<float> > testing_set,
+void NeuralNet::test(const FeatureMatrix& testing_set,
                      const char* hidden_activation_function,
                      const char* output_activation_function,
                      const bool verbose)
 {
-  loadPatterns(testing_set, hidden_activation_function,
+  vector<int> order(testing_set.get_num_rows());
+  for (int i = 0; i < static_cast<int>(order.size()); ++i)
+    order[i] = i;
+  loadPatterns(testing_set, order, hidden_activation_function,
                output_activation_function, 0.0, 0.0, false, verbose, false, 0);
 }
 
@@ -269,7 +281,7 @@ int NeuralNet::get_result() const
   int result = -1;
   for (int i = 0; i < output_layer_->get_size(); ++i)
   {
-    current_output = output_layer_->nodes_[i].get_output();
+    current_output = output_layer_->get_output(i);
     if (current_output > max_output)
     {
       max_output = current_output;
@@ -287,7 +299,7 @@ int NeuralNet::get_result() const
  */
 double NeuralNet::get_output(int output_node) const
 {
-  return output_layer_->nodes_[output_node].get_output();
+  return output_layer_->get_output(output_node);
 }
 
 /**
@@ -298,7 +310,7 @@ double NeuralNet::get_output(int output_node) const
  */
 double NeuralNet::get_output_error(int output_node) const
 {
-  return output_layer_->nodes_[output_node].get_error();
+  return output_layer_->get_error(output_node);
 }
 
 /**
@@ -11,8 +11,9 @@
 #include <vector>
 using std::vector; // Import portion of std namespace into current namespace.
 class Layer;
+class FeatureMatrix;
 
-// Neural Net consists of all the Neurodes and Layers and Connection Weights.
+// Neural Net consists of all the Layers (nodes) and Connection Weights.
 // Num weight layers = total layers - 1 (e.g. 3 node layers, 2 weight layers)
 // Num total weights = (previous layer size) * (previous layer size)
 class NeuralNet
@@ -27,7 +28,7 @@ class NeuralNet
                    const int num_connections_hidden_output,
                    const double kLowerRange,
                    const double kUpperRange);
-  void train(vector< vector<float> > training_set,
+  void train(const FeatureMatrix& training_set,
              const int num_epochs,
              const char* hidden_activation_function,
              const char* output_activation_function,
@@ -36,7 +37,7 @@ class NeuralNet
              const double max_error,
              const bool verbose,
              const bool output);
-  void test(vector< vector<float> > testing_set,
+  void test(const FeatureMatrix& testing_set,
             const char* hidden_activation_function,
             const char* output_activation_function,
             const bool verbose);
@@ -45,7 +46,8 @@ class NeuralNet
   double get_test_accuracy(void) const;
 
  private:
-  void loadPatterns(const vector< vector<float> > sample_set,
+  void loadPatterns(const FeatureMatrix& sample_set,
+                    const vector<int>& order,
                     const char* hidden_activation_function,
                     const char* output_activation_function,
                     const double learning_rate,
@@ -0,0 +1,275 @@
+/*
+ * File:   Projection.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "Projection.h"
+#include "Random.h"
+#include <algorithm>  // min, sort
+#include <cmath>
+#include <cstdlib>  // abort
+#include <cstring>  // strcmp
+#include <iostream>
+#include <utility>  // pair
+using namespace std;
+
+namespace {
+
+const unsigned long long kProjectionSeed = 0x5EED0F5ULL;
+// Jacobi sweeps stop once the off-diagonal part is this small relative to
+// the whole matrix (or after kMaxSweeps).
+const double kOffDiagonalTolerance = 1e-24;
+const int kMaxSweeps = 50;
+
+}  // namespace
+
+Projection::Projection(const Method method, const int dimensions,
+                       const double explained_variance)
+    : method_(method), dimensions_(dimensions),
+      explained_variance_(explained_variance), num_inputs_(0),
+      num_outputs_(0), kept_variance_(1.0), scale_(1.0f)
+{
+  if (method == kRandom && dimensions < 1)
+  {
+    cerr << "(!) A random projection needs the number of dimensions\n";
+    abort();
+  }
+  if (dimensions < 1 && (explained_variance <= 0.0 || explained_variance > 1.0))
+  {
+    cerr << "(!) The explained variance must be in (0, 1]\n";
+    abort();
+  }
+}
+
+/**
+ * Fits the projection to the training set (replacing any earlier fit).
+ */
+void Projection::fit(const FeatureMatrix& training_set)
+{
+  num_inputs_ = training_set.get_num_features();
+  if (method_ == kPca)
+    fitPca(training_set);
+  else
+    fitRandom();
+}
+
+void Projection::fitPca(const FeatureMatrix& training_set)
+{
+  const int n = num_inputs_;
+  const int size = training_set.get_num_rows();
+  vector<double> mean(n, 0.0);
+  for (int i = 0; i < size; ++i)
+  {
+    const float* row = training_set.row(i);
+    for (int j = 0; j < n; ++j)
+      mean[j] += row[j];
+  }
+  for (int j = 0; j < n; ++j)
+    mean[j] /= max(size, 1);
+
+  // Covariance of the centred rows (upper triangle, then mirrored).
+  vector<double> covariance(static_cast<size_t>(n) * n, 0.0);
+  vector<double> centred(n);
+  for (int i = 0; i < size; ++i)
+  {
+    const float* row = training_set.row(i);
+    for (int j = 0; j < n; ++j)
+      centred[j] = row[j] - mean[j];
+    for (int a = 0; a < n; ++a)
+    {
+      if (centred[a] == 0.0) continue;
+      double* line = &covariance[static_cast<size_t>(a) * n];
+      for (int b = a; b < n; ++b)
+        line[b] += centred[a] * centred[b];
+    }
+  }
+  for (int a = 0; a < n; ++a)
+  {
+    for (int b = a; b < n; ++b)
+    {
+      covariance[a * n + b] /= max(size, 1);
+      covariance[b * n + a] = covariance[a * n + b];
+    }
+  }
+
+  vector<double> eigenvalues, eigenvectors;
+  eigenSolve(covariance, n, eigenvalues, eigenvectors);
+  vector<pair<double, int> > order(n);
+  double total = 0.0;
+  for (int j = 0; j < n; ++j)
+  {
+    const double variance = max(eigenvalues[j], 0.0);
+    order[j] = make_pair(-variance, j);  // Largest first, then by index.
+    total += variance;
+  }
+  sort(order.begin(), order.end());
+
+  if (dimensions_ > 0)
+  {
+    num_outputs_ = min(dimensions_, n);
+  }
+  else
+  {
+    num_outputs_ = 0;
+    double kept = 0.0;
+    while (num_outputs_ < n &&
+           (num_outputs_ == 0 || kept < explained_variance_ * total))
+      kept -= order[num_outputs_++].first;
+  }
+  double kept = 0.0;
+  for (int o = 0; o < num_outputs_; ++o)
+    kept -= order[o].first;
+  kept_variance_ = total > 0.0 ? kept / total : 1.0;
+
+  mean_.assign(mean.begin(), mean.end());
+  components_.resize(static_cast<size_t>(num_outputs_) * n);
+  for (int o = 0; o < num_outputs_; ++o)
+  {
+    const int column = order[o].second;
+    for (int j = 0; j < n; ++j)
+      components_[o * n + j] = eigenvectors[j * n + column];
+  }
+}
+
+void Projection::fitRandom()
+{
+  num_outputs_ = dimensions_;
+  kept_variance_ = 1.0;
+  scale_ = sqrt(3.0 / num_outputs_);
+  Random generator(kProjectionSeed);
+  starts_.assign(1, 0);
+  inputs_.clear();
+  signs_.clear();
+  for (int o = 0; o < num_outputs_; ++o)
+  {
+    for (int j = 0; j < num_inputs_; ++j)
+    {
+      const double draw = generator.uniform();
+      if (draw < 1.0 / 6.0 || draw >= 5.0 / 6.0)
+      {
+        inputs_.push_back(j);
+        signs_.push_back(draw < 1.0 / 6.0 ? 1.0f : -1.0f);
+      }
+    }
+    starts_.push_back(inputs_.size());
+  }
+}
+
+void Projection::apply(const FeatureMatrix& in, FeatureMatrix* out) const
+{
+  const int size = in.get_num_rows();
+  FeatureMatrix projected(num_outputs_);
+  projected.reserve(size);
+  vector<float> row(num_outputs_ + 1);
+  for (int i = 0; i < size; ++i)
+  {
+    const float* features = in.row(i);
+    for (int o = 0; o < num_outputs_; ++o)
+    {
+      double sum = 0.0;
+      if (method_ == kPca)
+      {
+        const float* component = &components_[o * num_inputs_];
+        for (int j = 0; j < num_inputs_; ++j)
+          sum += (features[j] - mean_[j]) * component[j];
+      }
+      else
+      {
+        for (int e = starts_[o]; e < starts_[o + 1]; ++e)
+          sum += signs_[e] * features[inputs_[e]];
+        sum *= scale_;
+      }
+      row[o] = sum;
+    }
+    projected.appendRow(&row[0], in.label(i));
+  }
+  out->swap(projected);
+}
+
+/**
+ * Cyclic Jacobi eigenvalue algorithm for a symmetric matrix: rotations zero
+ * the off-diagonal entries one at a time until they are negligible.
+ *
+ * @param matrix n * n symmetric, row-major; overwritten.
+ * @param eigenvalues Receives n eigenvalues, in no particular order.
+ * @param eigenvectors Receives n * n values; column j is the unit
+ *                     eigenvector of eigenvalue j.
+ */
+void Projection::eigenSolve(vector<double>& matrix, const int n,
+                            vector<double>& eigenvalues,
+                            vector<double>& eigenvectors)
+{
+  eigenvectors.assign(static_cast<size_t>(n) * n, 0.0);
+  double total = 0.0;
+  for (int a = 0; a < n; ++a)
+  {
+    eigenvectors[a * n + a] = 1.0;
+    for (int b = 0; b < n; ++b)
+      total += matrix[a * n + b] * matrix[a * n + b];
+  }
+  for (int sweep = 0; sweep < kMaxSweeps; ++sweep)
+  {
+    double off_diagonal = 0.0;
+    for (int p = 0; p < n; ++p)
+    {
+      for (int q = p + 1; q < n; ++q)
+        off_diagonal += 2.0 * matrix[p * n + q] * matrix[p * n + q];
+    }
+    if (off_diagonal <= kOffDiagonalTolerance * total) break;
+
+    for (int p = 0; p < n; ++p)
+    {
+      for (int q = p + 1; q < n; ++q)
+      {
+        const double apq = matrix[p * n + q];
+        if (apq == 0.0) continue;
+        // The rotation angle phi that zeroes a_pq, as t = tan(phi).
+        const double theta = (matrix[q * n + q] - matrix[p * n + p]) /
+                             (2.0 * apq);
+        const double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                         (fabs(theta) + sqrt(theta * theta + 1.0));
+        const double c = 1.0 / sqrt(t * t + 1.0);
+        const double s = t * c;
+        for (int k = 0; k < n; ++k)  // Columns p and q.
+        {
+          const double akp = matrix[k * n + p];
+          const double akq = matrix[k * n + q];
+          matrix[k * n + p] = c * akp - s * akq;
+          matrix[k * n + q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < n; ++k)  // Rows p and q.
+        {
+          const double apk = matrix[p * n + k];
+          const double aqk = matrix[q * n + k];
+          matrix[p * n + k] = c * apk - s * aqk;
+          matrix[q * n + k] = s * apk + c * aqk;
+        }
+        for (int k = 0; k < n; ++k)
+        {
+          const double vkp = eigenvectors[k * n + p];
+          const double vkq = eigenvectors[k * n + q];
+          eigenvectors[k * n + p] = c * vkp - s * vkq;
+          eigenvectors[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  eigenvalues.resize(n);
+  for (int j = 0; j < n; ++j)
+    eigenvalues[j] = matrix[j * n + j];
+}
+
+bool Projection::parseMethod(const char* name, Method* method)
+{
+  if (strcmp(name, "pca") == 0) *method = kPca;
+  else if (strcmp(name, "random") == 0) *method = kRandom;
+  else return false;
+  return true;
+}
+
+const char* Projection::methodName(const Method method)
+{
+  return method == kPca ? "pca" : "random";
+}
@@ -0,0 +1,69 @@
+/*
+ * File:   Projection.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef PROJECTION_H
+#define	PROJECTION_H
+
+#include <vector>
+#include "FeatureMatrix.h"
+
+/**
+ * A linear map of the attributes to fewer dimensions, fitted on the training
+ * set and applied to every set, so the classifiers work on smaller rows:
+ *   pca     principal component analysis: the rows, centred on the training
+ *           mean, are projected on the eigenvectors of the training
+ *           covariance with the largest eigenvalues (a Jacobi eigen-solve)
+ *   random  sparse random projection (Achlioptas): each output is
+ *           sqrt(3 / dimensions) times a sum of about a third of the
+ *           attributes with random signs; distances are kept up to a small
+ *           distortion, and no fitting is needed
+ * The number of dimensions is given, or for pca chosen as the fewest
+ * components that explain the given share of the variance.
+ */
+class Projection
+{
+ public:
+  enum Method { kPca, kRandom };
+
+  // dimensions 0 picks them by explained_variance (pca only).
+  Projection(const Method method, const int dimensions,
+             const double explained_variance);
+  void fit(const FeatureMatrix& training_set);
+  // Writes the projection of every row of in to out (replacing its
+  // contents); the labels are kept.
+  void apply(const FeatureMatrix& in, FeatureMatrix* out) const;
+  int get_num_outputs() const { return num_outputs_; }
+  // Share of the training variance the outputs keep (pca only).
+  double get_explained_variance() const { return kept_variance_; }
+
+  // Reads "pca" or "random"; returns false for anything else.
+  static bool parseMethod(const char* name, Method* method);
+  static const char* methodName(const Method method);
+
+ private:
+  void fitPca(const FeatureMatrix& training_set);
+  void fitRandom();
+  static void eigenSolve(std::vector<double>& matrix, const int n,
+                         std::vector<double>& eigenvalues,
+                         std::vector<double>& eigenvectors);
+  Method method_;
+  int dimensions_;
+  double explained_variance_;
+  int num_inputs_;
+  int num_outputs_;
+  double kept_variance_;
+  std::vector<float> mean_;  // pca: per input.
+  std::vector<float> components_;  // pca: num_inputs_ per output, row-major.
+  // random: inputs added (positive) and subtracted (negative) by output o
+  // are those in [starts_[o], starts_[o + 1]) with their sign in signs_.
+  std::vector<int> starts_;
+  std::vector<int> inputs_;
+  std::vector<float> signs_;
+  float scale_;  // random: sqrt(3 / outputs).
+};
+
+#endif	/* PROJECTION_H */
@@ -0,0 +1,246 @@
+/*
+ * File:   PrototypeReducer.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "PrototypeReducer.h"
+#include <algorithm>  // min, max, sort
+#include <cstring>  // strcmp
+using namespace std;
+
+PrototypeReducer::PrototypeReducer(const int k, const Metric metric,
+                                   const int num_threads)
+    : k_(k), num_threads_(num_threads),
+      distance_(metricKernel(distanceKernels(), metric)),
+      distance_evaluations_(0) {}
+
+/**
+ * Reduces the training set to its prototypes (replacing any earlier contents
+ * of prototypes).
+ */
+void PrototypeReducer::reduce(const Method method,
+                              const FeatureMatrix& training_set,
+                              FeatureMatrix* prototypes)
+{
+  vector<int> rows(training_set.get_num_rows());
+  for (size_t i = 0; i < rows.size(); ++i)
+    rows[i] = i;
+  if (method == kEdited || method == kEditedCondensed)
+    rows = edit(training_set, rows);
+  if (method == kCondensed || method == kEditedCondensed)
+    rows = condense(training_set, rows);
+
+  FeatureMatrix reduced(training_set.get_num_features());
+  reduced.reserve(rows.size());
+  for (size_t i = 0; i < rows.size(); ++i)
+    reduced.appendRow(training_set, rows[i]);
+  prototypes->swap(reduced);
+}
+
+/**
+ * Wilson's editing: keeps the rows whose k nearest other rows (among rows)
+ * vote for their own class.
+ */
+vector<int> PrototypeReducer::edit(const FeatureMatrix& training_set,
+                                   const vector<int>& rows)
+{
+  vector<neighbour> results;
+  vector<int> counts;
+  search(training_set, rows, rows, k_, results, counts);
+  vector<int> kept;
+  for (size_t q = 0; q < rows.size(); ++q)
+  {
+    if (majority(&results[q * k_], counts[q]) == training_set.label(rows[q]))
+      kept.push_back(rows[q]);
+  }
+  return kept;
+}
+
+/**
+ * Hart's condensing: starts from the first row and adds every row that the
+ * nearest kept row misclassifies, passing over the rows until a pass adds
+ * none. Each pass finds the nearest among the rows kept before it with
+ * search(), then visits the rows in order, checking only the rows added so
+ * far in the pass, exactly as a sequential pass would.
+ */
+vector<int> PrototypeReducer::condense(const FeatureMatrix& training_set,
+                                       const vector<int>& rows)
+{
+  vector<int> kept;
+  if (rows.empty()) return kept;
+  vector<bool> is_kept(training_set.get_num_rows(), false);
+  kept.push_back(rows[0]);
+  is_kept[rows[0]] = true;
+  const int num_features = training_set.get_num_features();
+  bool added = true;
+  while (added)
+  {
+    added = false;
+    vector<int> queries;
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+      if (!is_kept[rows[i]]) queries.push_back(rows[i]);
+    }
+    vector<neighbour> results;
+    vector<int> counts;
+    search(training_set, queries, kept, 1, results, counts);
+    const size_t pass_start = kept.size();
+    for (size_t q = 0; q < queries.size(); ++q)
+    {
+      const float* query = training_set.row(queries[q]);
+      neighbour nearest = results[q];
+      for (size_t s = pass_start; s < kept.size(); ++s)
+      {
+        neighbour candidate;
+        candidate.distance = distance_(query, training_set.row(kept[s]),
+                                       num_features);
+        candidate.index = kept[s];
+        candidate.classification = training_set.label(kept[s]);
+        if (candidate < nearest) nearest = candidate;
+      }
+      distance_evaluations_ += kept.size() - pass_start;
+      if (nearest.classification != training_set.label(queries[q]))
+      {
+        kept.push_back(queries[q]);
+        is_kept[queries[q]] = true;
+        added = true;
+      }
+    }
+  }
+  sort(kept.begin(), kept.end());
+  return kept;
+}
+
+/**
+ * Finds the k nearest candidates of every query row (a row is not its own
+ * neighbour) on num_threads_ threads.
+ *
+ * @param results Receives k neighbours per query, nearest first.
+ * @param counts Receives the number of neighbours found per query (fewer
+ *               than k if there are too few candidates).
+ */
+void PrototypeReducer::search(const FeatureMatrix& training_set,
+                              const vector<int>& queries,
+                              const vector<int>& candidates, const int k,
+                              vector<neighbour>& results, vector<int>& counts)
+{
+  results.assign(queries.size() * k, neighbour());
+  counts.assign(queries.size(), 0);
+  SearchWork work;
+  work.reducer = this;
+  work.training_set = &training_set;
+  work.queries = &queries;
+  work.candidates = &candidates;
+  work.k = k;
+  work.results = &results;
+  work.counts = &counts;
+  work.next = 0;
+  work.distance_evaluations = 0;
+  pthread_mutex_init(&work.lock, NULL);
+  const int num_threads = max(1, min(num_threads_,
+                                     static_cast<int>(queries.size() +
+                                                      kRowChunk - 1) /
+                                     kRowChunk));
+  vector<pthread_t> threads(num_threads - 1);
+  for (size_t i = 0; i < threads.size(); ++i)
+    pthread_create(&threads[i], NULL, searchThread, &work);
+  searchThread(&work);
+  for (size_t i = 0; i < threads.size(); ++i)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&work.lock);
+  distance_evaluations_ += work.distance_evaluations;
+}
+
+/**
+ * Worker loop of search(): takes chunks of queries until none are left.
+ */
+void* PrototypeReducer::searchThread(void* search_work)
+{
+  SearchWork& work = *static_cast<SearchWork*>(search_work);
+  const FeatureMatrix& training_set = *work.training_set;
+  const vector<int>& queries = *work.queries;
+  const vector<int>& candidates = *work.candidates;
+  const int num_queries = queries.size();
+  const int num_features = training_set.get_num_features();
+  const DistanceFunction distance = work.reducer->distance_;
+  NeighbourList neighbours(work.k);
+  long distance_evaluations = 0;
+  for (;;)
+  {
+    pthread_mutex_lock(&work.lock);
+    const int start = work.next;
+    work.next = min(num_queries, start + kRowChunk);
+    pthread_mutex_unlock(&work.lock);
+    if (start >= num_queries) break;
+
+    for (int q = start; q < min(num_queries, start + kRowChunk); ++q)
+    {
+      const float* query = training_set.row(queries[q]);
+      neighbours.reset();
+      for (size_t c = 0; c < candidates.size(); ++c)
+      {
+        const int row = candidates[c];
+        if (row == queries[q]) continue;
+        neighbours.push(distance(query, training_set.row(row), num_features),
+                        row, training_set.label(row));
+        ++distance_evaluations;
+      }
+      neighbours.sort();
+      for (int i = 0; i < neighbours.size(); ++i)
+        (*work.results)[q * work.k + i] = neighbours[i];
+      (*work.counts)[q] = neighbours.size();
+    }
+  }
+  pthread_mutex_lock(&work.lock);
+  work.distance_evaluations += distance_evaluations;
+  pthread_mutex_unlock(&work.lock);
+  return NULL;
+}
+
+/**
+ * The class most of the neighbours (nearest first) belong to; a tie is won
+ * by the class whose member is nearest, as in NearestNeighbour. -1 if there
+ * are no neighbours.
+ */
+int PrototypeReducer::majority(const neighbour* neighbours, const int count)
+{
+  int majority_class = -1;
+  int majority_votes = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    int votes = 0;
+    for (int j = 0; j < count; ++j)
+    {
+      if (neighbours[j].classification == neighbours[i].classification)
+        ++votes;
+    }
+    if (votes > majority_votes)
+    {
+      majority_votes = votes;
+      majority_class = neighbours[i].classification;
+    }
+  }
+  return majority_class;
+}
+
+bool PrototypeReducer::parseMethod(const char* name, Method* method)
+{
+  if (strcmp(name, "enn") == 0) *method = kEdited;
+  else if (strcmp(name, "cnn") == 0) *method = kCondensed;
+  else if (strcmp(name, "enn+cnn") == 0) *method = kEditedCondensed;
+  else return false;
+  return true;
+}
+
+const char* PrototypeReducer::methodName(const Method method)
+{
+  switch (method)
+  {
+    case kEdited: return "enn";
+    case kCondensed: return "cnn";
+    case kEditedCondensed: return "enn+cnn";
+  }
+  return "?";
+}
@@ -0,0 +1,80 @@
+/*
+ * File:   PrototypeReducer.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef PROTOTYPEREDUCER_H
+#define	PROTOTYPEREDUCER_H
+
+#include <vector>
+#include <pthread.h>
+#include "FeatureMatrix.h"
+#include "NeighbourList.h"
+#include "DistanceKernels.h"
+
+/**
+ * Shrinks a training set to a smaller set of prototypes that classifies
+ * (nearly) as well, so every kNN query has fewer rows to search:
+ *   enn      Wilson's edited nearest neighbour: drops every example that the
+ *            majority of its k nearest other examples would misclassify
+ *            (noise and overlapping class borders)
+ *   cnn      Hart's condensed nearest neighbour: keeps only the examples the
+ *            1-NN rule over the kept ones would misclassify, passing over the
+ *            training set until none is added (drops interior points)
+ *   enn+cnn  editing followed by condensing, as Wilson suggested
+ * The prototypes keep their order in the training set. Searches are brute
+ * force over the float rows and are split over num_threads threads; the
+ * condensing passes search the prototypes kept at the start of a pass in
+ * parallel and only check the ones added during the pass in order, so the
+ * result is Hart's whatever the thread count.
+ */
+class PrototypeReducer
+{
+ public:
+  enum Method { kEdited, kCondensed, kEditedCondensed };
+
+  PrototypeReducer(const int k, const Metric metric, const int num_threads);
+  void reduce(const Method method, const FeatureMatrix& training_set,
+              FeatureMatrix* prototypes);
+  long get_distance_evaluations() const { return distance_evaluations_; }
+
+  // Reads "enn", "cnn" or "enn+cnn"; returns false for anything else.
+  static bool parseMethod(const char* name, Method* method);
+  static const char* methodName(const Method method);
+
+ private:
+  static const int kRowChunk = 16;  // Rows a search thread takes at once.
+  // Shared state of the threads of one search() call.
+  struct SearchWork
+  {
+    const PrototypeReducer* reducer;
+    const FeatureMatrix* training_set;
+    const std::vector<int>* queries;  // Rows to find the neighbours of.
+    const std::vector<int>* candidates;  // Rows to search among.
+    int k;
+    std::vector<neighbour>* results;  // k per query, nearest first.
+    std::vector<int>* counts;  // Neighbours found per query.
+    pthread_mutex_t lock;  // Guards next and distance_evaluations.
+    int next;  // First query not yet handed out.
+    long distance_evaluations;
+  };
+  static void* searchThread(void* search_work);
+  void search(const FeatureMatrix& training_set,
+              const std::vector<int>& queries,
+              const std::vector<int>& candidates, const int k,
+              std::vector<neighbour>& results, std::vector<int>& counts);
+  std::vector<int> edit(const FeatureMatrix& training_set,
+                        const std::vector<int>& rows);
+  std::vector<int> condense(const FeatureMatrix& training_set,
+                            const std::vector<int>& rows);
+  static int majority(const neighbour* neighbours, const int count);
+
+  int k_;
+  int num_threads_;
+  DistanceFunction distance_;
+  long distance_evaluations_;  // Over all reduce() calls.
+};
+
+#endif	/* PROTOTYPEREDUCER_H */
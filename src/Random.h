@@ -0,0 +1,44 @@
+/*
+ * File:   Random.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef RANDOM_H
+#define	RANDOM_H
+
+#include <cmath>
+
+/**
+ * Small linear congruential generator for the k-NN engines.
+ * Each user keeps its own generator with a fixed seed, so an index comes out
+ * the same on every run and rand() (which drives the ANN) is left alone.
+ */
+class Random
+{
+ public:
+  explicit Random(const unsigned long long seed) : state_(seed) {}
+
+  // Uniform in [0, 1).
+  double uniform()
+  {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (state_ >> 11) / 9007199254740992.0;
+  }
+
+  // Standard normal (Box-Muller; the second value is thrown away).
+  double gaussian()
+  {
+    const double u = 1.0 - uniform();  // In (0, 1], so the log is finite.
+    return std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * M_PI * uniform());
+  }
+
+  // Standard Cauchy.
+  double cauchy() { return std::tan(M_PI * (uniform() - 0.5)); }
+
+ private:
+  unsigned long long state_;
+};
+
+#endif	/* RANDOM_H */
@@ -0,0 +1,288 @@
+/*
+ * File:   ShardedScan.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "ShardedScan.h"
+#include "NearestNeighbour.h"
+#include "NeighbourList.h"
+#include "KnnIndex.h"  // SearchStats
+#include <cstdlib>  // abort, atoi
+#include <iostream>
+#include <errno.h>
+#include <dirent.h>  // opendir
+#include <sys/socket.h>  // socketpair
+#include <sys/wait.h>  // waitpid
+#include <unistd.h>  // fork, close, read, write
+using namespace std;
+
+ShardedScan::ShardedScan(const int num_shards, const int k,
+                         const int num_attributes, const int num_classes,
+                         const KnnParameters& parameters)
+    : num_shards_(num_shards < 1 ? 1 : num_shards), k_(k),
+      num_attributes_(num_attributes), num_classes_(num_classes),
+      parameters_(parameters)
+{
+  // A worker runs the engine on its own, in one thread.
+  parameters_.num_shards = 1;
+  parameters_.num_threads = 1;
+  parameters_.recall_report = false;
+  pthread_mutex_init(&lock_, NULL);
+}
+
+ShardedScan::~ShardedScan()
+{
+  stop();
+  pthread_mutex_destroy(&lock_);
+}
+
+/**
+ * Forks one worker per shard (replacing any earlier workers). Shard s holds
+ * the rows [s * N / shards, (s + 1) * N / shards) of the N training rows.
+ */
+void ShardedScan::build(const FeatureMatrix& training_set)
+{
+  stop();
+  const int size = training_set.get_num_rows();
+  cout.flush();  // Or the workers inherit (and might repeat) pending output.
+  cerr.flush();
+  for (int s = 0; s < num_shards_; ++s)
+  {
+    const int begin = static_cast<long>(size) * s / num_shards_;
+    const int end = static_cast<long>(size) * (s + 1) / num_shards_;
+    int ends[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0)
+    {
+      cerr << "(!) Unable to create the socket of kNN shard " << s << "\n";
+      abort();
+    }
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+      cerr << "(!) Unable to start the worker of kNN shard " << s << "\n";
+      abort();
+    }
+    if (pid == 0)
+    {
+      // Keep only the standard streams and this worker's socket, so that
+      // every other worker sees its socket close with the coordinator.
+      DIR* descriptors = opendir("/proc/self/fd");
+      vector<int> inherited;
+      if (descriptors != NULL)
+      {
+        const int listing = dirfd(descriptors);
+        for (dirent* entry = readdir(descriptors); entry != NULL;
+             entry = readdir(descriptors))
+        {
+          const int descriptor = atoi(entry->d_name);
+          if (descriptor > 2 && descriptor != ends[1] &&
+              descriptor != listing && entry->d_name[0] != '.')
+            inherited.push_back(descriptor);
+        }
+        closedir(descriptors);
+      }
+      for (size_t i = 0; i < inherited.size(); ++i)
+        close(inherited[i]);
+
+      FeatureMatrix shard(training_set.get_num_features());
+      shard.reserve(end - begin);
+      for (int i = begin; i < end; ++i)
+        shard.appendRow(training_set, i);
+      serve(ends[1], shard, begin, k_, num_attributes_, num_classes_,
+            parameters_);
+      _exit(0);  // Not exit(): the coordinator's state is not ours to free.
+    }
+    close(ends[1]);
+    sockets_.push_back(ends[0]);
+    workers_.push_back(pid);
+  }
+}
+
+/**
+ * Closes the sockets, which ends the workers, and waits for them.
+ */
+void ShardedScan::stop()
+{
+  for (size_t s = 0; s < sockets_.size(); ++s)
+    close(sockets_[s]);
+  for (size_t s = 0; s < workers_.size(); ++s)
+    waitpid(workers_[s], NULL, 0);
+  sockets_.clear();
+  workers_.clear();
+}
+
+void ShardedScan::search(const FeatureMatrix& queries, const int begin,
+                         const int end, vector<NeighbourList>& lists,
+                         SearchStats& stats) const
+{
+  const int count = end - begin;
+  vector<const float*> rows(count);
+  vector<NeighbourList*> targets(count);
+  for (int i = 0; i < count; ++i)
+  {
+    rows[i] = queries.row(begin + i);
+    targets[i] = &lists[i];
+  }
+  if (count > 0) scatterGather(&rows[0], count, &targets[0], stats);
+}
+
+void ShardedScan::search(const float* query, NeighbourList& neighbours,
+                         SearchStats& stats) const
+{
+  NeighbourList* target = &neighbours;
+  scatterGather(&query, 1, &target, stats);
+}
+
+/**
+ * Sends the queries to every worker, then merges the workers' neighbours
+ * into the lists (reset here; the capacity of the first is the k asked of
+ * the workers).
+ */
+void ShardedScan::scatterGather(const float* const* queries, const int count,
+                                NeighbourList* const* lists,
+                                SearchStats& stats) const
+{
+  const int header[2] = { count, lists[0]->capacity() };
+  vector<float> batch(static_cast<size_t>(count) * num_attributes_);
+  for (int i = 0; i < count; ++i)
+  {
+    for (int j = 0; j < num_attributes_; ++j)
+      batch[static_cast<size_t>(i) * num_attributes_ + j] = queries[i][j];
+    lists[i]->reset();
+  }
+
+  pthread_mutex_lock(&lock_);
+  // Every worker gets the whole batch before any answer is read, so the
+  // shards search in parallel.
+  for (size_t s = 0; s < sockets_.size(); ++s)
+  {
+    if (!writeAll(sockets_[s], header, sizeof(header)) ||
+        !writeAll(sockets_[s], &batch[0], sizeof(float) * batch.size()))
+      fail(s, "did not take its queries");
+  }
+  vector<WireNeighbour> found;
+  for (size_t s = 0; s < sockets_.size(); ++s)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      int size;
+      if (!readAll(sockets_[s], &size, sizeof(size)) || size < 0 ||
+          size > header[1])
+        fail(s, "did not answer");
+      found.resize(size);
+      if (size > 0 &&
+          !readAll(sockets_[s], &found[0], sizeof(WireNeighbour) * size))
+        fail(s, "did not answer");
+      for (int n = 0; n < size; ++n)
+        lists[i]->push(found[n].distance, found[n].index,
+                       found[n].classification);
+    }
+    WireStats worker;
+    if (!readAll(sockets_[s], &worker, sizeof(worker)))
+      fail(s, "did not answer");
+    stats.distance_evaluations += worker.distance_evaluations;
+    stats.nodes_visited += worker.nodes_visited;
+    stats.candidates += worker.candidates;
+    stats.features_examined += worker.features_examined;
+  }
+  pthread_mutex_unlock(&lock_);
+  stats.queries += count;
+}
+
+void ShardedScan::fail(const int shard, const char* what) const
+{
+  cerr << "(!) The worker of kNN shard " << shard << " (process "
+       << workers_[shard] << ") " << what << "\n";
+  abort();
+}
+
+/**
+ * Worker loop: builds the engine on the shard and answers batches until the
+ * coordinator closes the socket. A batch may ask for more than k
+ * neighbours (the engines do not depend on k).
+ *
+ * @param offset Row of the shard's first row in the whole training set.
+ */
+void ShardedScan::serve(const int socket, const FeatureMatrix& shard,
+                        const int offset, const int k,
+                        const int num_attributes, const int num_classes,
+                        const KnnParameters& parameters)
+{
+  NearestNeighbour knn(k, num_attributes, num_classes, parameters);
+  knn.set_report(false);
+  knn.buildIndex(shard);
+  FeatureMatrix queries(num_attributes);
+  vector<float> row(num_attributes + 1);
+  vector<WireNeighbour> found;
+  int header[2];
+  while (readAll(socket, header, sizeof(header)))
+  {
+    const int count = header[0];
+    const int wanted = header[1];
+    queries.clear();
+    queries.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+      if (!readAll(socket, &row[0], sizeof(float) * num_attributes)) return;
+      queries.appendRow(&row[0], 0);
+    }
+    vector<NeighbourList> lists(count, NeighbourList(wanted));
+    SearchStats stats;
+    knn.findNeighbours(queries, 0, count, lists, stats);
+    for (int i = 0; i < count; ++i)
+    {
+      const int size = lists[i].size();
+      found.resize(size);
+      for (int n = 0; n < size; ++n)
+      {
+        found[n].distance = lists[i][n].distance;
+        found[n].index = offset + lists[i][n].index;
+        found[n].classification = lists[i][n].classification;
+      }
+      if (!writeAll(socket, &size, sizeof(size)) ||
+          (size > 0 &&
+           !writeAll(socket, &found[0], sizeof(WireNeighbour) * size)))
+        return;
+    }
+    WireStats totals;
+    totals.distance_evaluations = stats.distance_evaluations;
+    totals.nodes_visited = stats.nodes_visited;
+    totals.candidates = stats.candidates;
+    totals.features_examined = stats.features_examined;
+    if (!writeAll(socket, &totals, sizeof(totals))) return;
+  }
+}
+
+bool ShardedScan::readAll(const int socket, void* data, const size_t bytes)
+{
+  char* next = static_cast<char*>(data);
+  size_t left = bytes;
+  while (left > 0)
+  {
+    const ssize_t got = read(socket, next, left);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) return false;  // Closed or failed.
+    next += got;
+    left -= got;
+  }
+  return true;
+}
+
+bool ShardedScan::writeAll(const int socket, const void* data,
+                           const size_t bytes)
+{
+  const char* next = static_cast<const char*>(data);
+  size_t left = bytes;
+  while (left > 0)
+  {
+    // MSG_NOSIGNAL: a dead peer is an error here, not a SIGPIPE.
+    const ssize_t sent = send(socket, next, left, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) return false;
+    next += sent;
+    left -= sent;
+  }
+  return true;
+}
@@ -0,0 +1,98 @@
+/*
+ * File:   ShardedScan.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef SHARDEDSCAN_H
+#define	SHARDEDSCAN_H
+
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>  // pid_t
+#include "FeatureMatrix.h"
+#include "knn_parameters.h"
+
+class NeighbourList;
+struct SearchStats;
+
+/**
+ * kNN over a training set split into shards, each owned by a worker
+ * process. The workers are forked by build() and talk to this process (the
+ * coordinator) over a Unix socket pair each. A worker copies its
+ * contiguous share of the rows, builds the configured engine on it like a
+ * single-process NearestNeighbour and then answers batches of queries with
+ * the k nearest of its rows. The coordinator scatters every batch to all
+ * the workers and merges their lists into the global k nearest.
+ *
+ * Rows are reported by their row in the whole training set and each
+ * distance is computed by the same kernel as without shards, so with an
+ * exact engine the merged neighbours (ties included) and therefore the
+ * votes are exactly those of the single-process run.
+ *
+ * A worker that exits (or closes its socket) is an error: the coordinator
+ * reports which shard failed and aborts. There is no timeout, so a worker
+ * that hangs without exiting also stalls the coordinator.
+ *
+ * Messages (in the byte order of the machine):
+ *   request   int count, int k, then count rows of num_features floats
+ *   response  per query an int n and n WireNeighbours, then a WireStats
+ * A worker exits when its socket is closed.
+ */
+class ShardedScan
+{
+ public:
+  ShardedScan(const int num_shards, const int k, const int num_attributes,
+              const int num_classes, const KnnParameters& parameters);
+  ~ShardedScan();
+  void build(const FeatureMatrix& training_set);
+  // Fills lists[0, end - begin) (reset here) with the nearest neighbours of
+  // queries begin to end - 1. Safe to call from several threads; the
+  // batches are sent one at a time.
+  void search(const FeatureMatrix& queries, const int begin, const int end,
+              std::vector<NeighbourList>& lists, SearchStats& stats) const;
+  // The same for one query.
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  int get_num_shards() const { return sockets_.size(); }
+
+ private:
+  struct WireNeighbour
+  {
+    double distance;
+    int index;  // Row in the whole training set.
+    int classification;
+  };
+  struct WireStats  // SearchStats without the query count.
+  {
+    long distance_evaluations;
+    long nodes_visited;
+    long candidates;
+    long features_examined;
+  };
+  void scatterGather(const float* const* queries, const int count,
+                     NeighbourList* const* lists, SearchStats& stats) const;
+  void fail(const int shard, const char* what) const;
+  void stop();
+  static void serve(const int socket, const FeatureMatrix& shard,
+                    const int offset, const int k, const int num_attributes,
+                    const int num_classes, const KnnParameters& parameters);
+  static bool readAll(const int socket, void* data, const size_t bytes);
+  static bool writeAll(const int socket, const void* data,
+                       const size_t bytes);
+
+  int num_shards_;
+  int k_;
+  int num_attributes_;
+  int num_classes_;
+  KnnParameters parameters_;  // For the workers' engines.
+  std::vector<int> sockets_;  // Coordinator end, one per worker.
+  std::vector<pid_t> workers_;
+  mutable pthread_mutex_t lock_;  // One batch on the sockets at a time.
+
+  ShardedScan(const ShardedScan&);
+  void operator=(const ShardedScan&);
+};
+
+#endif	/* SHARDEDSCAN_H */
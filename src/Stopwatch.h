@@ -0,0 +1,31 @@
+/*
+ * File:   Stopwatch.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef STOPWATCH_H
+#define	STOPWATCH_H
+
+#include <sys/time.h>  // gettimeofday
+#include <cstddef>
+
+// Measures wall-clock time since construction (or the last restart()).
+class Stopwatch
+{
+ public:
+  Stopwatch() { restart(); }
+  void restart() { gettimeofday(&start_, NULL); }
+  double seconds() const
+  {
+    timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start_.tv_sec) + (now.tv_usec - start_.tv_usec) / 1e6;
+  }
+
+ private:
+  timeval start_;
+};
+
+#endif	/* STOPWATCH_H */
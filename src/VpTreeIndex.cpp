@@ -0,0 +1,258 @@
+/*
+ * File:   VpTreeIndex.cpp
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#include "VpTreeIndex.h"
+#include "NeighbourList.h"
+#include "IndexBlob.h"
+#include <algorithm>  // nth_element, max
+#include <cstdlib>  // abort
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// Relative slack on the pruning radius. It absorbs rounding in the bounds
+// (square roots, differences), so pruning never changes the exact answer.
+const double kPruneSlack = 1e-9;
+
+}  // namespace
+
+VpTreeIndex::VpTreeIndex(const int leaf_size, const Metric metric)
+    : leaf_size_(leaf_size < 1 ? 1 : leaf_size), num_features_(0),
+      metric_(metric), distance_(metricKernel(distanceKernels(), metric))
+{
+  if (metric == kCosine)
+  {
+    std::cerr << "(!) The vptree engine needs a true metric; cosine distance "
+         << "breaks the triangle inequality\n";
+    abort();
+  }
+}
+
+/**
+ * Builds the tree over the whole training set.
+ *
+ * @param training_set The labeled examples to index.
+ */
+void VpTreeIndex::build(const FeatureMatrix& training_set)
+{
+  num_features_ = training_set.get_num_features();
+  const int size = training_set.get_num_rows();
+  std::vector<Candidate> candidates(size);
+  for (int i = 0; i < size; ++i)
+  {
+    candidates[i].distance = 0.0;
+    candidates[i].row = i;
+  }
+  left_.clear();
+  right_.clear();
+  begin_.clear();
+  end_.clear();
+  nearest_.clear();
+  furthest_.clear();
+  buildNode(training_set, candidates, 0, size);
+
+  rows_.resize(size);
+  points_ = FeatureMatrix(num_features_);
+  points_.reserve(size);
+  for (int i = 0; i < size; ++i)
+  {
+    rows_[i] = candidates[i].row;
+    points_.appendRow(training_set, rows_[i]);
+  }
+}
+
+bool VpTreeIndex::save(IndexBlobWriter& out) const
+{
+  out.value(num_features_);
+  out.array(rows_);
+  out.array(left_);
+  out.array(right_);
+  out.array(begin_);
+  out.array(end_);
+  out.array(nearest_);
+  out.array(furthest_);
+  return true;
+}
+
+/**
+ * Reads a tree written by save() and copies the training rows into tree
+ * order.
+ */
+bool VpTreeIndex::restore(IndexBlobReader& in,
+                          const FeatureMatrix& training_set)
+{
+  num_features_ = in.value<int>();
+  in.array(rows_);
+  in.array(left_);
+  in.array(right_);
+  in.array(begin_);
+  in.array(end_);
+  in.array(nearest_);
+  in.array(furthest_);
+  const int size = training_set.get_num_rows();
+  const size_t nodes = left_.size();
+  if (!in.ok() || num_features_ != training_set.get_num_features() ||
+      static_cast<int>(rows_.size()) != size || right_.size() != nodes ||
+      begin_.size() != nodes || end_.size() != nodes ||
+      nearest_.size() != nodes || furthest_.size() != nodes)
+    return false;
+  for (size_t node = 0; node < nodes; ++node)
+  {
+    if (left_[node] >= static_cast<int>(nodes) ||
+        right_[node] >= static_cast<int>(nodes) || begin_[node] < 0 ||
+        end_[node] > size || begin_[node] > end_[node])
+      return false;
+  }
+
+  points_ = FeatureMatrix(num_features_);
+  points_.reserve(size);
+  for (int i = 0; i < size; ++i)
+  {
+    if (rows_[i] < 0 || rows_[i] >= size) return false;
+    points_.appendRow(training_set, rows_[i]);
+  }
+  return true;
+}
+
+/**
+ * Creates the node for candidates[begin, end). Internal nodes take the row
+ * furthest from the first one as their vantage point (a cheap way to find a
+ * point near the edge of the data) and split the rest at the median distance.
+ *
+ * @return The number of the new node.
+ */
+int VpTreeIndex::buildNode(const FeatureMatrix& training_set,
+                           std::vector<Candidate>& candidates,
+                           const int begin, const int end)
+{
+  const int node = static_cast<int>(left_.size());
+  left_.push_back(-1);
+  right_.push_back(-1);
+  begin_.push_back(begin);
+  end_.push_back(end);
+  nearest_.push_back(0.0);
+  furthest_.push_back(std::numeric_limits<double>::infinity());
+
+  if (end - begin <= leaf_size_)
+    return node;
+
+  // Choose the vantage point and move it to the front of the node.
+  const float* first = training_set.row(candidates[begin].row);
+  int vantage = begin;
+  double vantage_distance = -1.0;
+  for (int i = begin; i < end; ++i)
+  {
+    double d = distance_(first, training_set.row(candidates[i].row),
+                         num_features_);
+    if (d > vantage_distance)
+    {
+      vantage_distance = d;
+      vantage = i;
+    }
+  }
+  std::swap(candidates[begin], candidates[vantage]);
+
+  const float* vantage_point = training_set.row(candidates[begin].row);
+  for (int i = begin + 1; i < end; ++i)
+  {
+    candidates[i].distance = metricDistance(
+        distance_(vantage_point, training_set.row(candidates[i].row),
+                  num_features_));
+  }
+
+  // Inner child: [begin + 1, middle), outer child: [middle, end).
+  const int middle = begin + 1 + (end - begin - 1) / 2;
+  std::nth_element(candidates.begin() + begin + 1, candidates.begin() + middle,
+                   candidates.begin() + end);
+  double bounds[4] = { std::numeric_limits<double>::infinity(), 0.0,
+                       std::numeric_limits<double>::infinity(), 0.0 };
+  for (int i = begin + 1; i < end; ++i)
+  {
+    double* child_bounds = i < middle ? bounds : bounds + 2;
+    child_bounds[0] = std::min(child_bounds[0], candidates[i].distance);
+    child_bounds[1] = std::max(child_bounds[1], candidates[i].distance);
+  }
+
+  int inner = buildNode(training_set, candidates, begin + 1, middle);
+  int outer = buildNode(training_set, candidates, middle, end);
+  left_[node] = inner;
+  right_[node] = outer;
+  nearest_[inner] = bounds[0];
+  furthest_[inner] = bounds[1];
+  nearest_[outer] = bounds[2];
+  furthest_[outer] = bounds[3];
+  return node;
+}
+
+/**
+ * Finds the k nearest training rows to the query.
+ */
+void VpTreeIndex::search(const float* query, NeighbourList& neighbours,
+                         SearchStats& stats) const
+{
+  ++stats.queries;
+  if (!left_.empty())
+    searchNode(0, query, neighbours, stats);
+}
+
+/**
+ * Depth-first search that visits the child whose distance range holds the
+ * query first, and skips a child the triangle inequality rules out.
+ */
+void VpTreeIndex::searchNode(const int node, const float* query,
+                             NeighbourList& neighbours,
+                             SearchStats& stats) const
+{
+  ++stats.nodes_visited;
+  if (left_[node] < 0)  // Leaf: scan its rows.
+  {
+    for (int i = begin_[node]; i < end_[node]; ++i)
+    {
+      neighbours.push(distance_(query, points_.row(i), num_features_),
+                      rows_[i], points_.label(i));
+    }
+    stats.distance_evaluations += end_[node] - begin_[node];
+    return;
+  }
+
+  const int vantage = begin_[node];
+  double ranking_distance = distance_(query, points_.row(vantage),
+                                      num_features_);
+  neighbours.push(ranking_distance, rows_[vantage], points_.label(vantage));
+  ++stats.distance_evaluations;
+  const double d = metricDistance(ranking_distance);
+
+  int children[2] = { left_[node], right_[node] };
+  if (d >= nearest_[children[1]])  // The query lies in the outer shell.
+    std::swap(children[0], children[1]);
+  for (int i = 0; i < 2; ++i)
+  {
+    const int child = children[i];
+    if (begin_[child] == end_[child]) continue;
+    double lower_bound = std::max(d - furthest_[child], nearest_[child] - d);
+    if (lower_bound <= radius(neighbours))
+      searchNode(child, query, neighbours, stats);
+  }
+}
+
+/**
+ * Converts a ranking distance from the kernel into a true metric distance
+ * (the kernel gives squared distances for the Euclidean metric).
+ */
+double VpTreeIndex::metricDistance(const double ranking_distance) const
+{
+  return ::metricDistance(metric_, ranking_distance);
+}
+
+/**
+ * The metric distance to the current k-th neighbour, plus slack.
+ */
+double VpTreeIndex::radius(const NeighbourList& neighbours) const
+{
+  return metricDistance(neighbours.threshold()) * (1 + kPruneSlack);
+}
@@ -0,0 +1,75 @@
+/*
+ * File:   VpTreeIndex.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ */
+
+#ifndef VPTREEINDEX_H
+#define	VPTREEINDEX_H
+
+#include <vector>
+#include "KnnIndex.h"
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"
+
+/**
+ * Exact k-nearest neighbour search with a vantage-point tree.
+ * Each internal node picks one of its rows as the vantage point and splits
+ * the others at the median distance to it into an inner and an outer child.
+ * The children remember the range of distances to the vantage point, so by
+ * the triangle inequality a child can be skipped when
+ *   max(d(q, vp) - furthest, nearest - d(q, vp)) > d(q, k-th neighbour).
+ * Only the triangle inequality is used, so any metric works (Euclidean,
+ * Manhattan, Hamming), regardless of the number of attributes.
+ *
+ * Like KdTreeIndex, nodes are flat arrays and rows are stored in tree order.
+ */
+class VpTreeIndex : public KnnIndex
+{
+ public:
+  VpTreeIndex(const int leaf_size, const Metric metric);
+  const char* name() const { return "vptree"; }
+  void build(const FeatureMatrix& training_set);
+  void search(const float* query, NeighbourList& neighbours,
+              SearchStats& stats) const;
+  bool save(IndexBlobWriter& out) const;
+  bool restore(IndexBlobReader& in, const FeatureMatrix& training_set);
+  int get_num_nodes() const { return static_cast<int>(left_.size()); }
+
+ private:
+  struct Candidate  // A row and its distance to the current vantage point.
+  {
+    double distance;
+    int row;
+    bool operator<(const Candidate& other) const
+    {
+      return distance < other.distance;
+    }
+  };
+  int buildNode(const FeatureMatrix& training_set,
+                std::vector<Candidate>& candidates, const int begin,
+                const int end);
+  void searchNode(const int node, const float* query,
+                  NeighbourList& neighbours, SearchStats& stats) const;
+  double metricDistance(const double ranking_distance) const;
+  double radius(const NeighbourList& neighbours) const;
+  int leaf_size_;
+  int num_features_;
+  Metric metric_;
+  DistanceFunction distance_;  // Ranking distance (squared for Euclidean).
+  FeatureMatrix points_;  // The training rows in tree order.
+  std::vector<int> rows_;  // Training set row of each row in points_.
+  // One entry per node. Internal nodes store their vantage point in
+  // points_[begin_]; leaves (left_ == -1) scan points_[begin_, end_).
+  std::vector<int> left_;
+  std::vector<int> right_;
+  std::vector<int> begin_;
+  std::vector<int> end_;
+  // Range of metric distances from the parent's vantage point to the rows
+  // under each node.
+  std::vector<double> nearest_;
+  std::vector<double> furthest_;
+};
+
+#endif	/* VPTREEINDEX_H */
@@ -1,4 +1,11 @@
 #!/usr/bin/env bash
 
-gcc -O3 -c Neurode.cpp Layer.cpp NeuralNet.cpp
-g++ main.cpp -O3 NeuralNet.o Neurode.o Layer.o -g
+# The same sources and flags as the Makefile.
+SOURCES="FeatureMatrix.cpp KnnIndexFile.cpp BitPackedMatrix.cpp BatchedScan.cpp
+ShardedScan.cpp EngineCalibration.cpp CompressedMatrix.cpp DistanceKernels.cpp
+KdTreeIndex.cpp VpTreeIndex.cpp LaesaIndex.cpp CascadeIndex.cpp HnswIndex.cpp
+KMeans.cpp IvfPqIndex.cpp LshIndex.cpp PrototypeReducer.cpp Projection.cpp
+Layer.cpp NeuralNet.cpp NearestNeighbour.cpp"
+
+g++ -Wall -O3 -g -pthread -c $SOURCES
+g++ main.cpp -Wall -O3 -g -pthread ${SOURCES//.cpp/.o} -o ann-vs-knn
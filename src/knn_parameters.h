@@ -0,0 +1,104 @@
+/*
+ * File:   knn_parameters.h
+ * Author: Dennis Ideler <di07ty at brocku.ca>
+ *
+ * Created on May 2012
+ *
+ * Passive structure with the settings of the k-NN search engines.
+ * Set from the command line in main.cpp; see README.txt.
+ */
+
+#ifndef KNN_PARAMETERS_H
+#define	KNN_PARAMETERS_H
+
+#include <string>
+#include <vector>
+#include "DistanceKernels.h"  // Metric
+
+// How the k nearest neighbours elect a class.
+enum Vote
+{
+  kMajority,  // One vote each.
+  kInverseDistance  // Each vote weighted by 1 / distance.
+};
+
+struct KnnParameters
+{
+  // Which search engine answers the queries:
+  //   brute   scan every training row (the default)
+  //   kdtree  exact KD-tree, best on low-dimensional data
+  //   vptree  exact vantage-point tree, for any metric
+  //   laesa   exact scan pruned by precomputed distances to pivot rows
+  //   hnsw    approximate hierarchical navigable small world graph
+  //   ivfpq   approximate inverted file over product-quantized rows
+  //   lsh     approximate multi-table locality sensitive hashing
+  //   cascade approximate: rank on a few attributes, re-rank the best
+  //   auto    the fastest exact engine, timed when the model is built
+  std::string engine;
+  Metric metric;  // Distance the neighbours are ranked by.
+  Vote vote;  // How the neighbours elect the classification.
+  int leaf_size;  // Maximum rows in a tree leaf.
+  int num_pivots;  // Pivot rows of the laesa engine.
+  int hnsw_m;  // Links per node and level (2M on level 0).
+  int ef_construction;  // Candidate queue size while building the graph.
+  int ef_search;  // Candidate queue size while querying.
+  int nlist;  // Inverted lists; 0 for sqrt(training rows).
+  int nprobe;  // Inverted lists visited per query.
+  int pq_subquantizers;  // Code bytes per row; 0 for features / 4.
+  int rerank;  // Candidates re-scored with the exact distance; 0 for none.
+              // Used by ivfpq and by reduced-precision storage.
+  int lsh_tables;  // Hash tables.
+  int lsh_bits;  // Hash functions per table.
+  double lsh_width;  // Bucket width of the p-stable hashes; 0 to estimate.
+  int lsh_probes;  // Buckets visited per table.
+  std::vector<int> cascade_columns;  // First-stage attributes (from 0).
+  int cascade_factor;  // Rows re-ranked on all attributes per neighbour.
+  std::string storage;  // Training rows for brute: float, fp16 or int8.
+  bool bit_pack;  // Scan binary attributes as packed bits (brute only).
+  bool early_abandon;  // Stop summing rows that cannot be among the k.
+  bool variance_order;  // Sum the attributes by decreasing variance.
+  // Anytime queries (brute only): each query scans the rows in a fixed
+  // representative order until one of these budgets (0 for none) runs out.
+  long anytime_budget;  // Distance evaluations per query.
+  double anytime_deadline;  // Microseconds per query.
+  std::string anytime_order;  // "class" (stratified) or "cluster".
+  std::vector<bool> binary_columns;  // Set by the loader: 0/1 attributes.
+  int batch_size;  // Queries scanned together (brute, euclidean); 0 for one.
+  int num_threads;  // Threads used to build indexes and to test.
+  int num_shards;  // Worker processes owning a part of the training set.
+  bool recall_report;  // Compare an approximate engine with brute force.
+
+  KnnParameters()  // Set default values.
+  {
+    engine = "brute";
+    metric = kEuclidean;
+    vote = kMajority;
+    leaf_size = 16;
+    num_pivots = 16;
+    hnsw_m = 16;
+    ef_construction = 200;
+    ef_search = 50;
+    nlist = 0;
+    nprobe = 4;
+    pq_subquantizers = 0;
+    rerank = 0;
+    lsh_tables = 8;
+    lsh_bits = 8;
+    lsh_width = 0.0;
+    lsh_probes = 1;
+    cascade_factor = 4;
+    storage = "float";
+    bit_pack = true;
+    early_abandon = false;
+    variance_order = false;
+    anytime_budget = 0;
+    anytime_deadline = 0.0;
+    anytime_order = "class";
+    batch_size = 0;
+    num_threads = 1;
+    num_shards = 1;
+    recall_report = false;
+  }
+};
+
+#endif	/* KNN_PARAMETERS_H */
@@ -19,15 +19,25 @@
 #include <cstdio>
 #include <limits>  // numeric_limits
 #include <sstream>  // stringstream
-#include <algorithm>  // random_shuffle
+#include <algorithm>  // random_shuffle, count
 #include <deque>
 #include <cassert>
 #include <vector>
 #include <cmath>
 #include <iostream>
 #include <unistd.h>  // getopt
+#include <getopt.h>  // getopt_long
 #include "NeuralNet.h"
 #include "NearestNeighbour.h"
+#include "FeatureMatrix.h"
+#include "DistanceKernels.h"
+#include "knn_parameters.h"
+#include "CompressedMatrix.h"
+#include "KnnIndexFile.h"
+#include "PrototypeReducer.h"
+#include "Projection.h"
+#include "CascadeIndex.h"
+#include "Stopwatch.h"
 using namespace std;
 
 // NOTE: Remember to use -> when referencing a pointer to an object.
@@ -48,6 +58,16 @@ struct UserParameters
   int training_ratio;
   int seed;
   int k;
+  int stream_percent;  // kNN training examples inserted after the build.
+  int stream_remove_percent;  // kNN examples removed while streaming.
+  int k_sweep;  // Largest k scored by the kNN sweep; 0 for no sweep.
+  bool leave_one_out;  // Score the kNN sweep by leave-one-out as well.
+  bool reduce;  // Search kNN prototypes of the training set instead.
+  PrototypeReducer::Method reduction;  // How prototypes are chosen.
+  bool project;  // Project the attributes to fewer dimensions.
+  Projection::Method projection;
+  int dimensions;  // Projected attributes; 0 to go by explained_variance.
+  double explained_variance;  // Share of the variance PCA keeps.
   string learning_rule;
   string hidden_activation_function;
   string output_activation_function;
@@ -55,6 +75,8 @@ struct UserParameters
   bool plot;  // Graph data.
   bool verbose;  // Display each classification attempt.
   bool output;  // Output accuracy every epoch.
+  bool float_accumulation;  // Sum kNN distances in single precision.
+  KnnParameters knn;  // Search engine settings for kNN.
   
   UserParameters()  // Set default values.
   {
@@ -70,6 +92,16 @@ struct UserParameters
     training_ratio = 80;
     seed = time(NULL);
     k = 3;
+    stream_percent = 0;
+    stream_remove_percent = 0;
+    k_sweep = 0;
+    leave_one_out = false;
+    reduce = false;
+    reduction = PrototypeReducer::kEditedCondensed;
+    project = false;
+    projection = Projection::kPca;
+    dimensions = 0;
+    explained_variance = 0.95;
     learning_rule = "backprop";
     hidden_activation_function = "logistic";
     output_activation_function = "logistic";
@@ -77,6 +109,7 @@ struct UserParameters
     plot = false;
     verbose = false;
     output = false;
+    float_accumulation = false;
   }
 } params;  // A global struct object is much easier than passing many args.
 
@@ -138,8 +171,8 @@ void appendData(const string file_name, const double accuracy)
  */
 void runNeuralNetwork(string error_filename, string accuracy_filename,
                       string test_accuracy_filename,
-                      vector< vector<float> > training_set,
-                      vector< vector<float> > testing_set)
+                      const FeatureMatrix& training_set,
+                      const FeatureMatrix& testing_set)
 {
   //  Construct the Artificial Neural Net and initialize weighted connections.
   NeuralNet* ann = new NeuralNet(params.num_features,
@@ -181,17 +214,114 @@ void runNeuralNetwork(string error_filename, string accuracy_filename,
 /**
  * Set of instructions to get the kNN classifiction started.
  *
+ * @param index_file    Where to save the trained model; "" to not save it.
  * @param training_set  The dataset to compare against.
  * @param testing_set   The dataset with examples to classify.
+ * @param min_values    Attribute values normalized to 0 (saved with the model).
+ * @param max_values    Attribute values normalized to 1 (saved with the model).
+ * @return The classification accuracy.
  */
-void runNearestNeighbour(const string knn_accuracy_file,
-                         const vector< vector<float> > training_set,
-                         const vector< vector<float> > testing_set)
+double runNearestNeighbour(const string knn_accuracy_file,
+                         const string index_file,
+                         const FeatureMatrix& training_set,
+                         const FeatureMatrix& testing_set,
+                         const vector<float>& min_values,
+                         const vector<float>& max_values)
 {
   cout << "\n=== " << params.k << "-Nearest Neighbours\n";
-  NearestNeighbour knn(params.k, params.num_features);
-  double accuracy = knn.learn(training_set, testing_set, params.verbose);
+  // With prototype reduction the model (and a saved index) only holds the
+  // prototypes.
+  FeatureMatrix prototypes(params.num_features);
+  if (params.reduce)
+  {
+    PrototypeReducer reducer(params.k, params.knn.metric,
+                             params.knn.num_threads);
+    Stopwatch stopwatch;
+    reducer.reduce(params.reduction, training_set, &prototypes);
+    const int size = training_set.get_num_rows();
+    const int kept = prototypes.get_num_rows();
+    cout << "Reduced " << size << " training examples to " << kept
+         << " prototypes by " << PrototypeReducer::methodName(params.reduction)
+         << " (" << 100.0 * kept / max(size, 1) << "% kept, compression "
+         << static_cast<double>(size) / max(kept, 1) << ":1) in "
+         << stopwatch.seconds() << " s with "
+         << reducer.get_distance_evaluations() << " distance evaluations\n";
+  }
+  const FeatureMatrix& model_set = params.reduce ? prototypes : training_set;
+
+  FeatureMatrix initial_set(params.num_features);  // Outlives knn.
+  NearestNeighbour knn(params.k, params.num_features, params.num_classes,
+                       params.knn);
+  double accuracy;
+  if (params.stream_percent > 0)
+  {
+    // Build on the first part of the training set, then insert the rest one
+    // example at a time as if it arrived later.
+    const int size = model_set.get_num_rows();
+    const int initial = size - size * min(params.stream_percent, 100) / 100;
+    initial_set.reserve(initial);
+    for (int i = 0; i < initial; ++i)
+      initial_set.appendRow(model_set, i);
+    knn.buildIndex(initial_set);
+    // Removals are spread evenly over the ids of all the examples, built and
+    // inserted; one is due after each insert, once its example is in.
+    const int removals = size * min(params.stream_remove_percent, 100) / 100;
+    int removed = 0;
+    Stopwatch stopwatch;
+    for (int i = initial; i < size; ++i)
+    {
+      knn.insert(model_set.row(i), model_set.label(i));
+      const long id = static_cast<long>(removed) * size / max(removals, 1);
+      if (removed < removals && id <= i)
+      {
+        knn.remove(id);
+        ++removed;
+      }
+    }
+    for (; removed < removals; ++removed)
+      knn.remove(static_cast<long>(removed) * size / removals);
+    cout << "Inserted " << size - initial;
+    if (removals > 0) cout << " and removed " << removals;
+    cout << " training examples in " << stopwatch.seconds() << " s\n";
+    accuracy = knn.test(testing_set, params.verbose);
+  }
+  else
+  {
+    accuracy = knn.learn(model_set, testing_set, params.verbose);
+  }
   appendData(knn_accuracy_file, accuracy);
+  if (params.reduce)
+  {
+    // The same classifier on every training example, for comparison.
+    cout << "Without prototype reduction:\n";
+    NearestNeighbour full(params.k, params.num_features, params.num_classes,
+                          params.knn);
+    const double full_accuracy = full.learn(training_set, testing_set, false);
+    cout << "Prototype reduction changed the accuracy by "
+         << showpos << accuracy - full_accuracy << noshowpos
+         << " percentage points\n\n";
+  }
+  if (params.k_sweep > 0) knn.reportKSweep(testing_set, params.k_sweep);
+
+  if (index_file != "")
+  {
+    knn.compact();  // Saves the engine with every inserted example in it.
+    vector<char> structure;
+    if (!knn.saveIndex(structure))
+    {
+      if (params.knn.num_shards > 1)
+        cerr << "(!) A sharded kNN model cannot be saved\n";
+      else
+        cerr << "(!) The " << knn.get_engine() << " engine cannot be saved\n";
+      abort();
+    }
+    KnnIndexFile::write(index_file, knn.get_training_set(),
+                        params.num_classes, params.knn.metric,
+                        knn.get_engine(), min_values, max_values,
+                        params.knn.binary_columns, structure);
+    cout << "Saved the kNN model to " << index_file << "\n";
+  }
+  return accuracy;
 }
 
 
@@ -289,6 +419,28 @@ void readUserParameters(string file_name)
 }
 
 
+/**
+ * Scales each attribute value:  x = (x - x_min) / (x_max - x_min)
+ *
+ * @param db_table    The example cases to scale.
+ * @param min_values  The value of each attribute that maps to 0.
+ * @param max_values  The value of each attribute that maps to 1.
+ */
+void scaleData(FeatureMatrix& db_table, const vector<float>& min_values,
+               const vector<float>& max_values)
+{
+  for (int i = 0; i < db_table.get_num_rows(); ++i)
+  {
+    float* instance = db_table.row(i);
+    for (int j = 0; j < params.num_features; ++j)
+    {
+      instance[j] = (instance[j] - min_values[j]) /
+                    (max_values[j] - min_values[j]);
+    }
+  }
+}
+
+
 /**
  * Normalizes the sample data. All numeric variables are scaled to a range of
  * [0,1]. All parameters should have the same scale for a fair comparison.
@@ -297,8 +449,11 @@ void readUserParameters(string file_name)
  * See: http://www.dataminingblog.com/standardization-vs-normalization
  * 
  * @param db_table  Database table with all the example cases to be normalized.
+ * @param min_values  Receives the value of each attribute that maps to 0.
+ * @param max_values  Receives the value of each attribute that maps to 1.
  */
-void normalizeData(vector< vector<float> >& db_table)
+void normalizeData(FeatureMatrix& db_table, vector<float>& min_values,
+                   vector<float>& max_values)
 {
   // TODO: consider Winsorizing the data.
   // “Winsorizing” data simlpy means clamping the extreme values.
@@ -314,7 +469,8 @@ void normalizeData(vector< vector<float> >& db_table)
   // scale the “normal” data to a very small interval. Generally, most data sets
   // have outliers. If your data contains several outliers, use standardization.
   
-  vector<float> min_values, max_values;
+  min_values.clear();
+  max_values.clear();
   for (int i = 0; i < params.num_features; ++i)
   {
     min_values.push_back(numeric_limits<float>::max());
@@ -324,25 +480,41 @@ void normalizeData(vector< vector<float> >& db_table)
   // Search all instances to find the min and max values for each attribute.
   for (int i = 0; i < params.num_instances; ++i)
   {
-    // Note: ignores the class data at the end of each instance.
+    // Note: the class data is kept apart from the attributes.
+    const float* instance = db_table.row(i);
     for (int j = 0; j < params.num_features; ++j)
     { 
-      if (db_table[i][j] < min_values[j])  // Update min value for attribute.
-        min_values[j] = db_table[i][j];
-      if (db_table[i][j] > max_values[j])  // Update max value for attribute.
-        max_values[j] = db_table[i][j];
+      if (instance[j] < min_values[j])  // Update min value for attribute.
+        min_values[j] = instance[j];
+      if (instance[j] > max_values[j])  // Update max value for attribute.
+        max_values[j] = instance[j];
     }
   }
   
-  // Scale each attribute value:  x = (x - x_min) / (x_max - x_min)
+  scaleData(db_table, min_values, max_values);
+}
+
+
+/**
+ * Finds the attributes that only take the values 0 and 1 (after
+ * normalization, every two-valued attribute does). The kNN packs these into
+ * bits; see BitPackedMatrix.h.
+ *
+ * @param db_table  Database table with all the example cases.
+ * @return One flag per attribute, true if it is binary.
+ */
+vector<bool> findBinaryColumns(const FeatureMatrix& db_table)
+{
+  vector<bool> binary(params.num_features, true);
   for (int i = 0; i < params.num_instances; ++i)
   {
+    const float* instance = db_table.row(i);
     for (int j = 0; j < params.num_features; ++j)
     {
-      db_table[i][j] = (db_table[i][j] - min_values[j]) /
-                       (max_values[j] - min_values[j]);
+      if (instance[j] != 0.0f && instance[j] != 1.0f) binary[j] = false;
     }
   }
+  return binary;
 }
 
 
@@ -355,9 +527,9 @@ void normalizeData(vector< vector<float> >& db_table)
  * @param training_set    Training set to be populated with data.
  * @param testing_set     Testing set to be populated with data.
  */
-void prepareData(const vector< vector<float> >& db_table,
-                 vector< vector<float> >& training_set,
-                 vector< vector<float> >& testing_set)
+void prepareData(const FeatureMatrix& db_table,
+                 FeatureMatrix& training_set,
+                 FeatureMatrix& testing_set)
 {
   // Assuming the data is ordered by classification type, the data can be
   // partitioned into sets of multiple types. Those sets can then be shuffled.
@@ -367,8 +539,9 @@ void prepareData(const vector< vector<float> >& db_table,
   // The remaining cases will then be used for the testing set.
 
   // Create a table partitioned by classification type.
-  vector< deque< vector<float> > > parted_db_table;
-  deque< vector<float> > cases; // The cases for every classification type.
+  // The partitions hold row indices into db_table, not copies of the rows.
+  vector< deque<int> > parted_db_table;
+  deque<int> cases; // The cases for every classification type.
 
   // Make room for all the classes within the parted table.
   for (int i = 0; i < params.num_classes; ++i)
@@ -379,7 +552,7 @@ void prepareData(const vector< vector<float> >& db_table,
   for (example = 0; example < params.num_instances; ++example)
   {
     // Get the classification of the current instance.
-    int classification = db_table[example][params.num_features];
+    int classification = db_table.label(example);
     #if 0
     // In the original datasets from the Semeion Research Center of
     // Sciences of Communication, the label of each instance is indicated with
@@ -398,7 +571,7 @@ void prepareData(const vector< vector<float> >& db_table,
     }
     #endif
     // Push the instance in the appropriate partition.
-    parted_db_table.at(classification - 1).push_back(db_table.at(example));
+    parted_db_table.at(classification - 1).push_back(example);
   }
 
   // Shuffle every partition.
@@ -410,6 +583,10 @@ void prepareData(const vector< vector<float> >& db_table,
   int num_testing_cases = example - num_training_cases;
   cout << "Training cases: " << num_training_cases << "\nTesting cases: "
        << num_testing_cases << "\n";
+  training_set = FeatureMatrix(params.num_features);
+  testing_set = FeatureMatrix(params.num_features);
+  training_set.reserve(num_training_cases);
+  testing_set.reserve(num_testing_cases);
 
   // Fills the training set with an equal amount of cases from each partition,
   // by grabbing the first case from each partition and then popping it.
@@ -421,7 +598,7 @@ void prepareData(const vector< vector<float> >& db_table,
       if (!parted_db_table.at(i).empty()) // Add instance if any left.
       {
         ++count;
-        training_set.push_back(parted_db_table.at(i).front());
+        training_set.appendRow(db_table, parted_db_table.at(i).front());
         parted_db_table.at(i).pop_front();
       }
     }
@@ -433,7 +610,7 @@ void prepareData(const vector< vector<float> >& db_table,
   {
     while (!parted_db_table.at(i).empty()) 
     {
-      testing_set.push_back(parted_db_table.at(i).front());
+      testing_set.appendRow(db_table, parted_db_table.at(i).front());
       parted_db_table.at(i).pop_front();
     }
   }
@@ -443,30 +620,39 @@ void prepareData(const vector< vector<float> >& db_table,
 /**
  * Reads in the data from a file and stores it in the table.
  * Expects data to have one instance per line and attribute values separated
- * by whitespace (e.g. tab).
+ * by whitespace (e.g. tab). The value following the num_features attributes
+ * is the classification of the instance.
  *
  * @param file      File that contains the dataset.
  * @param db_table	Database that will hold all cases and their input patterns
  */
-void readData(string file, vector< vector<float> >& db_table)
+void readData(string file, FeatureMatrix& db_table)
 { 
   ifstream file_stream(file.c_str());
   if (file_stream.is_open())
   {
+    db_table = FeatureMatrix(params.num_features);
+    vector<float> instance;
     string line;
     for (int line_num = 0; file_stream.good(); ++line_num)
     {
       getline(file_stream,line);  // Read a single training instance.
       if (line == "") break;
-      db_table.push_back(vector<float>()); // Create space for current instance.
 
       // Split the line into numeric values.
       float attribute;
+      instance.clear();
       istringstream iss(line, istringstream::in);
       while (iss >> attribute)
-        db_table.at(line_num).push_back(attribute);
+        instance.push_back(attribute);
+      if (static_cast<int>(instance.size()) <= params.num_features)
+      {
+        cerr << "(!) Instance on line " << line_num + 1 << " has no class.\n";
+        assert(false);
+      }
+      db_table.appendRow(&instance[0], instance[params.num_features]);
     }
-    params.num_instances = static_cast<int>(db_table.size());
+    params.num_instances = db_table.get_num_rows();
     file_stream.close();
   }
   else
@@ -477,6 +663,116 @@ void readData(string file, vector< vector<float> >& db_table)
 }
 
 
+/**
+ * Classifies every example of a dataset with a kNN model saved by
+ * runNearestNeighbour(). The examples are normalized like the training set
+ * of the model was.
+ *
+ * @param index_file   The saved model.
+ * @param dataset_file The examples to classify (with their labels).
+ */
+void runSavedNearestNeighbour(const string knn_accuracy_file,
+                              const string index_file,
+                              const string dataset_file)
+{
+  cout << "\n=== " << params.k << "-Nearest Neighbours (saved model)\n";
+  Stopwatch stopwatch;
+  KnnIndexFile model;
+  model.open(index_file);
+  const FeatureMatrix& training_set = model.training_set();
+  params.num_features = training_set.get_num_features();
+  params.num_classes = model.get_num_classes();
+  params.knn.engine = model.get_engine();
+  params.knn.metric = model.get_metric();
+  params.knn.binary_columns = model.binary_columns();
+  NearestNeighbour knn(params.k, params.num_features, params.num_classes,
+                       params.knn);
+  knn.restoreIndex(training_set, model.structure(), model.structure_bytes());
+  cout << "Loaded " << params.knn.engine << " model of "
+       << training_set.get_num_rows() << " training examples from "
+       << index_file << " in " << stopwatch.seconds() << " s\n";
+
+  FeatureMatrix testing_set;
+  readData(dataset_file, testing_set);
+  scaleData(testing_set, model.min_values(), model.max_values());
+  cout << "Testing cases: " << testing_set.get_num_rows() << "\n";
+  double accuracy = knn.test(testing_set, params.verbose);
+  appendData(knn_accuracy_file, accuracy);
+  if (params.k_sweep > 0) knn.reportKSweep(testing_set, params.k_sweep);
+}
+
+
+/**
+ * Fits the projection on the training set and replaces the training set,
+ * the testing set and the dataset with their projections. The projected
+ * attributes are no longer binary.
+ */
+void runProjection(FeatureMatrix& db_table, FeatureMatrix& training_set,
+                   FeatureMatrix& testing_set)
+{
+  Stopwatch stopwatch;
+  Projection projection(params.projection, params.dimensions,
+                        params.explained_variance);
+  projection.fit(training_set);
+  projection.apply(training_set, &training_set);
+  projection.apply(testing_set, &testing_set);
+  projection.apply(db_table, &db_table);
+  cout << "\nProjected " << params.num_features << " attributes to "
+       << projection.get_num_outputs() << " by "
+       << Projection::methodName(params.projection);
+  if (params.projection == Projection::kPca)
+    cout << " (" << 100.0 * projection.get_explained_variance()
+         << "% of the variance)";
+  cout << " in " << stopwatch.seconds() << " s\n";
+  params.num_features = projection.get_num_outputs();
+  params.knn.binary_columns.assign(params.num_features, false);
+}
+
+
+/**
+ * Runs kNN on the attributes as they were before the projection and
+ * reports what the projection changed.
+ *
+ * @param knn_parameters The kNN settings for the original attributes.
+ * @param projected_accuracy Accuracy of kNN on the projected attributes.
+ * @param projected_seconds Time kNN took on the projected attributes.
+ */
+void compareProjection(const FeatureMatrix& training_set,
+                       const FeatureMatrix& testing_set,
+                       const KnnParameters& knn_parameters,
+                       const double projected_accuracy,
+                       const double projected_seconds)
+{
+  cout << "Without the projection:\n";
+  Stopwatch stopwatch;
+  NearestNeighbour knn(params.k, training_set.get_num_features(),
+                       params.num_classes, knn_parameters);
+  const double accuracy = knn.learn(training_set, testing_set, false);
+  const double seconds = stopwatch.seconds();
+  cout << "The projection changed the kNN accuracy by " << showpos
+       << projected_accuracy - accuracy << noshowpos
+       << " percentage points; kNN took " << projected_seconds
+       << " s instead of " << seconds << " s (" << seconds / projected_seconds
+       << "x)\n";
+}
+
+
+/**
+ * Leave-one-out evaluation of kNN: every example of the dataset is
+ * classified by all the others, for every k up to the sweep limit (or the
+ * configured k without a sweep).
+ *
+ * @param db_table The complete (normalized) dataset.
+ */
+void runLeaveOneOut(const FeatureMatrix& db_table)
+{
+  NearestNeighbour knn(params.k, params.num_features, params.num_classes,
+                       params.knn);
+  knn.buildIndex(db_table);
+  knn.reportLeaveOneOut(params.k_sweep > 0 ? params.k_sweep : params.k);
+}
+
+
 /**
  * @todo FINAL = RELEASE MODE!
  * @todo autoformat code (ALT+SHIFT+F)
@@ -502,9 +798,65 @@ int main(int argc, char** argv)
     string ann_train_accuracy_filename = "ann-train-accuracy.out";
     string ann_test_accuracy_filename = "ann-test-accuracy.out";
     string knn_accuracy_filename = "knn-accuracy.out";
+    string save_index_filename = "";
+    string load_index_filename = "";
     int c;
 
-    while ((c = getopt(argc, argv, "c:d:s:t:e:a:z:k:pov")) != -1)
+    // Tuning options for the kNN engines only have a long form.
+    enum LongOption
+    {
+      kLeafSize = 256, kPivots, kHnswM, kEfConstruction, kEfSearch, kNlist,
+      kNprobe, kPqSubquantizers, kRerank, kLshTables,
+      kLshBits, kLshWidth, kLshProbes, kStorage, kNoBitPack,
+      kBatch, kThreads, kRecallReport, kSaveIndex, kLoadIndex, kStream,
+      kKSweep, kLeaveOneOut, kVote, kEarlyAbandon, kVarianceOrder, kReduce,
+      kProject, kDimensions, kExplainedVariance, kShards,
+      kStreamRemove, kCascadeColumns, kCascadeFactor, kBudget, kDeadline, kAnytimeOrder
+    };
+    static const struct option long_options[] =
+    {
+      {"leaf-size", required_argument, NULL, kLeafSize},
+      {"pivots", required_argument, NULL, kPivots},
+      {"hnsw-m", required_argument, NULL, kHnswM},
+      {"ef-construction", required_argument, NULL, kEfConstruction},
+      {"ef-search", required_argument, NULL, kEfSearch},
+      {"nlist", required_argument, NULL, kNlist},
+      {"nprobe", required_argument, NULL, kNprobe},
+      {"pq-m", required_argument, NULL, kPqSubquantizers},
+      {"rerank", required_argument, NULL, kRerank},
+      {"lsh-tables", required_argument, NULL, kLshTables},
+      {"lsh-bits", required_argument, NULL, kLshBits},
+      {"lsh-width", required_argument, NULL, kLshWidth},
+      {"lsh-probes", required_argument, NULL, kLshProbes},
+      {"storage", required_argument, NULL, kStorage},
+      {"no-bit-pack", no_argument, NULL, kNoBitPack},
+      {"batch", required_argument, NULL, kBatch},
+      {"threads", required_argument, NULL, kThreads},
+      {"recall-report", no_argument, NULL, kRecallReport},
+      {"save-index", required_argument, NULL, kSaveIndex},
+      {"load-index", required_argument, NULL, kLoadIndex},
+      {"stream", required_argument, NULL, kStream},
+      {"stream-remove", required_argument, NULL, kStreamRemove},
+      {"k-sweep", required_argument, NULL, kKSweep},
+      {"leave-one-out", no_argument, NULL, kLeaveOneOut},
+      {"vote", required_argument, NULL, kVote},
+      {"early-abandon", no_argument, NULL, kEarlyAbandon},
+      {"variance-order", no_argument, NULL, kVarianceOrder},
+      {"reduce", required_argument, NULL, kReduce},
+      {"project", required_argument, NULL, kProject},
+      {"dimensions", required_argument, NULL, kDimensions},
+      {"explained-variance", required_argument, NULL, kExplainedVariance},
+      {"shards", required_argument, NULL, kShards},
+      {"cascade-columns", required_argument, NULL, kCascadeColumns},
+      {"cascade-factor", required_argument, NULL, kCascadeFactor},
+      {"budget", required_argument, NULL, kBudget},
+      {"deadline", required_argument, NULL, kDeadline},
+      {"anytime-order", required_argument, NULL, kAnytimeOrder},
+      {NULL, 0, NULL, 0}
+    };
+
+    while ((c = getopt_long(argc, argv, "c:d:s:t:e:a:z:k:povfn:m:", long_options,
+                            NULL)) != -1)
     {
       switch (c)
       {
@@ -541,6 +893,164 @@ int main(int argc, char** argv)
         case 'v':
           params.verbose = true;
           break;
+        case 'f':  // Faster, less accurate kNN distances.
+          params.float_accumulation = true;
+          break;
+        case 'n':  // Search engine for kNN.
+          params.knn.engine = optarg;
+          break;
+        case 'm':  // Distance metric for kNN.
+          if (!parseMetric(optarg, &params.knn.metric))
+          {
+            cerr << "(!) Unknown metric: " << optarg << "\n";
+            abort();
+          }
+          break;
+        case kLeafSize:
+          params.knn.leaf_size = atoi(optarg);
+          break;
+        case kPivots:
+          params.knn.num_pivots = atoi(optarg);
+          break;
+        case kHnswM:
+          params.knn.hnsw_m = atoi(optarg);
+          break;
+        case kEfConstruction:
+          params.knn.ef_construction = atoi(optarg);
+          break;
+        case kEfSearch:
+          params.knn.ef_search = atoi(optarg);
+          break;
+        case kNlist:
+          params.knn.nlist = atoi(optarg);
+          break;
+        case kNprobe:
+          params.knn.nprobe = atoi(optarg);
+          break;
+        case kPqSubquantizers:
+          params.knn.pq_subquantizers = atoi(optarg);
+          break;
+        case kRerank:
+          params.knn.rerank = atoi(optarg);
+          break;
+        case kLshTables:
+          params.knn.lsh_tables = atoi(optarg);
+          break;
+        case kLshBits:
+          params.knn.lsh_bits = atoi(optarg);
+          break;
+        case kLshWidth:
+          params.knn.lsh_width = atof(optarg);
+          break;
+        case kLshProbes:
+          params.knn.lsh_probes = atoi(optarg);
+          break;
+        case kStorage:
+        {
+          CompressedMatrix::Precision precision;
+          if (strcmp(optarg, "float") != 0 &&
+              !CompressedMatrix::parsePrecision(optarg, &precision))
+          {
+            cerr << "(!) Unknown storage: " << optarg << "\n";
+            abort();
+          }
+          params.knn.storage = optarg;
+          break;
+        }
+        case kNoBitPack:
+          params.knn.bit_pack = false;
+          break;
+        case kBatch:
+          params.knn.batch_size = atoi(optarg);
+          break;
+        case kThreads:
+          params.knn.num_threads = atoi(optarg);
+          break;
+        case kRecallReport:
+          params.knn.recall_report = true;
+          break;
+        case kSaveIndex:
+          save_index_filename = optarg;
+          break;
+        case kLoadIndex:
+          load_index_filename = optarg;
+          break;
+        case kStream:
+          params.stream_percent = atoi(optarg);
+          break;
+        case kStreamRemove:
+          params.stream_remove_percent = atoi(optarg);
+          break;
+        case kKSweep:
+          params.k_sweep = atoi(optarg);
+          break;
+        case kLeaveOneOut:
+          params.leave_one_out = true;
+          break;
+        case kVote:
+          if (!NearestNeighbour::parseVote(optarg, &params.knn.vote))
+          {
+            cerr << "(!) Unknown vote: " << optarg << "\n";
+            abort();
+          }
+          break;
+        case kEarlyAbandon:
+          params.knn.early_abandon = true;
+          break;
+        case kVarianceOrder:
+          params.knn.early_abandon = true;
+          params.knn.variance_order = true;
+          break;
+        case kReduce:
+          if (!PrototypeReducer::parseMethod(optarg, &params.reduction))
+          {
+            cerr << "(!) Unknown prototype reduction: " << optarg << "\n";
+            abort();
+          }
+          params.reduce = true;
+          break;
+        case kProject:
+          if (!Projection::parseMethod(optarg, &params.projection))
+          {
+            cerr << "(!) Unknown projection: " << optarg << "\n";
+            abort();
+          }
+          params.project = true;
+          break;
+        case kDimensions:
+          params.dimensions = atoi(optarg);
+          break;
+        case kExplainedVariance:
+          params.explained_variance = atof(optarg);
+          break;
+        case kShards:
+          params.knn.num_shards = atoi(optarg);
+          break;
+        case kCascadeColumns:
+          if (!CascadeIndex::parseColumns(optarg,
+                                          &params.knn.cascade_columns))
+          {
+            cerr << "(!) Bad cascade attributes: " << optarg << "\n";
+            abort();
+          }
+          break;
+        case kCascadeFactor:
+          params.knn.cascade_factor = atoi(optarg);
+          break;
+        case kBudget:
+          params.knn.anytime_budget = atol(optarg);
+          break;
+        case kDeadline:
+          params.knn.anytime_deadline = atof(optarg);
+          break;
+        case kAnytimeOrder:
+          if (strcmp(optarg, "class") != 0 && strcmp(optarg, "cluster") != 0)
+          {
+            cerr << "(!) Unknown anytime order: " << optarg << "\n";
+            abort();
+          }
+          params.knn.anytime_order = optarg;
+          break;
         default:
           abort();
       }
@@ -551,6 +1061,8 @@ int main(int argc, char** argv)
       printf("Non-option argument %s\n", argv[index]);
 
     srand(params.seed);
+    const DistanceKernels& kernels =
+        selectDistanceKernels(params.float_accumulation);
 
     cout << "Configuration file = " << config_filename
          << "\nDataset file = " << dataset_filename
@@ -560,18 +1072,61 @@ int main(int argc, char** argv)
          << "\nKNN accurary output file = " << knn_accuracy_filename
          << "\nRandom number seed = " << params.seed
          << "\nTraining : testing ratio = " << params.training_ratio << " : "
-         << 100 - params.training_ratio << "\n";
+         << 100 - params.training_ratio
+         << "\nkNN engine = " << params.knn.engine
+         << "\nkNN metric = " << metricName(params.knn.metric)
+         << "\nkNN vote = " << (params.knn.vote == kMajority ? "majority"
+                                                           : "distance")
+         << "\nkNN distance kernels = " << kernels.name
+         << (kernels.float_accumulation ? " (single" : " (double")
+         << " precision accumulation)\n";
 
     if (config_filename != "") readUserParameters(config_filename);
+    if (load_index_filename != "")
+    {
+      // A saved kNN model classifies the whole dataset; no ANN is trained.
+      runSavedNearestNeighbour(knn_accuracy_filename, load_index_filename,
+                               dataset_filename);
+      return 0;
+    }
     // Tables to store the complete database, training set, and testing set.
-    vector< vector<float> > db_table, training_set, testing_set;
+    FeatureMatrix db_table, training_set, testing_set;
     readData(dataset_filename, db_table);
     cout << "Number of instances = " << params.num_instances << "\n";
-    normalizeData(db_table);
+    vector<float> min_values, max_values;
+    normalizeData(db_table, min_values, max_values);
+    params.knn.binary_columns = findBinaryColumns(db_table);
+    cout << "Binary attributes = "
+         << count(params.knn.binary_columns.begin(),
+                  params.knn.binary_columns.end(), true)
+         << " of " << params.num_features << "\n";
     prepareData(db_table, training_set, testing_set);
+    // The attributes as loaded, for comparison with the projection.
+    FeatureMatrix original_training_set, original_testing_set;
+    const KnnParameters original_knn = params.knn;
+    if (params.project)
+    {
+      if (save_index_filename != "")
+      {
+        cerr << "(!) A kNN model on projected attributes cannot be saved\n";
+        abort();
+      }
+      original_training_set = training_set;
+      original_testing_set = testing_set;
+      runProjection(db_table, training_set, testing_set);
+    }
     runNeuralNetwork(ann_train_error_filename, ann_train_accuracy_filename,
                      ann_test_accuracy_filename, training_set, testing_set);
-    runNearestNeighbour(knn_accuracy_filename, training_set, testing_set);
+    Stopwatch knn_stopwatch;
+    const double knn_accuracy =
+        runNearestNeighbour(knn_accuracy_filename, save_index_filename,
+                            training_set, testing_set, min_values, max_values);
+    if (params.project)
+    {
+      compareProjection(original_training_set, original_testing_set,
+                        original_knn, knn_accuracy, knn_stopwatch.seconds());
+    }
+    if (params.leave_one_out) runLeaveOneOut(db_table);
   }
   catch (exception& ex) // TODO: improve exception handling.
   {